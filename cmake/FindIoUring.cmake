@@ -0,0 +1,46 @@
+# - Check for the io_uring kernel interface
+# Once done, this will define
+#
+#  IOURING_FOUND - the kernel headers declare the io_uring interface
+#  IOURING_INCLUDE_DIR - the directory containing linux/io_uring.h
+#
+# The interface is used through the raw system calls: there is no library to
+# link against (liburing is not needed).
+
+find_path(IOURING_INCLUDE_DIR
+    linux/io_uring.h
+    HINTS
+    PATH_SUFFIXES
+    include
+    )
+
+mark_as_advanced(IOURING_INCLUDE_DIR)
+
+if(IOURING_INCLUDE_DIR)
+    # the scheduler needs the non-vectored opcodes and the opcodes probing
+    # (Linux 5.6 headers)
+    include(CheckCSourceCompiles)
+    set(CMAKE_REQUIRED_INCLUDES ${IOURING_INCLUDE_DIR})
+    check_c_source_compiles("
+        #include <linux/io_uring.h>
+        #include <sys/syscall.h>
+        int main(void)
+        {
+            long nr = __NR_io_uring_setup + __NR_io_uring_enter
+                      + __NR_io_uring_register;
+            return (int)nr + IORING_OP_READ + IORING_REGISTER_PROBE;
+        }"
+        IOURING_INTERFACE_COMPILES)
+    unset(CMAKE_REQUIRED_INCLUDES)
+endif()
+
+include(FindPackageHandleStandardArgs)
+find_package_handle_standard_args(IoUring
+    DEFAULT_MSG
+    IOURING_INCLUDE_DIR
+    IOURING_INTERFACE_COMPILES)
+
+if(IOURING_FOUND)
+    set(HAS_IO_URING ON)
+    set(HAS_IO_URING ${HAS_IO_URING} PARENT_SCOPE)
+endif()
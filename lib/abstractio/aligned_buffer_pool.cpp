@@ -0,0 +1,78 @@
+#include <sse/schemes/abstractio/aligned_buffer_pool.hpp>
+
+#include <cassert>
+
+#include <algorithm>
+#include <new>
+
+namespace sse {
+namespace abstractio {
+
+static size_t round_up(size_t size, size_t alignment)
+{
+    return ((size + alignment - 1) / alignment) * alignment;
+}
+
+AlignedBufferPool::AlignedBufferPool(size_t buffer_size,
+                                     size_t alignment,
+                                     size_t capacity)
+    : m_buffer_size(round_up(std::max<size_t>(buffer_size, 1), alignment)),
+      m_alignment(alignment), m_capacity(capacity), m_free_buffers(capacity)
+{
+    if (m_capacity == 0) {
+        return;
+    }
+
+    void* region = nullptr;
+    int   ret
+        = posix_memalign(&region, m_alignment, m_capacity * m_buffer_size);
+    if (ret != 0 || region == nullptr) {
+        throw std::bad_alloc();
+    }
+    m_region = static_cast<uint8_t*>(region);
+
+    for (size_t i = 0; i < m_capacity; i++) {
+        bool pushed = m_free_buffers.try_push(m_region + i * m_buffer_size);
+        (void)pushed;
+        assert(pushed);
+    }
+}
+
+AlignedBufferPool::~AlignedBufferPool()
+{
+    free(m_region);
+}
+
+void* AlignedBufferPool::acquire()
+{
+    void* buf = nullptr;
+    if (m_free_buffers.try_pop(buf)) {
+        return buf;
+    }
+
+    // the pool is exhausted
+    int ret = posix_memalign(&buf, m_alignment, m_buffer_size);
+    if (ret != 0 || buf == nullptr) {
+        throw std::bad_alloc();
+    }
+    return buf;
+}
+
+void AlignedBufferPool::release(void* buf) noexcept
+{
+    if (buf == nullptr) {
+        return;
+    }
+    if (!owns(buf)) {
+        free(buf);
+        return;
+    }
+
+    // the queue can hold all the pooled buffers
+    bool pushed = m_free_buffers.try_push(buf);
+    (void)pushed;
+    assert(pushed);
+}
+
+} // namespace abstractio
+} // namespace sse
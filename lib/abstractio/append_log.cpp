@@ -0,0 +1,105 @@
+#include <sse/schemes/abstractio/append_log.hpp>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstring>
+
+#include <stdexcept>
+
+namespace sse {
+namespace abstractio {
+
+constexpr size_t AppendLog::kDefaultBufferSize;
+
+static std::string errno_string(int err)
+{
+    return std::to_string(err) + " (" + strerror(err) + ")";
+}
+
+AppendLog::AppendLog(std::string path, size_t buffer_size)
+    : m_path(std::move(path)), m_buffer_size(buffer_size)
+{
+    m_fd = ::open(m_path.c_str(), O_CREAT | O_RDWR | O_TRUNC, 0644);
+    if (m_fd == -1) {
+        throw std::runtime_error("Unable to open the append log " + m_path
+                                 + ": errno " + errno_string(errno));
+    }
+    m_buffer.reserve(m_buffer_size);
+}
+
+AppendLog::~AppendLog()
+{
+    if (m_fd != -1) {
+        ::close(m_fd);
+        ::unlink(m_path.c_str());
+    }
+}
+
+uint64_t AppendLog::append(const void* data, size_t length)
+{
+    const uint64_t offset = size();
+    const auto*    bytes  = static_cast<const uint8_t*>(data);
+
+    if (m_buffer.size() + length > m_buffer_size) {
+        flush();
+    }
+    if (length >= m_buffer_size) {
+        // do not copy large records in the staging buffer
+        write_all(bytes, length);
+        m_flushed_size += length;
+    } else {
+        m_buffer.insert(m_buffer.end(), bytes, bytes + length);
+    }
+    return offset;
+}
+
+void AppendLog::flush()
+{
+    write_all(m_buffer.data(), m_buffer.size());
+    m_flushed_size += m_buffer.size();
+    m_buffer.clear();
+}
+
+void AppendLog::read(uint64_t offset, void* data, size_t length) const
+{
+    if (offset + length > m_flushed_size) {
+        throw std::out_of_range("Append log read past the flushed records");
+    }
+
+    auto* bytes = static_cast<uint8_t*>(data);
+    while (length > 0) {
+        ssize_t res = ::pread(m_fd, bytes, length, static_cast<off_t>(offset));
+        if (res < 0 && errno == EINTR) {
+            continue;
+        }
+        if (res <= 0) {
+            throw std::runtime_error("Error during the append log pread: "
+                                     + (res == 0 ? std::string("end of file")
+                                                 : errno_string(errno)));
+        }
+        bytes += res;
+        offset += static_cast<uint64_t>(res);
+        length -= static_cast<size_t>(res);
+    }
+}
+
+void AppendLog::write_all(const uint8_t* data, size_t length)
+{
+    while (length > 0) {
+        ssize_t res = ::write(m_fd, data, length);
+        if (res < 0 && errno == EINTR) {
+            continue;
+        }
+        if (res < 0) {
+            throw std::runtime_error("Error during the append log write: "
+                                     + errno_string(errno));
+        }
+        data += res;
+        length -= static_cast<size_t>(res);
+    }
+}
+
+} // namespace abstractio
+} // namespace sse
@@ -0,0 +1,689 @@
+#include "configure.hpp"
+
+#ifdef HAS_IO_URING
+
+#include "io_uring_scheduler.hpp"
+#include "utils/utils.hpp"
+
+#include <cassert>
+#include <cerrno>
+#include <cstring>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+
+namespace sse {
+namespace abstractio {
+
+// user_data of the no-op used to wake the completion thread up
+static constexpr uint64_t kWakeUpTag = UINT64_MAX;
+
+// idle time (in ms) after which the kernel polling thread goes to sleep
+static constexpr unsigned kSqThreadIdle = 1000;
+
+// maximum number of entries handed to the kernel by a single io_uring_enter
+static constexpr size_t kMaxBatchSize = 256;
+
+static constexpr unsigned kProbeOpsCount = 256;
+
+static int sys_io_uring_setup(unsigned entries, struct io_uring_params* p)
+{
+    long ret = syscall(__NR_io_uring_setup, entries, p);
+    return (ret < 0) ? -errno : static_cast<int>(ret);
+}
+
+static int sys_io_uring_enter(int      fd,
+                              unsigned to_submit,
+                              unsigned min_complete,
+                              unsigned flags)
+{
+    long ret = syscall(
+        __NR_io_uring_enter, fd, to_submit, min_complete, flags, nullptr, 0);
+    return (ret < 0) ? -errno : static_cast<int>(ret);
+}
+
+static int sys_io_uring_register(int         fd,
+                                 unsigned    opcode,
+                                 const void* arg,
+                                 unsigned    nr_args)
+{
+    long ret = syscall(__NR_io_uring_register, fd, opcode, arg, nr_args);
+    return (ret < 0) ? -errno : static_cast<int>(ret);
+}
+
+// The ring indices are shared with the kernel: accesses to the indices
+// written by the other side need acquire/release semantics.
+static inline unsigned load_acquire(const unsigned* p)
+{
+    return __atomic_load_n(p, __ATOMIC_ACQUIRE);
+}
+
+static inline void store_release(unsigned* p, unsigned v)
+{
+    __atomic_store_n(p, v, __ATOMIC_RELEASE);
+}
+
+IoUringScheduler::IoUringScheduler(const size_t   page_size,
+                                   const unsigned queue_depth,
+                                   bool           sqpoll)
+    : m_page_size(page_size), m_queue_depth(std::max(queue_depth, 1U)),
+      m_sqpoll(sqpoll)
+{
+    setup_rings(m_queue_depth);
+
+    // the completion ring holds (m_cq_mask + 1) entries: keep one for the
+    // wake-up no-op
+    m_requests.resize(m_cq_mask);
+    m_free_slots.reserve(m_cq_mask);
+    for (uint32_t i = m_cq_mask; i > 0; i--) {
+        m_free_slots.push_back(i - 1);
+    }
+
+    m_completion_thread = std::thread(&IoUringScheduler::completion_loop, this);
+}
+
+IoUringScheduler::~IoUringScheduler()
+{
+    IoUringScheduler::wait_completions();
+
+    release_rings();
+
+#ifdef LOG_AIO_SCHEDULER_STATS
+    std::cerr << "io_uring_enter: " << m_enter_calls << " calls\n";
+    std::cerr << m_submit_partial << " partial submissions\n";
+    std::cerr << m_slots_exhausted << " with no free request slot\n";
+    std::cerr << m_completed_queries_count << " completed queries\n";
+    std::cerr << m_failed_queries_count.load() << " failed queries\n";
+#endif
+}
+
+void IoUringScheduler::setup_rings(const unsigned queue_depth)
+{
+    struct io_uring_params params;
+    memset(&params, 0, sizeof(params));
+
+    if (m_sqpoll) {
+        params.flags          = IORING_SETUP_SQPOLL;
+        params.sq_thread_idle = kSqThreadIdle;
+    }
+
+    int fd = sys_io_uring_setup(queue_depth, &params);
+
+    if (fd < 0 && m_sqpoll) {
+        // SQPOLL requires privileges on older kernels: fall back to
+        // submissions through io_uring_enter
+        memset(&params, 0, sizeof(params));
+        m_sqpoll = false;
+        fd       = sys_io_uring_setup(queue_depth, &params);
+    }
+
+    if (fd < 0) {
+        throw std::runtime_error("Error initializing io_uring: "
+                                 + std::to_string(-fd) + "(" + strerror(-fd)
+                                 + ")\n");
+    }
+    m_ring_fd = fd;
+
+    auto fail = [this](const std::string& message, int err) {
+        release_rings();
+        throw std::runtime_error(message + std::to_string(err) + "("
+                                 + strerror(err) + ")\n");
+    };
+
+    // the scheduler relies on the non-vectored read and write opcodes (Linux
+    // 5.6)
+    std::vector<uint8_t> probe_buffer(
+        sizeof(struct io_uring_probe)
+        + kProbeOpsCount * sizeof(struct io_uring_probe_op));
+    auto* probe = reinterpret_cast<struct io_uring_probe*>(probe_buffer.data());
+
+    int ret = sys_io_uring_register(
+        m_ring_fd, IORING_REGISTER_PROBE, probe, kProbeOpsCount);
+    if (ret < 0) {
+        fail("Error probing io_uring opcodes: ", -ret);
+    }
+    for (uint8_t op : {IORING_OP_READ,
+                       IORING_OP_WRITE,
+                       IORING_OP_READ_FIXED,
+                       IORING_OP_WRITE_FIXED}) {
+        if (probe->last_op < op
+            || (probe->ops[op].flags & IO_URING_OP_SUPPORTED) == 0) {
+            fail("Unsupported io_uring opcode: ", EOPNOTSUPP);
+        }
+    }
+
+    m_sq_ring_size = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    m_cq_ring_size
+        = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+
+    const bool single_mmap = (params.features & IORING_FEAT_SINGLE_MMAP) != 0;
+    if (single_mmap) {
+        m_sq_ring_size = std::max(m_sq_ring_size, m_cq_ring_size);
+        m_cq_ring_size = 0;
+    }
+
+    m_sq_ring_ptr = mmap(nullptr,
+                         m_sq_ring_size,
+                         PROT_READ | PROT_WRITE,
+                         MAP_SHARED | MAP_POPULATE,
+                         m_ring_fd,
+                         IORING_OFF_SQ_RING);
+    if (m_sq_ring_ptr == MAP_FAILED) {
+        m_sq_ring_ptr = nullptr;
+        fail("Error mapping the io_uring submission ring: ", errno);
+    }
+
+    if (single_mmap) {
+        m_cq_ring_ptr = m_sq_ring_ptr;
+    } else {
+        m_cq_ring_ptr = mmap(nullptr,
+                             m_cq_ring_size,
+                             PROT_READ | PROT_WRITE,
+                             MAP_SHARED | MAP_POPULATE,
+                             m_ring_fd,
+                             IORING_OFF_CQ_RING);
+        if (m_cq_ring_ptr == MAP_FAILED) {
+            m_cq_ring_ptr = nullptr;
+            fail("Error mapping the io_uring completion ring: ", errno);
+        }
+    }
+
+    m_sqes_size = params.sq_entries * sizeof(struct io_uring_sqe);
+    void* sqes  = mmap(nullptr,
+                      m_sqes_size,
+                      PROT_READ | PROT_WRITE,
+                      MAP_SHARED | MAP_POPULATE,
+                      m_ring_fd,
+                      IORING_OFF_SQES);
+    if (sqes == MAP_FAILED) {
+        fail("Error mapping the io_uring submission entries: ", errno);
+    }
+    m_sqes = static_cast<struct io_uring_sqe*>(sqes);
+
+    auto* sq_ring = static_cast<uint8_t*>(m_sq_ring_ptr);
+    m_sq_khead    = reinterpret_cast<unsigned*>(sq_ring + params.sq_off.head);
+    m_sq_ktail    = reinterpret_cast<unsigned*>(sq_ring + params.sq_off.tail);
+    m_sq_kflags   = reinterpret_cast<unsigned*>(sq_ring + params.sq_off.flags);
+    m_sq_mask
+        = *reinterpret_cast<unsigned*>(sq_ring + params.sq_off.ring_mask);
+    m_sq_entries
+        = *reinterpret_cast<unsigned*>(sq_ring + params.sq_off.ring_entries);
+
+    // the submission entries are always used in the ring order: the
+    // indirection array can be filled once and for all
+    auto* sq_array = reinterpret_cast<unsigned*>(sq_ring + params.sq_off.array);
+    for (unsigned i = 0; i < m_sq_entries; i++) {
+        sq_array[i] = i;
+    }
+
+    auto* cq_ring = static_cast<uint8_t*>(m_cq_ring_ptr);
+    m_cq_khead    = reinterpret_cast<unsigned*>(cq_ring + params.cq_off.head);
+    m_cq_ktail    = reinterpret_cast<unsigned*>(cq_ring + params.cq_off.tail);
+    m_cq_mask
+        = *reinterpret_cast<unsigned*>(cq_ring + params.cq_off.ring_mask);
+    m_cqes = reinterpret_cast<struct io_uring_cqe*>(cq_ring
+                                                    + params.cq_off.cqes);
+}
+
+void IoUringScheduler::release_rings()
+{
+    if (m_sqes != nullptr) {
+        munmap(m_sqes, m_sqes_size);
+        m_sqes = nullptr;
+    }
+    if (m_cq_ring_ptr != nullptr && m_cq_ring_ptr != m_sq_ring_ptr) {
+        munmap(m_cq_ring_ptr, m_cq_ring_size);
+    }
+    m_cq_ring_ptr = nullptr;
+    if (m_sq_ring_ptr != nullptr) {
+        munmap(m_sq_ring_ptr, m_sq_ring_size);
+        m_sq_ring_ptr = nullptr;
+    }
+    if (m_ring_fd >= 0) {
+        close(m_ring_fd);
+        m_ring_fd = -1;
+    }
+}
+
+void IoUringScheduler::completion_loop()
+{
+    while (!m_stop_flag.load()
+           || ((m_completed_queries_count.load()
+                + m_failed_queries_count.load())
+               < m_submitted_queries_count.load())) {
+        wait_cqe();
+        reap_completions();
+    }
+}
+
+void IoUringScheduler::wait_cqe()
+{
+    int ret = sys_io_uring_enter(m_ring_fd, 0, 1, IORING_ENTER_GETEVENTS);
+
+    if (ret < 0 && ret != -EINTR) {
+        std::cerr << "Error in io_uring_enter: " << std::to_string(-ret) << "("
+                  << strerror(-ret) << ")\n";
+    }
+}
+
+void IoUringScheduler::reap_completions()
+{
+    for (;;) {
+        // the head is only written by the completion thread
+        const unsigned head = *m_cq_khead;
+        if (head == load_acquire(m_cq_ktail)) {
+            break;
+        }
+
+        const struct io_uring_cqe& cqe = m_cqes[head & m_cq_mask];
+        const uint64_t             tag = cqe.user_data;
+        const int32_t              res = cqe.res;
+
+        // hand the entry back before running the callback, which might reap
+        // completions itself
+        store_release(m_cq_khead, head + 1);
+
+        if (tag == kWakeUpTag) {
+            continue;
+        }
+
+        const auto slot     = static_cast<uint32_t>(tag);
+        Request&   req      = m_requests[slot];
+        auto       callback = std::move(req.m_callback);
+        void*      data     = req.m_user_data;
+        req.m_callback      = nullptr;
+
+        release_slots(&slot, 1);
+
+        if (callback) {
+            callback(data, res);
+        }
+        m_completed_queries_count.fetch_add(1);
+    }
+}
+
+int IoUringScheduler::check_args(void* buf, size_t len, off_t offset) const
+{
+    if (!utility::is_aligned(buf, m_page_size)) {
+        return -EINVAL_UNALIGNED_BUFFER;
+    }
+
+    if (len % 512 != 0) {
+        return -EINVAL_BUFFERSIZE;
+    }
+
+    if (offset % 512 != 0) {
+        return -EINVAL_UNALIGNED_ACCESS;
+    }
+
+    return 0;
+}
+
+void IoUringScheduler::wait_completions()
+{
+    if (!m_stop_flag.exchange(true)) {
+        // wake the completion thread up, in case it is waiting for an event
+        std::lock_guard<std::mutex> lock(m_sq_lock);
+
+        wait_sq_space();
+        struct io_uring_sqe* sqe = &m_sqes[*m_sq_ktail & m_sq_mask];
+        memset(sqe, 0, sizeof(*sqe));
+        sqe->opcode    = IORING_OP_NOP;
+        sqe->user_data = kWakeUpTag;
+
+        int err = 0;
+        flush_sq(1, err);
+    }
+
+    if (m_completion_thread.joinable()) {
+        m_completion_thread.join();
+    }
+}
+
+size_t IoUringScheduler::acquire_slots(uint32_t* slots, size_t max_count)
+{
+    std::unique_lock<std::mutex> lock(m_slots_lock);
+
+    if (m_free_slots.empty()) {
+#ifdef LOG_AIO_SCHEDULER_STATS
+        m_slots_exhausted++;
+#endif
+        if (std::this_thread::get_id() == m_completion_thread.get_id()) {
+            // called from a completion callback: no one else can free a slot
+            while (m_free_slots.empty()) {
+                lock.unlock();
+                wait_cqe();
+                reap_completions();
+                lock.lock();
+            }
+        } else {
+            m_cv_slots.wait(lock, [this] { return !m_free_slots.empty(); });
+        }
+    }
+
+    const size_t count = std::min(max_count, m_free_slots.size());
+    for (size_t i = 0; i < count; i++) {
+        slots[i] = m_free_slots.back();
+        m_free_slots.pop_back();
+    }
+    return count;
+}
+
+void IoUringScheduler::release_slots(const uint32_t* slots, size_t count)
+{
+    std::lock_guard<std::mutex> lock(m_slots_lock);
+
+    // waiters only block on an empty free list
+    const bool notify = m_free_slots.empty();
+    m_free_slots.insert(m_free_slots.end(), slots, slots + count);
+
+    if (notify) {
+        m_cv_slots.notify_all();
+    }
+}
+
+unsigned IoUringScheduler::wait_sq_space()
+{
+    for (;;) {
+        const unsigned used = *m_sq_ktail - load_acquire(m_sq_khead);
+        if (used < m_sq_entries) {
+            return m_sq_entries - used;
+        }
+        // the submission ring can only be full when the kernel polls it:
+        // make sure the polling thread is awake, and let it work
+        if ((load_acquire(m_sq_kflags) & IORING_SQ_NEED_WAKEUP) != 0) {
+            sys_io_uring_enter(m_ring_fd, 0, 0, IORING_ENTER_SQ_WAKEUP);
+        }
+        std::this_thread::yield();
+    }
+}
+
+void IoUringScheduler::prep_sqe(struct io_uring_sqe* sqe,
+                                Submission&          sub,
+                                uint32_t             slot)
+{
+    memset(sqe, 0, sizeof(*sqe));
+    sqe->opcode    = sub.write ? IORING_OP_WRITE : IORING_OP_READ;
+    sqe->fd        = sub.fd;
+    sqe->addr      = reinterpret_cast<uint64_t>(sub.buf);
+    sqe->len       = static_cast<uint32_t>(sub.len);
+    sqe->off       = static_cast<uint64_t>(sub.offset);
+    sqe->user_data = slot;
+
+    if (sub.fd >= 0 && static_cast<size_t>(sub.fd) < m_fixed_files.size()
+        && m_fixed_files[sub.fd] >= 0) {
+        sqe->fd = m_fixed_files[sub.fd];
+        sqe->flags |= IOSQE_FIXED_FILE;
+    }
+
+    if (!m_fixed_buffers.empty()) {
+        const auto begin = reinterpret_cast<uintptr_t>(sub.buf);
+        auto       it    = std::upper_bound(
+            m_fixed_buffers.begin(),
+            m_fixed_buffers.end(),
+            begin,
+            [](uintptr_t addr, const FixedBuffer& b) {
+                return addr < b.m_begin;
+            });
+
+        if (it != m_fixed_buffers.begin()) {
+            --it;
+            if (begin + sub.len <= it->m_end) {
+                sqe->opcode
+                    = sub.write ? IORING_OP_WRITE_FIXED : IORING_OP_READ_FIXED;
+                sqe->buf_index = it->m_index;
+            }
+        }
+    }
+
+    Request& req    = m_requests[slot];
+    req.m_user_data = sub.data;
+    req.m_callback  = std::move(sub.callback);
+}
+
+unsigned IoUringScheduler::flush_sq(unsigned count, int& err)
+{
+    const unsigned tail = *m_sq_ktail + count;
+    store_release(m_sq_ktail, tail);
+
+    if (m_sqpoll) {
+        // the kernel thread picks the new entries up by itself, unless it went
+        // to sleep
+        __atomic_thread_fence(__ATOMIC_SEQ_CST);
+        if ((load_acquire(m_sq_kflags) & IORING_SQ_NEED_WAKEUP) != 0) {
+            sys_io_uring_enter(m_ring_fd, 0, 0, IORING_ENTER_SQ_WAKEUP);
+        }
+        return count;
+    }
+
+    unsigned remaining = count;
+    while (remaining > 0) {
+        int ret = sys_io_uring_enter(m_ring_fd, remaining, 0, 0);
+#ifdef LOG_AIO_SCHEDULER_STATS
+        m_enter_calls++;
+#endif
+
+        if (ret > 0) {
+            assert(static_cast<unsigned>(ret) <= remaining);
+#ifdef LOG_AIO_SCHEDULER_STATS
+            if (static_cast<unsigned>(ret) != remaining) {
+                m_submit_partial++;
+            }
+#endif
+            remaining -= ret;
+        } else if (ret == 0 || ret == -EINTR || ret == -EAGAIN
+                   || ret == -EBUSY) {
+            // transient shortage of kernel resources
+            std::this_thread::yield();
+        } else {
+            // the kernel left the remaining entries in the ring: take them
+            // back
+            store_release(m_sq_ktail, tail - remaining);
+            err = ret;
+            break;
+        }
+    }
+    return count - remaining;
+}
+
+int IoUringScheduler::submit(Submission* subs, size_t n_subs)
+{
+    uint32_t slots[kMaxBatchSize];
+    size_t   submitted = 0;
+
+    while (submitted < n_subs) {
+        size_t count = acquire_slots(
+            slots, std::min(n_subs - submitted, kMaxBatchSize));
+
+        std::unique_lock<std::mutex> lock(m_sq_lock);
+
+        const unsigned space = wait_sq_space();
+        if (space < count) {
+            release_slots(slots + space, count - space);
+            count = space;
+        }
+
+        const unsigned tail = *m_sq_ktail;
+        for (size_t i = 0; i < count; i++) {
+            prep_sqe(&m_sqes[(tail + i) & m_sq_mask],
+                     subs[submitted + i],
+                     slots[i]);
+        }
+        m_submitted_queries_count.fetch_add(count);
+
+        int            err      = 0;
+        const unsigned consumed = flush_sq(static_cast<unsigned>(count), err);
+        lock.unlock();
+
+        if (consumed < count) {
+            for (size_t i = consumed; i < count; i++) {
+                m_requests[slots[i]].m_callback = nullptr;
+            }
+            release_slots(slots + consumed, count - consumed);
+            m_failed_queries_count.fetch_add(count - consumed);
+
+            std::cerr << "Submission error: " << err << "(" << strerror(-err)
+                      << ")\n";
+            // the first submissions are still in flight
+            submitted += consumed;
+            return (submitted > 0) ? static_cast<int>(submitted) : err;
+        }
+        submitted += count;
+    }
+
+    return static_cast<int>(submitted);
+}
+
+int IoUringScheduler::submit_pread(int                     fd,
+                                   void*                   buf,
+                                   size_t                  len,
+                                   off_t                   offset,
+                                   void*                   data,
+                                   scheduler_callback_type callback)
+{
+    if (m_stop_flag) {
+        return -EINVAL_INVALID_STATE;
+    }
+
+    int ret = check_args(buf, len, offset);
+
+    if (ret != 0) {
+        return ret;
+    }
+
+    Submission sub{false, fd, buf, len, offset, data, std::move(callback)};
+    return submit(&sub, 1);
+}
+
+int IoUringScheduler::submit_preads(const std::vector<PReadSumission>& subs)
+{
+    if (m_stop_flag) {
+        return -EINVAL_INVALID_STATE;
+    }
+
+    std::vector<Submission> batch;
+    batch.reserve(subs.size());
+
+    for (const auto& sub : subs) {
+        // check that the arguments are well-formed (stop there, so that the
+        // submitted reads are the first ones)
+        if (check_args(sub.buf, sub.len, sub.offset) != 0) {
+            break;
+        }
+        batch.push_back(Submission{false,
+                                   sub.fd,
+                                   sub.buf,
+                                   sub.len,
+                                   static_cast<off_t>(sub.offset),
+                                   sub.data,
+                                   sub.callback});
+    }
+
+    return submit(batch.data(), batch.size());
+}
+
+int IoUringScheduler::submit_pwrite(int                     fd,
+                                    void*                   buf,
+                                    size_t                  len,
+                                    off_t                   offset,
+                                    void*                   data,
+                                    scheduler_callback_type callback)
+{
+    if (m_stop_flag) {
+        return -EINVAL_INVALID_STATE;
+    }
+
+    int ret = check_args(buf, len, offset);
+
+    if (ret != 0) {
+        return ret;
+    }
+
+    Submission sub{true, fd, buf, len, offset, data, std::move(callback)};
+    return submit(&sub, 1);
+}
+
+int IoUringScheduler::register_buffers(const std::vector<ReadBuffer>& buffers)
+{
+    std::lock_guard<std::mutex> lock(m_sq_lock);
+
+    if (buffers.empty()) {
+        return 0;
+    }
+    if (!m_fixed_buffers.empty()) {
+        return -EBUSY;
+    }
+
+    std::vector<struct iovec> iovecs;
+    iovecs.reserve(buffers.size());
+    for (const auto& b : buffers) {
+        iovecs.push_back({b.buf, b.len});
+    }
+
+    int ret = sys_io_uring_register(m_ring_fd,
+                                    IORING_REGISTER_BUFFERS,
+                                    iovecs.data(),
+                                    static_cast<unsigned>(iovecs.size()));
+    if (ret < 0) {
+        return ret;
+    }
+
+    m_fixed_buffers.reserve(buffers.size());
+    for (size_t i = 0; i < buffers.size(); i++) {
+        const auto begin = reinterpret_cast<uintptr_t>(buffers[i].buf);
+        m_fixed_buffers.push_back(FixedBuffer{
+            begin, begin + buffers[i].len, static_cast<uint16_t>(i)});
+    }
+    std::sort(m_fixed_buffers.begin(),
+              m_fixed_buffers.end(),
+              [](const FixedBuffer& a, const FixedBuffer& b) {
+                  return a.m_begin < b.m_begin;
+              });
+    return 0;
+}
+
+int IoUringScheduler::register_files(const std::vector<int>& fds)
+{
+    std::lock_guard<std::mutex> lock(m_sq_lock);
+
+    if (fds.empty()) {
+        return 0;
+    }
+    if (!m_fixed_files.empty()) {
+        return -EBUSY;
+    }
+
+    int ret = sys_io_uring_register(m_ring_fd,
+                                    IORING_REGISTER_FILES,
+                                    fds.data(),
+                                    static_cast<unsigned>(fds.size()));
+    if (ret < 0) {
+        return ret;
+    }
+
+    // negative descriptors are placeholders for sparse registrations
+    m_fixed_files.assign(
+        std::max(*std::max_element(fds.begin(), fds.end()), 0) + 1, -1);
+    for (size_t i = 0; i < fds.size(); i++) {
+        if (fds[i] >= 0) {
+            m_fixed_files[fds[i]] = static_cast<int>(i);
+        }
+    }
+    return 0;
+}
+
+Scheduler* IoUringScheduler::duplicate() const
+{
+    return make_io_uring_scheduler(m_page_size, m_queue_depth, m_sqpoll);
+}
+
+} // namespace abstractio
+} // namespace sse
+
+#endif // HAS_IO_URING
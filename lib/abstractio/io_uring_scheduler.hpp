@@ -0,0 +1,173 @@
+#pragma once
+
+#include "configure.hpp"
+
+#ifdef HAS_IO_URING
+
+#include "abstractio/scheduler.hpp"
+
+#include <linux/io_uring.h>
+
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace sse {
+namespace abstractio {
+
+
+// Scheduler using the io_uring kernel interface, through the raw system calls
+// (no dependency on liburing).
+//
+// Submissions are written in the shared submission ring and handed to the
+// kernel with a single io_uring_enter call per submit call (or none at all
+// when the kernel polls the ring itself, with SQPOLL). Completions are reaped
+// from the completion ring by a dedicated thread. The per-IO state (user data
+// and callback) lives in a table of request slots allocated once and for all:
+// the slot index is the user_data of the submission entry. The number of
+// slots is bounded by the size of the completion ring, so that the latter can
+// never overflow.
+class IoUringScheduler : public Scheduler
+{
+public:
+    IoUringScheduler(const size_t   page_size,
+                     const unsigned queue_depth,
+                     bool           sqpoll);
+    ~IoUringScheduler() override;
+
+    void wait_completions() override;
+
+    int submit_pread(int                     fd,
+                     void*                   buf,
+                     size_t                  len,
+                     off_t                   offset,
+                     void*                   data,
+                     scheduler_callback_type callback) override;
+
+    int submit_preads(const std::vector<PReadSumission>& subs) override;
+
+    int submit_pwrite(int                     fd,
+                      void*                   buf,
+                      size_t                  len,
+                      off_t                   offset,
+                      void*                   data,
+                      scheduler_callback_type callback) override;
+
+    // IOs whose buffer lies in a registered buffer use the fixed buffers
+    // opcodes, and registered file descriptors are referred to by their
+    // index. Both calls must happen before any IO is submitted, and can only
+    // be made once per scheduler.
+    int register_buffers(const std::vector<ReadBuffer>& buffers) override;
+    int register_files(const std::vector<int>& fds) override;
+
+    Scheduler* duplicate() const override;
+
+    // false if SQPOLL was requested but refused by the kernel
+    bool sqpoll_enabled() const
+    {
+        return m_sqpoll;
+    }
+
+private:
+    struct Request
+    {
+        void*                   m_user_data{nullptr};
+        scheduler_callback_type m_callback;
+    };
+
+    struct FixedBuffer
+    {
+        uintptr_t m_begin;
+        uintptr_t m_end;
+        uint16_t  m_index;
+    };
+
+    struct Submission
+    {
+        bool                    write;
+        int                     fd;
+        void*                   buf;
+        size_t                  len;
+        off_t                   offset;
+        void*                   data;
+        scheduler_callback_type callback;
+    };
+
+    void setup_rings(const unsigned queue_depth);
+    void release_rings();
+
+    void completion_loop();
+    void wait_cqe();
+    void reap_completions();
+
+    int check_args(void* buf, size_t len, off_t offset) const;
+
+    // Take up to max_count free request slots, waiting for one if necessary.
+    size_t acquire_slots(uint32_t* slots, size_t max_count);
+    void   release_slots(const uint32_t* slots, size_t count);
+
+    // The following functions must be called with m_sq_lock held.
+    // Returns the number of free submission entries, waiting for one if
+    // necessary.
+    unsigned wait_sq_space();
+    void     prep_sqe(struct io_uring_sqe* sqe, Submission& sub, uint32_t slot);
+    // Publish the count entries following the tail, and hand them to the
+    // kernel. Returns the number of entries consumed by the kernel. The
+    // others are removed from the ring, and err is set.
+    unsigned flush_sq(unsigned count, int& err);
+
+    int submit(Submission* subs, size_t n_subs);
+
+    const size_t   m_page_size;
+    const unsigned m_queue_depth;
+    bool           m_sqpoll;
+
+    int                  m_ring_fd{-1};
+    void*                m_sq_ring_ptr{nullptr};
+    size_t               m_sq_ring_size{0};
+    void*                m_cq_ring_ptr{nullptr};
+    size_t               m_cq_ring_size{0};
+    struct io_uring_sqe* m_sqes{nullptr};
+    size_t               m_sqes_size{0};
+
+    unsigned*            m_sq_khead{nullptr};
+    unsigned*            m_sq_ktail{nullptr};
+    unsigned*            m_sq_kflags{nullptr};
+    unsigned             m_sq_mask{0};
+    unsigned             m_sq_entries{0};
+    unsigned*            m_cq_khead{nullptr};
+    unsigned*            m_cq_ktail{nullptr};
+    unsigned             m_cq_mask{0};
+    struct io_uring_cqe* m_cqes{nullptr};
+
+    // protects the submission ring
+    std::mutex m_sq_lock;
+
+    std::vector<Request>    m_requests;
+    std::vector<uint32_t>   m_free_slots;
+    std::mutex              m_slots_lock;
+    std::condition_variable m_cv_slots;
+
+    std::vector<FixedBuffer> m_fixed_buffers; // sorted by address
+    std::vector<int>         m_fixed_files;   // indexed by fd, -1 if absent
+
+    std::thread       m_completion_thread;
+    std::atomic<bool> m_stop_flag{false};
+
+    std::atomic<uint64_t> m_submitted_queries_count{0};
+    std::atomic<uint64_t> m_completed_queries_count{0};
+    std::atomic<uint64_t> m_failed_queries_count{0};
+
+#ifdef LOG_AIO_SCHEDULER_STATS
+    std::atomic_size_t m_enter_calls{0};
+    std::atomic_size_t m_submit_partial{0};
+    std::atomic_size_t m_slots_exhausted{0};
+#endif
+};
+
+} // namespace abstractio
+} // namespace sse
+
+#endif // HAS_IO_URING
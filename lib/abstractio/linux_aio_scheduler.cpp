@@ -8,6 +8,7 @@
 #include <cassert>
 #include <climits>
 #include <libaio.h>
+#include <sched.h>
 
 #include <iostream>
 
@@ -16,10 +17,11 @@ namespace abstractio {
 
 static constexpr size_t kMaxNr = 128;
 
-LinuxAIOScheduler::LinuxAIOScheduler(const size_t   page_size,
-                                     const unsigned nr_events)
-    : m_ioctx(nullptr), m_page_size(page_size), m_nr_events(nr_events),
-      m_stop_flag(false), m_submitted_queries_count(0),
+constexpr unsigned LinuxAIOScheduler::kMaxDefaultShards;
+
+LinuxAIOScheduler::Shard::Shard(const unsigned           nr_events,
+                                const std::atomic<bool>& stop_flag)
+    : m_ioctx(nullptr), m_stop_flag(stop_flag), m_submitted_queries_count(0),
       m_completed_queries_count(0), m_failed_queries_count(0)
 {
     // NOLINTNEXTLINE(bugprone-sizeof-expression)
@@ -27,7 +29,7 @@ LinuxAIOScheduler::LinuxAIOScheduler(const size_t   page_size,
 
 
     // NOLINTNEXTLINE(bugprone-narrowing-conversions)
-    int nevents = (m_nr_events > INT_MAX) ? INT_MAX : m_nr_events;
+    int nevents = (nr_events > INT_MAX) ? INT_MAX : nr_events;
     int res     = io_setup(nevents, &m_ioctx);
 
     if (res != 0) {
@@ -35,12 +37,12 @@ LinuxAIOScheduler::LinuxAIOScheduler(const size_t   page_size,
                                  + std::to_string(errno) + "(" + strerror(errno)
                                  + ")\n");
     }
-    m_notify_thread = std::thread(&LinuxAIOScheduler::notify_loop, this);
+    m_notify_thread = std::thread(&LinuxAIOScheduler::Shard::notify_loop, this);
 }
 
-LinuxAIOScheduler::~LinuxAIOScheduler()
+LinuxAIOScheduler::Shard::~Shard()
 {
-    LinuxAIOScheduler::wait_completions();
+    join();
 
     io_destroy(m_ioctx);
 
@@ -53,7 +55,43 @@ LinuxAIOScheduler::~LinuxAIOScheduler()
 #endif
 }
 
-void LinuxAIOScheduler::notify_loop()
+void LinuxAIOScheduler::Shard::join()
+{
+    if (m_notify_thread.joinable()) {
+        m_notify_thread.join();
+    }
+}
+
+LinuxAIOScheduler::LinuxAIOScheduler(const size_t   page_size,
+                                     const unsigned nr_events,
+                                     const unsigned n_shards)
+    : m_page_size(page_size), m_nr_events(nr_events), m_stop_flag(false)
+{
+    const unsigned count
+        = (n_shards > 0)
+              ? n_shards
+              : std::min(std::max(std::thread::hardware_concurrency(), 1U),
+                         kMaxDefaultShards);
+
+    m_shards.reserve(count);
+    try {
+        for (unsigned i = 0; i < count; i++) {
+            m_shards.emplace_back(new Shard(m_nr_events, m_stop_flag));
+        }
+    } catch (...) {
+        // the notify loops of the shards already built only exit once the
+        // stop flag is set: otherwise, destroying them would hang
+        m_stop_flag.store(true);
+        throw;
+    }
+}
+
+LinuxAIOScheduler::~LinuxAIOScheduler()
+{
+    LinuxAIOScheduler::wait_completions();
+}
+
+void LinuxAIOScheduler::Shard::notify_loop()
 {
     struct io_event* events = new io_event[kMaxNr];
     struct timespec  timeout;
@@ -91,6 +129,23 @@ void LinuxAIOScheduler::notify_loop()
     std::cerr << "Shut down\n";
 }
 
+LinuxAIOScheduler::Shard& LinuxAIOScheduler::local_shard()
+{
+    if (m_shards.size() == 1) {
+        return *m_shards[0];
+    }
+
+    int cpu = sched_getcpu();
+    if (cpu < 0) {
+        // fall back to a fixed shard per thread
+        static std::atomic<unsigned> next_thread_index{0};
+        thread_local unsigned thread_index = next_thread_index.fetch_add(1);
+
+        cpu = static_cast<int>(thread_index);
+    }
+    return *m_shards[static_cast<size_t>(cpu) % m_shards.size()];
+}
+
 int LinuxAIOScheduler::check_args(void* buf, size_t len, off_t offset) const
 {
     if (!utility::is_aligned(buf, m_page_size)) {
@@ -112,12 +167,13 @@ void LinuxAIOScheduler::wait_completions()
 {
     m_stop_flag = true;
 
-    if (m_notify_thread.joinable()) {
-        m_notify_thread.join();
+    for (auto& shard : m_shards) {
+        shard->join();
     }
 }
 
-size_t LinuxAIOScheduler::submit_iocbs(struct iocb** iocbs, size_t n_iocbs)
+size_t LinuxAIOScheduler::Shard::submit_iocbs(struct iocb** iocbs,
+                                              size_t        n_iocbs)
 {
     // cppcheck-suppress unreadVariable
     int           res            = -EAGAIN;
@@ -155,7 +211,8 @@ size_t LinuxAIOScheduler::submit_iocbs(struct iocb** iocbs, size_t n_iocbs)
             m_failed_queries_count.fetch_add(remaining_subs);
             std::cerr << "Submission error: " << res << "\n";
             perror("io_submit");
-            return -1;
+            // the first iocbs are still in flight
+            return (remaining_subs < n_iocbs) ? n_iocbs - remaining_subs : -1;
         }
     }
 
@@ -183,7 +240,8 @@ int LinuxAIOScheduler::submit_pread(int                     fd,
     struct iocb  iocb;
     struct iocb* iocbs = &iocb;
 
-    uint64_t         query_id = m_submitted_queries_count.fetch_add(1);
+    Shard&           shard    = local_shard();
+    uint64_t         query_id = shard.new_query_id();
     LinuxAIORequest* req
         = new LinuxAIORequest(query_id, data, std::move(callback));
 
@@ -193,7 +251,7 @@ int LinuxAIOScheduler::submit_pread(int                     fd,
     iocb.data = req;
 
     // std::cerr << "Submit IO\n";
-    return submit_iocbs(&iocbs, 1);
+    return shard.submit_iocbs(&iocbs, 1);
 }
 
 int LinuxAIOScheduler::submit_preads(const std::vector<PReadSumission>& subs)
@@ -204,6 +262,9 @@ int LinuxAIOScheduler::submit_preads(const std::vector<PReadSumission>& subs)
                                       // code conventions
     }
 
+    // submit the whole batch to a single shard
+    Shard& shard = local_shard();
+
     struct iocb** iocbs
         = static_cast<struct iocb**>(calloc(subs.size(), sizeof(struct iocb*)));
     size_t iocbs_count = 0;
@@ -216,11 +277,12 @@ int LinuxAIOScheduler::submit_preads(const std::vector<PReadSumission>& subs)
     // fill in all the iocbs needed
     for (const auto& sub : subs) {
         // check that the arguments are well-formed
+        // (stop there, so that the submitted reads are the first ones)
         if (check_args(sub.buf, sub.len, sub.offset) != 0) {
-            continue;
+            break;
         }
 
-        uint64_t         query_id = m_submitted_queries_count.fetch_add(1);
+        uint64_t         query_id = shard.new_query_id();
         LinuxAIORequest* req
             = new LinuxAIORequest(query_id, sub.data, sub.callback);
 
@@ -232,7 +294,13 @@ int LinuxAIOScheduler::submit_preads(const std::vector<PReadSumission>& subs)
     }
 
     // now we have to submit the iocbs
-    int ret = submit_iocbs(iocbs, iocbs_count);
+    int ret = shard.submit_iocbs(iocbs, iocbs_count);
+
+    // the requests that were not submitted will never complete
+    for (size_t i = (ret > 0) ? static_cast<size_t>(ret) : 0; i < iocbs_count;
+         i++) {
+        delete static_cast<LinuxAIORequest*>(flat_iocbs[i].data);
+    }
 
     // free the allocated memory
     free(iocbs);
@@ -270,19 +338,21 @@ int LinuxAIOScheduler::submit_pwrite(int                     fd,
     struct iocb  iocb;
     struct iocb* iocbs = &iocb;
 
-    uint64_t         query_id = m_submitted_queries_count.fetch_add(1);
+    Shard&           shard    = local_shard();
+    uint64_t         query_id = shard.new_query_id();
     LinuxAIORequest* req
         = new LinuxAIORequest(query_id, data, std::move(callback));
 
     io_prep_pwrite(&iocb, fd, buf, len, offset);
     iocb.data = req;
 
-    return submit_iocbs(&iocbs, 1);
+    return shard.submit_iocbs(&iocbs, 1);
 }
 
 Scheduler* LinuxAIOScheduler::duplicate() const
 {
-    return make_linux_aio_scheduler(m_page_size, m_nr_events);
+    return make_linux_aio_scheduler(
+        m_page_size, m_nr_events, static_cast<unsigned>(m_shards.size()));
 }
 
 
@@ -9,6 +9,9 @@
 #include <libaio.h>
 
 #include <atomic>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
 #include <thread>
 #include <vector>
 
@@ -16,10 +19,22 @@ namespace sse {
 namespace abstractio {
 
 
+// The scheduler is split in shards, each with its own io context and
+// completion thread. An IO is submitted to the shard of the CPU the calling
+// thread runs on, and its callback is run by that shard's thread: completion
+// handling is spread over as many cores as there are shards.
 class LinuxAIOScheduler : public Scheduler
 {
 public:
-    LinuxAIOScheduler(const size_t page_size, const unsigned nr_events);
+    // Every io context counts against the system-wide fs.aio-max-nr limit:
+    // do not create one per hardware thread on large machines
+    static constexpr unsigned kMaxDefaultShards = 8;
+
+    // nr_events is the capacity of every shard. If n_shards is 0, use one
+    // shard per hardware thread, up to kMaxDefaultShards.
+    LinuxAIOScheduler(const size_t   page_size,
+                      const unsigned nr_events,
+                      const unsigned n_shards = 1);
     ~LinuxAIOScheduler();
 
     void wait_completions() override;
@@ -42,13 +57,14 @@ public:
 
     Scheduler* duplicate() const override;
 
-private:
-    void notify_loop();
+    size_t shards_count() const
+    {
+        return m_shards.size();
+    }
 
+private:
     int check_args(void* buf, size_t len, off_t offset) const;
 
-    size_t submit_iocbs(struct iocb** iocbs, size_t n_iocbs);
-
 
     struct LinuxAIORequest
     {
@@ -65,27 +81,56 @@ private:
         }
     };
 
-    io_context_t   m_ioctx;
-    const size_t   m_page_size;
-    const unsigned m_nr_events;
-    // std::vector<LinuxAIOSchedulerState> m_state;
+    class Shard
+    {
+    public:
+        Shard(const unsigned nr_events, const std::atomic<bool>& stop_flag);
+        ~Shard();
 
-    std::thread       m_notify_thread;
-    std::atomic<bool> m_stop_flag;
+        // Must be called after the stop flag is set
+        void join();
+
+        // The requests attached to the iocbs must have been accounted for
+        // with new_query_id() beforehand
+        size_t submit_iocbs(struct iocb** iocbs, size_t n_iocbs);
+
+        uint64_t new_query_id()
+        {
+            return m_submitted_queries_count.fetch_add(1);
+        }
 
-    std::atomic<uint64_t> m_submitted_queries_count;
-    uint64_t              m_completed_queries_count;
-    std::atomic<uint64_t> m_failed_queries_count;
+    private:
+        void notify_loop();
 
-    std::mutex              m_cv_lock;
-    std::condition_variable m_cv_submission;
-    bool                    m_waiting_submissions{false};
+        io_context_t             m_ioctx;
+        const std::atomic<bool>& m_stop_flag;
+
+        std::thread m_notify_thread;
+
+        std::atomic<uint64_t> m_submitted_queries_count;
+        uint64_t              m_completed_queries_count;
+        std::atomic<uint64_t> m_failed_queries_count;
+
+        std::mutex              m_cv_lock;
+        std::condition_variable m_cv_submission;
+        bool                    m_waiting_submissions{false};
 
 #ifdef LOG_AIO_SCHEDULER_STATS
-    std::atomic_size_t m_submit_calls{0};
-    std::atomic_size_t m_submit_EAGAIN{0};
-    std::atomic_size_t m_submit_partial{0};
+        std::atomic_size_t m_submit_calls{0};
+        std::atomic_size_t m_submit_EAGAIN{0};
+        std::atomic_size_t m_submit_partial{0};
 #endif
+    };
+
+    // The shard of the CPU running the calling thread
+    Shard& local_shard();
+
+    const size_t   m_page_size;
+    const unsigned m_nr_events;
+
+    std::atomic<bool> m_stop_flag;
+
+    std::vector<std::unique_ptr<Shard>> m_shards;
 };
 
 } // namespace abstractio
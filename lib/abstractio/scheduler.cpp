@@ -1,8 +1,12 @@
+#include "abstractio/io_uring_scheduler.hpp"
 #include "abstractio/linux_aio_scheduler.hpp"
 #include "abstractio/thread_pool_aio_scheduler.hpp"
 #include "configure.hpp"
 #include "utils/utils.hpp"
 
+#include <atomic>
+#include <stdexcept>
+
 namespace sse {
 namespace abstractio {
 
@@ -13,9 +17,19 @@ size_t Scheduler::async_io_page_size(int fd)
 
 #ifdef HAS_LIBAIO
 Scheduler* make_linux_aio_scheduler(const size_t   page_size,
-                                    const unsigned n_events)
+                                    const unsigned n_events,
+                                    const unsigned n_shards)
+{
+    return new LinuxAIOScheduler(page_size, n_events, n_shards);
+}
+#endif
+
+#ifdef HAS_IO_URING
+Scheduler* make_io_uring_scheduler(const size_t   page_size,
+                                   const unsigned queue_depth,
+                                   bool           sqpoll)
 {
-    return new LinuxAIOScheduler(page_size, n_events);
+    return new IoUringScheduler(page_size, queue_depth, sqpoll);
 }
 #endif
 
@@ -27,11 +41,30 @@ Scheduler* make_thread_pool_aio_scheduler()
 
 Scheduler* make_default_aio_scheduler(const size_t page_size)
 {
+    constexpr unsigned kDefaultNEvents = 128;
+
+#ifdef HAS_IO_URING
+    // io_uring can be missing at runtime (old kernel, seccomp filters, ...):
+    // only try once
+    static std::atomic<bool> io_uring_unavailable{false};
+
+    if (!io_uring_unavailable.load()) {
+        try {
+            return make_io_uring_scheduler(page_size, kDefaultNEvents);
+        } catch (const std::runtime_error&) {
+            io_uring_unavailable.store(true);
+        }
+    }
+#endif
+
 #ifdef HAS_LIBAIO
-    constexpr size_t kDefaultNEvents = 128;
-    return make_linux_aio_scheduler(page_size, kDefaultNEvents);
+    // one shard per hardware thread (up to
+    // LinuxAIOScheduler::kMaxDefaultShards), so that the completions are not
+    // all handled by a single core
+    return make_linux_aio_scheduler(page_size, kDefaultNEvents, 0);
 #else
     (void)page_size;
+    (void)kDefaultNEvents;
     return make_thread_pool_aio_scheduler();
 #endif
 }
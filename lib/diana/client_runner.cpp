@@ -287,30 +287,46 @@ const DC& DianaClientRunner::client() const
 std::list<uint64_t> DianaClientRunner::search(
     const std::string&                   keyword,
     const std::function<void(uint64_t)>& receive_callback) const
+{
+    std::vector<uint64_t> results;
+
+    search(keyword, results, receive_callback);
+
+    return std::list<uint64_t>(results.begin(), results.end());
+}
+
+void DianaClientRunner::search(
+    const std::string&                   keyword,
+    std::vector<uint64_t>&               results,
+    const std::function<void(uint64_t)>& receive_callback) const
 {
     logger::logger()->trace("Searching keyword: " + keyword);
 
     grpc::ClientContext  context;
     SearchRequestMessage message;
-    SearchReply          reply;
+    BatchedSearchReply   reply;
+
+    results.clear();
 
     message
         = request_to_message(token_wrapper_, client_->search_request(keyword));
 
     if (message.add_count() == 0) {
-        return {};
+        return;
     }
 
-    std::unique_ptr<grpc::ClientReader<SearchReply>> reader(
-        stub_->search(&context, message));
-    std::list<uint64_t> results;
+    std::unique_ptr<grpc::ClientReader<BatchedSearchReply>> reader(
+        stub_->batch_search(&context, message));
 
+    results.reserve(message.add_count());
 
     while (reader->Read(&reply)) {
-        results.push_back(reply.result());
+        for (uint64_t res : reply.results()) {
+            results.push_back(res);
 
-        if (receive_callback != nullptr) {
-            receive_callback(reply.result());
+            if (receive_callback != nullptr) {
+                receive_callback(res);
+            }
         }
     }
     grpc::Status status = reader->Finish();
@@ -319,8 +335,6 @@ std::list<uint64_t> DianaClientRunner::search(
     } else {
         logger::logger()->error("Search failed: \n" + status.error_message());
     }
-
-    return results;
 }
 
 void DianaClientRunner::insert(const std::string& keyword, uint64_t index)
@@ -21,6 +21,7 @@
 #include "diana/server_runner.hpp"
 
 #include "diana/server_runner_private.hpp"
+#include "utils/batched_reply_writer.hpp"
 
 #include <sse/schemes/utils/logger.hpp>
 #include <sse/schemes/utils/utils.hpp>
@@ -31,10 +32,12 @@
 
 #include <grpcpp/grpcpp.h>
 
+#include <algorithm>
 #include <atomic>
 #include <fstream>
 #include <thread>
 #include <utility>
+#include <vector>
 
 
 namespace sse {
@@ -293,6 +296,59 @@ grpc::Status DianaImpl::async_search(__attribute__((unused))
 }
 
 
+grpc::Status DianaImpl::batch_search(
+    __attribute__((unused)) grpc::ServerContext* context,
+    const SearchRequestMessage*                  mes,
+    grpc::ServerWriter<BatchedSearchReply>*      writer)
+{
+    if (!server_) {
+        // problem, the server is already set up
+        return grpc::Status(grpc::FAILED_PRECONDITION,
+                            "The server is not set up");
+    }
+
+    logger::logger()->trace("Start searching keyword (batched replies)...");
+
+    auto req = message_to_request(token_wrapper_, mes);
+
+    // the replies are written by the batch writer's own thread
+    utility::BatchedReplyWriter<BatchedSearchReply> batch_writer(
+        writer, search_batch_size_);
+
+    {
+        SearchBenchmark bench("Diana batched search");
+
+        if (!async_search_) {
+            std::vector<uint64_t> res_list(req.add_count);
+
+            server_->search_parallel(req, 8, res_list);
+            batch_writer.push(res_list.begin(), res_list.end());
+        } else if (req.add_count >= 2) {
+            auto post_callback
+                = [&batch_writer](index_type i) { batch_writer.push(i); };
+
+            server_->search_parallel(
+                req, post_callback, std::thread::hardware_concurrency());
+        } else {
+            auto post_callback
+                = [&batch_writer](index_type i) { batch_writer.push(i); };
+
+            server_->search(req, post_callback);
+        }
+        bench.set_count(batch_writer.finish());
+    }
+
+    if (batch_writer.failed()) {
+        logger::logger()->warn("Batched search: unable to write the replies");
+        return grpc::Status(grpc::UNAVAILABLE,
+                            "Unable to write the search replies");
+    }
+
+    logger::logger()->trace("Done searching");
+
+    return grpc::Status::OK;
+}
+
 grpc::Status DianaImpl::insert(__attribute__((unused))
                                grpc::ServerContext*        context,
                                const UpdateRequestMessage* mes,
@@ -331,13 +387,26 @@ grpc::Status DianaImpl::bulk_insert(
 
     UpdateRequestMessage mes;
 
+    const size_t batch_size
+        = std::max<size_t>(bulk_write_options_.batch_size, 1);
+    std::vector<UpdateRequest<index_type>> batch;
+    batch.reserve(batch_size);
+
     while (reader->Read(&mes)) {
-        server_->insert(message_to_request(&mes));
+        batch.push_back(message_to_request(&mes));
+
+        if (batch.size() >= batch_size) {
+            server_->insert(batch, bulk_write_options_.disable_wal);
+            batch.clear();
+        }
+    }
+    if (!batch.empty()) {
+        server_->insert(batch, bulk_write_options_.disable_wal);
     }
 
     logger::logger()->trace("Updating (bulk)... done");
 
-
+    // the flush also persists the writes that skipped the WAL
     flush_server_storage();
 
     return grpc::Status::OK;
@@ -353,6 +422,26 @@ void DianaImpl::set_search_asynchronously(bool flag)
     async_search_ = flag;
 }
 
+size_t DianaImpl::search_batch_size() const
+{
+    return search_batch_size_;
+}
+
+void DianaImpl::set_search_batch_size(size_t batch_size)
+{
+    search_batch_size_ = batch_size;
+}
+
+const sophos::WriteBatchOptions& DianaImpl::bulk_write_options() const
+{
+    return bulk_write_options_;
+}
+
+void DianaImpl::set_bulk_write_options(const sophos::WriteBatchOptions& options)
+{
+    bulk_write_options_ = options;
+}
+
 
 void DianaImpl::flush_server_storage()
 {
@@ -428,6 +517,20 @@ void DianaServerRunner::set_async_search(bool flag)
     service_->set_search_asynchronously(flag);
 }
 
+void DianaServerRunner::set_search_batch_size(size_t batch_size)
+{
+    service_->set_search_batch_size(batch_size);
+}
+
+void DianaServerRunner::set_bulk_write_options(size_t batch_size, bool disable_wal)
+{
+    sophos::WriteBatchOptions options;
+    options.batch_size  = batch_size;
+    options.disable_wal = disable_wal;
+
+    service_->set_bulk_write_options(options);
+}
+
 void DianaServerRunner::wait()
 {
     server_->Wait();
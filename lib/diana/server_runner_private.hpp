@@ -40,6 +40,7 @@ namespace diana {
 class SetupMessage;
 class SearchRequestMessage;
 class SearchReplyMessage;
+class BatchedSearchReply;
 class UpdateRequestMessage;
 
 class DianaImpl final : public diana::Diana::Service
@@ -47,6 +48,9 @@ class DianaImpl final : public diana::Diana::Service
 public:
     typedef uint64_t index_type;
 
+    // Default number of results sent in a single batched search reply
+    static constexpr size_t kDefaultSearchBatchSize = 1024;
+
     explicit DianaImpl(std::string path);
     ~DianaImpl();
 
@@ -66,6 +70,11 @@ public:
                               const SearchRequestMessage*      mes,
                               grpc::ServerWriter<SearchReply>* writer);
 
+    grpc::Status batch_search(
+        grpc::ServerContext*                    context,
+        const SearchRequestMessage*             mes,
+        grpc::ServerWriter<BatchedSearchReply>* writer) override;
+
     grpc::Status insert(grpc::ServerContext*        context,
                         const UpdateRequestMessage* mes,
                         google::protobuf::Empty*    e) override;
@@ -77,6 +86,12 @@ public:
     bool search_asynchronously() const;
     void set_search_asynchronously(bool flag);
 
+    size_t search_batch_size() const;
+    void   set_search_batch_size(size_t batch_size);
+
+    const sophos::WriteBatchOptions& bulk_write_options() const;
+    void set_bulk_write_options(const sophos::WriteBatchOptions& options);
+
     void flush_server_storage();
 
 private:
@@ -91,6 +106,10 @@ private:
     std::mutex update_mtx_;
 
     bool async_search_;
+
+    size_t search_batch_size_{kDefaultSearchBatchSize};
+
+    sophos::WriteBatchOptions bulk_write_options_;
 };
 
 SearchRequest message_to_request(
@@ -35,6 +35,7 @@
 #include <memory>
 #include <mutex>
 #include <thread>
+#include <vector>
 
 namespace sse {
 namespace diana {
@@ -71,6 +72,12 @@ public:
     std::list<index_type> search(
         const std::string&                   keyword,
         const std::function<void(uint64_t)>& receive_callback = nullptr) const;
+    // Replace the content of results by the search's results. The vector's
+    // capacity is reserved upfront from the expected number of matches.
+    void search(
+        const std::string&                   keyword,
+        std::vector<index_type>&             results,
+        const std::function<void(uint64_t)>& receive_callback = nullptr) const;
     void insert(const std::string& keyword, uint64_t index);
 
     void start_update_session();
@@ -51,6 +51,14 @@ public:
 
     void set_async_search(bool flag);
 
+    // Set the maximum number of results sent in a single message by the
+    // batched search RPC
+    void set_search_batch_size(size_t batch_size);
+
+    // Set the number of updates written in a single batch by the bulk
+    // insertion RPC, and whether these writes skip the write-ahead log
+    void set_bulk_write_options(size_t batch_size, bool disable_wal);
+
     void wait();
     void shutdown();
 
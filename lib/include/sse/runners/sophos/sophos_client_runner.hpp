@@ -30,9 +30,12 @@
 
 #include <atomic>
 #include <condition_variable>
+#include <list>
 #include <memory>
 #include <mutex>
 #include <thread>
+#include <utility>
+#include <vector>
 
 namespace sse {
 namespace sophos {
@@ -62,11 +65,19 @@ public:
     std::list<uint64_t> search(
         const std::string&                   keyword,
         const std::function<void(uint64_t)>& receive_callback = nullptr) const;
+    // Replace the content of results by the search's results. The vector's
+    // capacity is reserved upfront from the expected number of matches.
+    void search(
+        const std::string&                   keyword,
+        std::vector<uint64_t>&               results,
+        const std::function<void(uint64_t)>& receive_callback = nullptr) const;
     void insert(const std::string& keyword, uint64_t index);
 
     void start_update_session();
     void end_update_session();
     void insert_in_session(const std::string& keyword, uint64_t index);
+    void insert_in_session(
+        const std::list<std::pair<std::string, uint64_t>>& update_list);
 
     bool load_inverted_index(const std::string& path);
 
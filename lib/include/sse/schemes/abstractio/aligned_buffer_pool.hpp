@@ -0,0 +1,95 @@
+#pragma once
+
+#include <sse/schemes/abstractio/scheduler.hpp>
+#include <sse/schemes/utils/bounded_queue.hpp>
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+
+#include <memory>
+#include <type_traits>
+
+namespace sse {
+namespace abstractio {
+
+/// Pool of fixed-size, aligned memory buffers for the async IOs.
+///
+/// The pooled buffers are carved out of a single memory region, allocated at
+/// construction, which can be registered with the IO schedulers (see
+/// Scheduler::register_buffers). They are recycled through a lock-free queue:
+/// acquiring or releasing a pooled buffer never takes a lock nor calls the
+/// allocator. Once the pool is exhausted, acquire() falls back to
+/// posix_memalign, and release() frees these extra buffers.
+class AlignedBufferPool
+{
+public:
+    AlignedBufferPool(size_t buffer_size, size_t alignment, size_t capacity);
+    ~AlignedBufferPool();
+
+    AlignedBufferPool(const AlignedBufferPool&) = delete;
+    AlignedBufferPool& operator=(const AlignedBufferPool&) = delete;
+
+    // Throws std::bad_alloc if the fallback allocation fails
+    void* acquire();
+
+    // Can be called concurrently, from any thread
+    void release(void* buf) noexcept;
+
+    bool owns(const void* buf) const noexcept
+    {
+        const auto* p = static_cast<const uint8_t*>(buf);
+        return p >= m_region && p < m_region + m_capacity * m_buffer_size;
+    }
+
+    size_t buffer_size() const noexcept
+    {
+        return m_buffer_size;
+    }
+
+    size_t capacity() const noexcept
+    {
+        return m_capacity;
+    }
+
+    // The memory region holding the pooled buffers
+    ReadBuffer region() const noexcept
+    {
+        return ReadBuffer{m_region, m_capacity * m_buffer_size};
+    }
+
+private:
+    const size_t m_buffer_size; // multiple of the alignment
+    const size_t m_alignment;
+    const size_t m_capacity;
+    uint8_t*     m_region{nullptr};
+
+    utility::BoundedQueue<void*> m_free_buffers;
+};
+
+/// Deleter giving the buffer back to its pool. The pool is kept alive as long
+/// as one of its buffers is in use. Without a pool, the buffer is freed.
+template<typename T>
+struct PooledBufferDeleter
+{
+    // the buffers are handed out as raw memory: no destructor is ever called
+    static_assert(std::is_trivially_destructible<T>::value,
+                  "Pooled values must be trivially destructible");
+
+    std::shared_ptr<AlignedBufferPool> pool;
+
+    void operator()(T* ptr) const noexcept
+    {
+        if (pool) {
+            pool->release(ptr);
+        } else {
+            free(ptr);
+        }
+    }
+};
+
+template<typename T>
+using pooled_ptr = std::unique_ptr<T, PooledBufferDeleter<T>>;
+
+} // namespace abstractio
+} // namespace sse
@@ -0,0 +1,63 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+#include <string>
+#include <vector>
+
+namespace sse {
+namespace abstractio {
+
+/// Append-only scratch file, used to move data out of memory.
+///
+/// Records are staged in a memory buffer and written to the file by large
+/// sequential chunks. Once flushed, a record can be read back from its
+/// offset, in any order and from any thread. The file is truncated on
+/// construction and removed on destruction: the log only lives as long as
+/// the object.
+class AppendLog
+{
+public:
+    static constexpr size_t kDefaultBufferSize = 1UL << 20;
+
+    explicit AppendLog(std::string path,
+                       size_t      buffer_size = kDefaultBufferSize);
+    ~AppendLog();
+
+    AppendLog(const AppendLog&) = delete;
+    AppendLog& operator=(const AppendLog&) = delete;
+
+    // Returns the offset of the record in the log
+    uint64_t append(const void* data, size_t length);
+
+    // Writes the staged records to the file
+    void flush();
+
+    // Reads a flushed record. Throws std::out_of_range if the record is not
+    // flushed yet. Can be called concurrently.
+    void read(uint64_t offset, void* data, size_t length) const;
+
+    // Size of the log, including the staged records
+    uint64_t size() const noexcept
+    {
+        return m_flushed_size + m_buffer.size();
+    }
+
+    const std::string& path() const noexcept
+    {
+        return m_path;
+    }
+
+private:
+    void write_all(const uint8_t* data, size_t length);
+
+    const std::string    m_path;
+    const size_t         m_buffer_size;
+    int                  m_fd{-1};
+    uint64_t             m_flushed_size{0};
+    std::vector<uint8_t> m_buffer;
+};
+
+} // namespace abstractio
+} // namespace sse
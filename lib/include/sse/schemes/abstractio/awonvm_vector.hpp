@@ -2,6 +2,8 @@
 
 #pragma once
 
+#include <sse/schemes/abstractio/aligned_buffer_pool.hpp>
+#include <sse/schemes/abstractio/page_cache.hpp>
 #include <sse/schemes/abstractio/scheduler.hpp>
 #include <sse/schemes/utils/logger.hpp>
 #include <sse/schemes/utils/utils.hpp>
@@ -9,6 +11,7 @@
 #include <cassert>
 #include <cerrno>
 #include <cstring>
+#include <sys/mman.h>
 #include <unistd.h>
 
 #include <atomic>
@@ -31,7 +34,16 @@ public:
     static_assert(kTypeAlignment <= kValueSize,
                   "Invalid alignment for the type size");
 
-    using get_callback_type = std::function<void(std::unique_ptr<T>)>;
+    // number of IO buffers kept in the vector's pool
+    static constexpr size_t kBufferPoolCapacity = 256;
+
+    // the buffer holding the value goes back to the vector's pool once
+    // released
+    using value_ptr         = pooled_ptr<T>;
+    using get_callback_type = std::function<void(value_ptr)>;
+
+    // called with the number of written bytes, or a negative error code
+    using write_callback_type = std::function<void(int64_t)>;
 
     struct GetRequest
     {
@@ -56,6 +68,13 @@ public:
     size_t push_back(const T& val);
     size_t async_push_back(const T& val);
 
+    // Write count contiguous values with a single IO, and return the index of
+    // the first one. The values are not copied: they must stay valid until
+    // the callback is called.
+    size_t async_push_back(const T*            values,
+                           size_t              count,
+                           write_callback_type callback);
+
     void reserve(size_t n);
 
     void commit() noexcept;
@@ -67,7 +86,15 @@ public:
 
     T    get(size_t index);
     void async_get(size_t index, get_callback_type get_callback);
-    void async_gets(const std::vector<GetRequest>& requests);
+    // Returns the number of requests whose callback will be called: if the
+    // reads can only be partially submitted, the callbacks of the last ones
+    // are dropped. Throws if none of the reads can be submitted.
+    size_t async_gets(const std::vector<GetRequest>& requests);
+
+    // Reference to the value at the given index: in the mapping when the
+    // vector is memory mapped (no copy), and in buffer otherwise (the value
+    // is read directly in buffer).
+    const T& view(size_t index, T& buffer);
 
     bool is_committed() const noexcept
     {
@@ -81,9 +108,46 @@ public:
 
     void set_use_direct_access(bool flag);
 
+    // Optional cache consulted by all the reads before going to the device.
+    // It must not be changed while reads are running.
+    void set_cache(std::shared_ptr<PageCache<T>> cache)
+    {
+        m_cache = std::move(cache);
+    }
+
+    const std::shared_ptr<PageCache<T>>& cache() const noexcept
+    {
+        return m_cache;
+    }
+
+    // Map the (committed) vector in memory. All the reads are then served
+    // from the mapping, without IOs nor system calls. With populate, the
+    // whole file is read at once; otherwise, the pages are read on first
+    // access. huge_pages asks the kernel to back the mapping with huge pages
+    // (only a hint).
+    void map_memory(bool populate = false, bool huge_pages = false);
+    void unmap_memory() noexcept;
+
+    bool is_memory_mapped() const noexcept
+    {
+        return m_mapping != nullptr;
+    }
+
 private:
     static size_t async_io_page_size(int fd);
 
+    // Register the buffer pool and the file descriptor with the scheduler
+    void register_io_resources();
+
+    // Returns the value in a pooled buffer if it is in memory (in the
+    // mapping or in the cache), or nullptr otherwise
+    value_ptr get_from_memory(size_t index);
+
+    // Completion callback of an async read, filling the cache
+    Scheduler::scheduler_callback_type read_completion_callback(
+        size_t            index,
+        get_callback_type get_callback) const;
+
 
     const std::string m_filename;
     bool              m_use_direct_io{false};
@@ -94,11 +158,19 @@ private:
 
     std::atomic<bool> m_is_committed{false};
 
-    std::unique_ptr<Scheduler> m_io_scheduler;
-    bool                       m_io_warn_flag{false};
+    std::shared_ptr<AlignedBufferPool> m_buffer_pool;
+    std::unique_ptr<Scheduler>         m_io_scheduler;
+    bool                               m_io_warn_flag{false};
+
+    std::shared_ptr<PageCache<T>> m_cache;
+
+    const T* m_mapping{nullptr};
+    size_t   m_mapping_length{0};
 };
 template<typename T, size_t ALIGNMENT>
 constexpr size_t awonvm_vector<T, ALIGNMENT>::kValueSize;
+template<typename T, size_t ALIGNMENT>
+constexpr size_t awonvm_vector<T, ALIGNMENT>::kBufferPoolCapacity;
 
 template<typename T, size_t ALIGNMENT>
 // cppcheck-suppress uninitMemberVar
@@ -110,6 +182,10 @@ awonvm_vector<T, ALIGNMENT>::awonvm_vector(
     : m_filename(path), m_use_direct_io(direct_io),
       m_fd(utility::open_fd(path, m_use_direct_io)),
       m_device_page_size(Scheduler::async_io_page_size(m_fd)),
+      m_buffer_pool(
+          std::make_shared<AlignedBufferPool>(std::max(ALIGNMENT, sizeof(T)),
+                                              ALIGNMENT,
+                                              kBufferPoolCapacity)),
       m_io_scheduler(std::move(scheduler))
 {
     off_t file_size = utility::file_size(m_fd);
@@ -134,6 +210,7 @@ awonvm_vector<T, ALIGNMENT>::awonvm_vector(
 
         m_size.store(file_size / sizeof(T));
     }
+    register_io_resources();
 }
 
 template<typename T, size_t ALIGNMENT>
@@ -144,6 +221,10 @@ awonvm_vector<T, ALIGNMENT>::awonvm_vector(const std::string& path,
     : m_filename(path), m_use_direct_io(direct_io),
       m_fd(utility::open_fd(path, m_use_direct_io)),
       m_device_page_size(Scheduler::async_io_page_size(m_fd)),
+      m_buffer_pool(
+          std::make_shared<AlignedBufferPool>(std::max(ALIGNMENT, sizeof(T)),
+                                              ALIGNMENT,
+                                              kBufferPoolCapacity)),
       m_io_scheduler(make_default_aio_scheduler(m_device_page_size))
 {
     off_t file_size = utility::file_size(m_fd);
@@ -168,14 +249,19 @@ awonvm_vector<T, ALIGNMENT>::awonvm_vector(const std::string& path,
 
         m_size.store(file_size / sizeof(T));
     }
+    register_io_resources();
 }
 template<typename T, size_t ALIGNMENT>
 awonvm_vector<T, ALIGNMENT>::awonvm_vector(awonvm_vector&& vec) noexcept
     : m_filename(vec.m_filename), m_use_direct_io(vec.m_use_direct_io),
       m_fd(vec.m_fd), m_device_page_size(vec.m_device_page_size),
-      m_io_scheduler(std::move(vec.m_io_scheduler))
+      m_buffer_pool(std::move(vec.m_buffer_pool)),
+      m_io_scheduler(std::move(vec.m_io_scheduler)),
+      m_cache(std::move(vec.m_cache)), m_mapping(vec.m_mapping),
+      m_mapping_length(vec.m_mapping_length)
 {
-    vec.m_fd = 0;
+    vec.m_fd      = 0;
+    vec.m_mapping = nullptr;
 }
 
 template<typename T, size_t ALIGNMENT>
@@ -188,9 +274,20 @@ awonvm_vector<T, ALIGNMENT>::~awonvm_vector()
             m_io_scheduler->wait_completions();
         }
     }
+    unmap_memory();
     close(m_fd);
 }
 
+template<typename T, size_t ALIGNMENT>
+void awonvm_vector<T, ALIGNMENT>::register_io_resources()
+{
+    if (m_io_scheduler) {
+        // not fatal: the IOs just do not use the pre-registered resources
+        m_io_scheduler->register_buffers({m_buffer_pool->region()});
+        m_io_scheduler->register_files({m_fd});
+    }
+}
+
 template<typename T, size_t ALIGNMENT>
 void awonvm_vector<T, ALIGNMENT>::reserve(size_t n)
 {
@@ -253,32 +350,26 @@ size_t awonvm_vector<T, ALIGNMENT>::async_push_back(const T& val)
     }
 
     // we have to copy the data so it does not get destructed by the caller
-    void* buf;
-
-    int ret = posix_memalign((&buf), ALIGNMENT, std::max(ALIGNMENT, sizeof(T)));
-
-    if (ret != 0 || buf == nullptr) {
-        throw std::runtime_error("Error when allocating aligned memory: errno "
-                                 + std::to_string(ret) + "(" + strerror(ret)
-                                 + ")");
-    }
+    void* buf = m_buffer_pool->acquire();
     memcpy(buf, &val, sizeof(T));
 
-    auto cb = [](void* b, size_t /*res*/) {
+    auto cb = [pool = m_buffer_pool](void* b, size_t /*res*/) {
         // std::cerr << (int)((uint8_t*)b)[0] << "\t" << res << "\n";
         // if (buf != b) {
         //     std::cerr << "Issue: inconsistent buffer\n";
         // }
-        free(b);
+        pool->release(b);
         // m_completed_writes.fetch_add(1);
     };
 
     size_t pos = m_size.fetch_add(1);
     off_t  off = pos * sizeof(T);
 
-    ret = m_io_scheduler->submit_pwrite(m_fd, buf, sizeof(T), off, buf, cb);
+    int ret = m_io_scheduler->submit_pwrite(m_fd, buf, sizeof(T), off, buf, cb);
 
     if (ret != 1) {
+        m_buffer_pool->release(buf);
+
         // we should have a specific exception type here to be able to return
         // which position was corrupted
         throw std::runtime_error("Error when submitting the read async IO: "
@@ -289,6 +380,47 @@ size_t awonvm_vector<T, ALIGNMENT>::async_push_back(const T& val)
 }
 
 
+template<typename T, size_t ALIGNMENT>
+size_t awonvm_vector<T, ALIGNMENT>::async_push_back(
+    const T*            values,
+    size_t              count,
+    write_callback_type callback)
+{
+    if (m_is_committed) {
+        throw std::runtime_error(
+            "Invalid state during write: the vector is committed");
+    }
+    if (!m_io_scheduler) {
+        throw std::runtime_error("No IO Scheduler set");
+    }
+    if (m_use_direct_io && !utility::is_aligned(values, kTypeAlignment)) {
+        throw std::invalid_argument("Input is not correctly aligned");
+    }
+
+    if (!m_use_direct_io && !m_io_warn_flag) {
+        std::cerr << "awonvm_vector uses buffered IOs. Calls for async IOs "
+                     "will be synchronous.\n";
+        m_io_warn_flag = true;
+    }
+
+    auto cb = [callback](void* /*data*/, int64_t res) { callback(res); };
+
+    size_t pos = m_size.fetch_add(count);
+    off_t  off = pos * sizeof(T);
+
+    // the scheduler does not write in the buffer
+    void* buf = const_cast<T*>(values);
+    int   ret = m_io_scheduler->submit_pwrite(
+        m_fd, buf, count * sizeof(T), off, nullptr, cb);
+
+    if (ret != 1) {
+        throw std::runtime_error("Error when submitting the write async IO: "
+                                 + std::to_string(ret));
+    }
+
+    return pos;
+}
+
 template<typename T, size_t ALIGNMENT>
 void awonvm_vector<T, ALIGNMENT>::commit() noexcept
 {
@@ -300,6 +432,7 @@ void awonvm_vector<T, ALIGNMENT>::commit() noexcept
                 new_sched); // this will block until the completion of write
                             // queries and then create a new scheduler for
                             // future async read queries
+            register_io_resources();
         } else {
             fsync(m_fd);
         }
@@ -324,6 +457,7 @@ void awonvm_vector<T, ALIGNMENT>::set_use_direct_access(bool flag)
         // recreate an async scheduler
         Scheduler* new_sched = m_io_scheduler->duplicate();
         m_io_scheduler.reset(new_sched);
+        register_io_resources();
 
         m_use_direct_io = flag;
         m_io_warn_flag  = false;
@@ -333,7 +467,15 @@ void awonvm_vector<T, ALIGNMENT>::set_use_direct_access(bool flag)
 template<typename T, size_t ALIGNMENT>
 T awonvm_vector<T, ALIGNMENT>::get(size_t index)
 {
-    if (index > m_size.load()) {
+    alignas(kTypeAlignment) T v;
+
+    return view(index, v);
+}
+
+template<typename T, size_t ALIGNMENT>
+const T& awonvm_vector<T, ALIGNMENT>::view(size_t index, T& buffer)
+{
+    if (index >= m_size.load()) {
         throw std::invalid_argument("Index (" + std::to_string(index)
                                     + ") out of bounds (size="
                                     + std::to_string(m_size.load()) + ")");
@@ -344,16 +486,132 @@ T awonvm_vector<T, ALIGNMENT>::get(size_t index)
             "Invalid state during read: the vector is not committed");
     }
 
-    alignas(kTypeAlignment) T v;
+    if (m_mapping) {
+        return m_mapping[index];
+    }
 
-    int res = pread(m_fd, &v, sizeof(T), index * sizeof(T));
+    if (m_use_direct_io && !utility::is_aligned(&buffer, kTypeAlignment)) {
+        // direct IOs need an aligned destination
+        buffer = get(index);
+        return buffer;
+    }
+
+    if (m_cache && m_cache->get(index, buffer)) {
+        return buffer;
+    }
+
+    int res = pread(m_fd, &buffer, sizeof(T), index * sizeof(T));
 
     if (res != sizeof(T)) {
         std::cerr << "Error during pread: " << res << "\n";
         throw std::runtime_error("Error during pread: " + std::to_string(res));
     }
 
-    return v;
+    if (m_cache) {
+        m_cache->insert(index, buffer);
+    }
+
+    return buffer;
+}
+
+template<typename T, size_t ALIGNMENT>
+auto awonvm_vector<T, ALIGNMENT>::get_from_memory(size_t index) -> value_ptr
+{
+    value_ptr result(nullptr, PooledBufferDeleter<T>{m_buffer_pool});
+
+    if (m_mapping) {
+        void* buffer = m_buffer_pool->acquire();
+        memcpy(buffer, m_mapping + index, sizeof(T));
+        result.reset(reinterpret_cast<T*>(buffer));
+    } else if (m_cache) {
+        void* buffer = m_buffer_pool->acquire();
+
+        if (m_cache->get(index, *reinterpret_cast<T*>(buffer))) {
+            result.reset(reinterpret_cast<T*>(buffer));
+        } else {
+            m_buffer_pool->release(buffer);
+        }
+    }
+    return result;
+}
+
+template<typename T, size_t ALIGNMENT>
+void awonvm_vector<T, ALIGNMENT>::map_memory(bool populate, bool huge_pages)
+{
+    if (!m_is_committed) {
+        throw std::runtime_error(
+            "Invalid state for memory mapping: the vector is not committed");
+    }
+    if (m_mapping || m_size.load() == 0) {
+        return;
+    }
+
+    int flags = MAP_SHARED;
+#ifdef MAP_POPULATE
+    if (populate) {
+        flags |= MAP_POPULATE;
+    }
+#endif
+
+    size_t length = m_size.load() * sizeof(T);
+    void*  addr   = mmap(nullptr, length, PROT_READ, flags, m_fd, 0);
+
+    if (addr == MAP_FAILED) {
+        int err = errno;
+        throw std::runtime_error("Unable to map " + m_filename
+                                 + " in memory: errno " + std::to_string(err)
+                                 + "(" + strerror(err) + ")");
+    }
+
+    // the advices are only hints: ignore the failures
+    // the table lookups are random: prevent read ahead
+    madvise(addr, length, populate ? MADV_WILLNEED : MADV_RANDOM);
+#ifdef MADV_HUGEPAGE
+    if (huge_pages) {
+        madvise(addr, length, MADV_HUGEPAGE);
+    }
+#else
+    (void)huge_pages;
+#endif
+#ifndef MAP_POPULATE
+    (void)populate;
+#endif
+
+    m_mapping        = static_cast<const T*>(addr);
+    m_mapping_length = length;
+}
+
+template<typename T, size_t ALIGNMENT>
+void awonvm_vector<T, ALIGNMENT>::unmap_memory() noexcept
+{
+    if (m_mapping) {
+        munmap(const_cast<T*>(m_mapping), m_mapping_length);
+        m_mapping        = nullptr;
+        m_mapping_length = 0;
+    }
+}
+
+template<typename T, size_t ALIGNMENT>
+Scheduler::scheduler_callback_type awonvm_vector<T, ALIGNMENT>::
+    read_completion_callback(size_t            index,
+                             get_callback_type get_callback) const
+{
+    return [get_callback, index, pool = m_buffer_pool, cache = m_cache](
+               void* buf, int64_t res) {
+        value_ptr result(nullptr, PooledBufferDeleter<T>{pool});
+
+        if (res == sizeof(T)) {
+            result.reset(reinterpret_cast<T*>(buf));
+
+            if (cache) {
+                cache->insert(index, *result);
+            }
+        } else {
+            pool->release(buf); // avoid memory leaks
+        }
+
+        get_callback(std::move(result));
+    };
 }
 
 template<typename T, size_t ALIGNMENT>
@@ -375,39 +633,31 @@ void awonvm_vector<T, ALIGNMENT>::async_get(size_t            index,
         m_io_warn_flag = true;
     }
 
-    if (index > m_size.load()) {
+    if (index >= m_size.load()) {
         throw std::invalid_argument("Index (" + std::to_string(index)
                                     + ") out of bounds (size="
                                     + std::to_string(m_size.load()) + ")");
     }
 
-    void* buffer;
-    int   ret
-        = posix_memalign((&buffer), ALIGNMENT, std::max(ALIGNMENT, sizeof(T)));
-
-    if (ret != 0 || buffer == nullptr) {
-        throw std::runtime_error("Error when allocating aligned memory: errno "
-                                 + std::to_string(ret) + "(" + strerror(ret)
-                                 + ")");
+    value_ptr in_memory = get_from_memory(index);
+    if (in_memory) {
+        // no IO: the callback is called from the caller's thread
+        get_callback(std::move(in_memory));
+        return;
     }
 
-    auto inner_cb = [get_callback](void* buf, int64_t res) {
-        std::unique_ptr<T> result(nullptr);
-
-        if (res == sizeof(T)) {
-            result.reset(reinterpret_cast<T*>(buf));
-        } else {
-            free(buf); // avoid memory leaks
-        }
+    void* buffer = m_buffer_pool->acquire();
 
-        get_callback(std::move(result));
-    };
-
-    ret = m_io_scheduler->submit_pread(
-        m_fd, buffer, sizeof(T), index * sizeof(T), buffer, inner_cb);
+    int ret = m_io_scheduler->submit_pread(
+        m_fd,
+        buffer,
+        sizeof(T),
+        index * sizeof(T),
+        buffer,
+        read_completion_callback(index, get_callback));
 
     if (ret != 1) {
-        free(buffer);
+        m_buffer_pool->release(buffer);
 
         throw std::runtime_error(
             "Error when submitting the read async IO: errno "
@@ -416,7 +666,7 @@ void awonvm_vector<T, ALIGNMENT>::async_get(size_t            index,
 }
 
 template<typename T, size_t ALIGNMENT>
-void awonvm_vector<T, ALIGNMENT>::async_gets(
+size_t awonvm_vector<T, ALIGNMENT>::async_gets(
     const std::vector<GetRequest>& requests)
 {
     if (!m_io_scheduler) {
@@ -434,53 +684,66 @@ void awonvm_vector<T, ALIGNMENT>::async_gets(
         m_io_warn_flag = true;
     }
 
-    std::vector<Scheduler::PReadSumission> submissions;
-    submissions.reserve(requests.size());
-
+    // check all the indices before allocating any buffer
     for (const auto& req : requests) {
-        if (req.index > m_size.load()) {
+        if (req.index >= m_size.load()) {
             throw std::invalid_argument("Index (" + std::to_string(req.index)
                                         + ") out of bounds (size="
                                         + std::to_string(m_size.load()) + ")");
         }
+    }
 
+    std::vector<Scheduler::PReadSumission> submissions;
+    submissions.reserve(requests.size());
 
-        void* buffer;
-        int   ret = posix_memalign(
-            (&buffer), ALIGNMENT, std::max(ALIGNMENT, sizeof(T)));
+    // the values found in memory are only delivered once the other reads
+    // have been submitted
+    std::vector<std::pair<value_ptr, const get_callback_type*>> hits;
 
-        if (ret != 0 || buffer == nullptr) {
-            throw std::runtime_error(
-                "Error when allocating aligned memory: errno "
-                + std::to_string(ret) + "(" + strerror(ret) + ")");
+    for (const auto& req : requests) {
+        value_ptr in_memory = get_from_memory(req.index);
+        if (in_memory) {
+            hits.emplace_back(std::move(in_memory), &req.callback);
+            continue;
         }
 
-        auto get_callback = req.callback;
-        auto inner_cb     = [get_callback](void* buf, int64_t res) {
-            std::unique_ptr<T> result(nullptr);
-
-            if (res == sizeof(T)) {
-                result.reset(reinterpret_cast<T*>(buf));
-            }
-
-            get_callback(std::move(result));
-        };
+        void* buffer = m_buffer_pool->acquire();
 
         submissions.push_back(Scheduler::PReadSumission(
-            m_fd, buffer, sizeof(T), req.index * sizeof(T), buffer, inner_cb));
-    }
-
-    int ret = m_io_scheduler->submit_preads(submissions);
+            m_fd,
+            buffer,
+            sizeof(T),
+            req.index * sizeof(T),
+            buffer,
+            read_completion_callback(req.index, req.callback)));
+    }
+
+    size_t submitted = 0;
+    if (!submissions.empty()) {
+        int ret = m_io_scheduler->submit_preads(submissions);
+
+        // the first reads are in flight, and their buffers are released by
+        // their completion callbacks
+        submitted = (ret > 0) ? static_cast<size_t>(ret) : 0;
+        for (size_t i = submitted; i < submissions.size(); i++) {
+            m_buffer_pool->release(submissions[i].buf);
+        }
 
-    if (ret < 0 || static_cast<size_t>(ret) != submissions.size()) {
-        for (auto& sub : submissions) {
-            free(sub.buf);
+        if (submitted == 0) {
+            throw std::runtime_error(
+                "Error when submitting the read async IO: errno "
+                + std::to_string(-ret) + "(" + strerror(-ret) + ")");
+        }
+        if (submitted < submissions.size()) {
+            std::cerr << "Partial submission of the read async IOs: "
+                      << submitted << "/" << submissions.size() << "\n";
         }
+    }
 
-        throw std::runtime_error(
-            "Error when submitting the read async IO: errno "
-            + std::to_string(ret) + "(" + strerror(ret) + ")");
+    for (auto& hit : hits) {
+        (*hit.second)(std::move(hit.first));
     }
+    return submitted + hits.size();
 }
 
 
@@ -0,0 +1,184 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+#include <algorithm>
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+namespace sse {
+namespace abstractio {
+
+/// Cache of fixed-size pages, indexed by their position in a vector.
+///
+/// The cache is split in shards, each protected by its own lock, and each
+/// shard evicts its pages using the CLOCK algorithm: a page has a reference
+/// bit set on every hit, and the clock hand evicts the first page whose bit
+/// is cleared, clearing the bits it passes over. Newly inserted pages start
+/// with a cleared bit, so that pages read only once are evicted first.
+///
+/// Pages are copied in and out of the cache: the cache never hands out
+/// references to its content.
+template<typename T>
+class PageCache
+{
+public:
+    static constexpr size_t kDefaultShardsCount = 16;
+
+    // The byte budget is evenly split between the shards. Every shard holds
+    // at least one page.
+    explicit PageCache(size_t byte_budget,
+                       size_t n_shards = kDefaultShardsCount);
+
+    PageCache(const PageCache&) = delete;
+    PageCache& operator=(const PageCache&) = delete;
+
+    // Copies the cached page in value and returns true on a hit
+    bool get(size_t index, T& value);
+
+    void insert(size_t index, const T& value);
+
+    size_t capacity() const noexcept
+    {
+        return m_shards.size() * m_shard_capacity;
+    }
+
+    size_t size() const;
+
+    uint64_t hit_count() const noexcept
+    {
+        return m_hit_count.load(std::memory_order_relaxed);
+    }
+
+    uint64_t miss_count() const noexcept
+    {
+        return m_miss_count.load(std::memory_order_relaxed);
+    }
+
+private:
+    struct Entry
+    {
+        size_t index;
+        bool   referenced;
+        T      value;
+    };
+
+    struct Shard
+    {
+        mutable std::mutex                 lock;
+        std::vector<Entry>                 entries;
+        std::unordered_map<size_t, size_t> positions; // index -> entry
+        size_t                             clock_hand{0};
+    };
+
+    static size_t shard_capacity(size_t byte_budget, size_t n_shards)
+    {
+        n_shards = std::max<size_t>(n_shards, 1);
+        return std::max<size_t>(byte_budget / sizeof(T) / n_shards, 1);
+    }
+
+    Shard& shard(size_t index)
+    {
+        return *m_shards[index % m_shards.size()];
+    }
+
+    const size_t                        m_shard_capacity;
+    std::vector<std::unique_ptr<Shard>> m_shards;
+
+    std::atomic<uint64_t> m_hit_count{0};
+    std::atomic<uint64_t> m_miss_count{0};
+};
+
+template<typename T>
+constexpr size_t PageCache<T>::kDefaultShardsCount;
+
+template<typename T>
+PageCache<T>::PageCache(size_t byte_budget, size_t n_shards)
+    : m_shard_capacity(shard_capacity(byte_budget, n_shards))
+{
+    n_shards = std::max<size_t>(n_shards, 1);
+    m_shards.reserve(n_shards);
+
+    for (size_t i = 0; i < n_shards; i++) {
+        m_shards.emplace_back(new Shard());
+        // the entries are allocated when the shard fills up
+        m_shards.back()->positions.reserve(m_shard_capacity);
+    }
+}
+
+template<typename T>
+bool PageCache<T>::get(size_t index, T& value)
+{
+    Shard& s = shard(index);
+
+    {
+        std::lock_guard<std::mutex> lock(s.lock);
+
+        auto it = s.positions.find(index);
+        if (it != s.positions.end()) {
+            Entry& entry     = s.entries[it->second];
+            entry.referenced = true;
+            value            = entry.value;
+
+            m_hit_count.fetch_add(1, std::memory_order_relaxed);
+            return true;
+        }
+    }
+    m_miss_count.fetch_add(1, std::memory_order_relaxed);
+    return false;
+}
+
+template<typename T>
+void PageCache<T>::insert(size_t index, const T& value)
+{
+    Shard& s = shard(index);
+
+    std::lock_guard<std::mutex> lock(s.lock);
+
+    auto it = s.positions.find(index);
+    if (it != s.positions.end()) {
+        // already inserted by a concurrent miss
+        s.entries[it->second].value = value;
+        return;
+    }
+
+    if (s.entries.size() < m_shard_capacity) {
+        s.positions.emplace(index, s.entries.size());
+        s.entries.push_back(Entry{index, false, value});
+        return;
+    }
+
+    // find a victim, giving a second chance to the referenced pages
+    while (s.entries[s.clock_hand].referenced) {
+        s.entries[s.clock_hand].referenced = false;
+        s.clock_hand = (s.clock_hand + 1) % m_shard_capacity;
+    }
+
+    Entry& victim = s.entries[s.clock_hand];
+    s.positions.erase(victim.index);
+    s.positions.emplace(index, s.clock_hand);
+
+    victim.index      = index;
+    victim.referenced = false;
+    victim.value      = value;
+
+    s.clock_hand = (s.clock_hand + 1) % m_shard_capacity;
+}
+
+template<typename T>
+size_t PageCache<T>::size() const
+{
+    size_t res = 0;
+    for (const auto& s : m_shards) {
+        std::lock_guard<std::mutex> lock(s->lock);
+        res += s->entries.size();
+    }
+    return res;
+}
+
+} // namespace abstractio
+} // namespace sse
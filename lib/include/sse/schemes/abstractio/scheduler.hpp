@@ -79,6 +79,9 @@ public:
                              scheduler_callback_type callback)
         = 0;
 
+    /// Submit the reads in order, stopping at the first failure. Returns the
+    /// number of submitted reads (always the first ones of subs: only their
+    /// callbacks will be called), or a negated error code.
     inline virtual int submit_preads(const std::vector<PReadSumission>& subs);
 
     virtual int submit_pwrite(int                     fd,
@@ -90,6 +93,13 @@ public:
         = 0;
 
 
+    /// Register buffers (resp. file descriptors) that will be used
+    /// repeatedly in the IO queries. Schedulers able to take advantage of it
+    /// set them up once and for all, the others ignore the call. Returns 0 on
+    /// success, and a negated error code otherwise.
+    inline virtual int register_buffers(const std::vector<ReadBuffer>& buffers);
+    inline virtual int register_files(const std::vector<int>& fds);
+
     virtual Scheduler* duplicate() const = 0;
 
     static size_t async_io_page_size(int fd);
@@ -102,25 +112,48 @@ int Scheduler::submit_preads(const std::vector<PReadSumission>& subs)
         int err = this->submit_pread(
             read.fd, read.buf, read.len, read.offset, read.data, read.callback);
 
-        if (err == 1) {
-            ret++;
+        if (err != 1) {
+            break;
         }
+        ret++;
     }
     return ret;
 }
+
+int Scheduler::register_buffers(const std::vector<ReadBuffer>& /*buffers*/)
+{
+    return 0;
+}
+
+int Scheduler::register_files(const std::vector<int>& /*fds*/)
+{
+    return 0;
+}
+
 constexpr int EINVAL_UNALIGNED_BUFFER = 1024;
 constexpr int EINVAL_UNALIGNED_ACCESS = 1025;
 constexpr int EINVAL_BUFFERSIZE       = 1026;
 constexpr int EINVAL_INVALID_STATE    = 1027;
 
 #ifdef HAS_LIBAIO
+/// n_shards io contexts (each with n_events slots and its own completion
+/// thread) are used. If n_shards is 0, use one per hardware thread, up to 8.
 Scheduler* make_linux_aio_scheduler(const size_t   page_size,
-                                    const unsigned n_events);
+                                    const unsigned n_events,
+                                    const unsigned n_shards = 1);
+#endif
+
+#ifdef HAS_IO_URING
+Scheduler* make_io_uring_scheduler(const size_t   page_size,
+                                   const unsigned queue_depth,
+                                   bool           sqpoll = false);
 #endif
 
 Scheduler* make_thread_pool_aio_scheduler();
 
 
+/// Returns an io_uring scheduler when the kernel supports it, and falls back
+/// to libaio (or to the thread pool) otherwise.
 Scheduler* make_default_aio_scheduler(const size_t page_size);
 
 } // namespace abstractio
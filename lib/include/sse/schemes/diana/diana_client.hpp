@@ -75,6 +75,10 @@ public:
 
     bool remove_keyword(const std::string& kw);
 
+    // Keep the keyword counters in memory (see RocksDBCounter::enable_cache)
+    void enable_counter_cache(std::chrono::milliseconds checkpoint_period
+                              = std::chrono::milliseconds(1000));
+
     const crypto::Prf<kSearchTokenKeySize>& root_prf() const;
     const crypto::Prf<kKeywordTokenSize>&   kw_token_prf() const;
 
@@ -257,21 +261,25 @@ std::list<std::tuple<std::string, T, uint32_t>> DianaClient<T>::
 {
     std::list<std::tuple<std::string, index_type, uint32_t>> res;
 
-    for (auto it = update_list.begin(); it != update_list.end(); ++it) {
-        std::string keyword = it->first;
-        index_type  index   = it->second;
+    std::vector<std::string> keywords;
+    keywords.reserve(update_list.size());
+    for (const auto& update : update_list) {
+        keywords.push_back(update.first);
+    }
 
-        // retrieve the counter
-        uint32_t kw_counter;
-        bool     success = counter_map_.get_and_increment(keyword, kw_counter);
+    // retrieve and increment all the counters with a single write batch
+    std::vector<uint32_t> kw_counters;
+    bool success = counter_map_.get_and_increment(keywords, kw_counters);
 
-        if (!success) {
-            throw std::runtime_error(
-                "Unable to increment the keyword counter for keyword \""
-                + keyword + "\"");
-        }
+    if (!success) {
+        throw std::runtime_error(
+            "Unable to increment the keyword counters of a batch of "
+            + std::to_string(keywords.size()) + " updates");
+    }
 
-        res.push_back(std::make_tuple(keyword, index, kw_counter));
+    size_t i = 0;
+    for (auto it = update_list.begin(); it != update_list.end(); ++it, ++i) {
+        res.push_back(std::make_tuple(it->first, it->second, kw_counters[i]));
     }
 
     return res;
@@ -283,6 +291,13 @@ bool DianaClient<T>::remove_keyword(const std::string& kw)
     return counter_map_.remove_key(kw);
 }
 
+template<typename T>
+void DianaClient<T>::enable_counter_cache(
+    std::chrono::milliseconds checkpoint_period)
+{
+    counter_map_.enable_cache(checkpoint_period);
+}
+
 template<typename T>
 size_t DianaClient<T>::keyword_count() const
 {
@@ -23,11 +23,16 @@
 
 #include <sse/schemes/diana/diana_common.hpp>
 #include <sse/schemes/diana/types.hpp>
+#include <sse/schemes/utils/range_executor.hpp>
 #include <sse/schemes/utils/rocksdb_wrapper.hpp>
 #include <sse/schemes/utils/thread_pool.hpp>
 
 #include <sse/crypto/prf.hpp>
 
+#include <algorithm>
+#include <memory>
+#include <vector>
+
 namespace sse {
 namespace diana {
 
@@ -43,15 +48,53 @@ public:
     using basic_callback_type = std::function<void(index_type)>;
     // Callback taking the position of the result in the result list (i.e. n if
     // it is the n-th element in the insertion order), the result and the thread
-    // id as input. In this implementation, this callback is guaranteed to be
-    // called by only one thread (hence the tl prefix for 'thread local')
+    // id as input. In this implementation, the callback is never called
+    // concurrently with the same thread id (hence the tl prefix for 'thread
+    // local')
     using tl_callback_type = std::function<void(size_t, index_type, uint8_t)>;
 
+    // Default number of update tokens whose entries are fetched from the
+    // database in a single batch during searches
+    static constexpr size_t kDefaultLookupBatchSize = 128;
+
+    // Default number of leaves processed at once by a thread during parallel
+    // searches
+    static constexpr size_t kDefaultSearchChunkSize = 1024;
+
 
     explicit DianaServer(const std::string& db_path);
 
+    // Parallel searches are run on the given executor, which can be shared
+    // between several servers. By default, the global executor is used.
+    DianaServer(const std::string& db_path, utility::RangeExecutor& executor);
+
+    // Set the number of database entries fetched together during a search.
+    // A batch size of 0 or 1 disables batching: the entries are then retrieved
+    // one by one. This must not be called while a search is running.
+    void set_lookup_batch_size(size_t batch_size);
+
+    size_t lookup_batch_size() const
+    {
+        return lookup_batch_size_;
+    }
+
+    // Set the number of leaves processed at once by a thread during parallel
+    // searches: a search is split between threads only if it has more
+    // results. This must not be called while a search is running.
+    void set_search_chunk_size(size_t chunk_size);
+
+    size_t search_chunk_size() const
+    {
+        return search_chunk_size_;
+    }
+
     std::list<index_type> search(const SearchRequest& req,
                                  bool                 delete_results = false);
+    // Results are written in the vector (resized to req.add_count if needed)
+    // at the position corresponding to their insertion order
+    void                  search(const SearchRequest&     req,
+                                 std::vector<index_type>& results,
+                                 bool                     delete_results = false);
     void                  search(const SearchRequest&       req,
                                  const basic_callback_type& post_callback,
                                  bool                       delete_results = false);
@@ -75,11 +118,29 @@ public:
 
     void insert(const UpdateRequest<index_type>& req);
 
+    // Insert all the requests with a single write batch
+    void insert(const std::vector<UpdateRequest<index_type>>& reqs,
+                bool                                          disable_wal = false);
+
     void flush_edb();
 
+    // Make the previous insertions durable (see RockDBWrapper::sync)
+    void sync_edb(bool wal_disabled);
+
 private:
+    // Callback taking the leaf index and the unmasked result as input
+    using leaf_callback_type = std::function<void(uint64_t, index_type)>;
+
     bool get_unmask(uint8_t* key, index_type& index, bool delete_key);
 
+    // Retrieve (and unmask) the entries associated to the leaves between
+    // min_index and max_index (included) of the request's constrained RCPRF
+    void lookup_range(const SearchRequest&      req,
+                      uint64_t                  min_index,
+                      uint64_t                  max_index,
+                      bool                      delete_results,
+                      const leaf_callback_type& callback);
+
     inline bool retrieve_entry(const update_token_type& key,
                                index_type&              index,
                                bool                     delete_key)
@@ -94,6 +155,11 @@ private:
 
 
     sophos::RockDBWrapper edb_;
+
+    utility::RangeExecutor& executor_;
+
+    size_t lookup_batch_size_{kDefaultLookupBatchSize};
+    size_t search_chunk_size_{kDefaultSearchChunkSize};
 };
 
 } // namespace diana
@@ -103,10 +169,30 @@ namespace sse {
 namespace diana {
 
 template<typename T>
-DianaServer<T>::DianaServer(const std::string& db_path) : edb_(db_path)
+DianaServer<T>::DianaServer(const std::string& db_path)
+    : DianaServer(db_path, utility::RangeExecutor::global_executor())
+{
+}
+
+template<typename T>
+DianaServer<T>::DianaServer(const std::string&      db_path,
+                            utility::RangeExecutor& executor)
+    : edb_(db_path), executor_(executor)
 {
 }
 
+template<typename T>
+void DianaServer<T>::set_lookup_batch_size(size_t batch_size)
+{
+    lookup_batch_size_ = batch_size;
+}
+
+template<typename T>
+void DianaServer<T>::set_search_chunk_size(size_t chunk_size)
+{
+    search_chunk_size_ = std::max<size_t>(chunk_size, 1);
+}
+
 template<typename T>
 bool DianaServer<T>::get_unmask(uint8_t*    key,
                                 index_type& index,
@@ -157,6 +243,31 @@ std::list<typename DianaServer<T>::index_type> DianaServer<T>::search(
     return results;
 }
 
+template<typename T>
+void DianaServer<T>::search(const SearchRequest&     req,
+                            std::vector<index_type>& results,
+                            bool                     delete_results)
+{
+    if (results.size() < req.add_count) {
+        // resize the vector if needed
+        results.resize(req.add_count);
+    }
+
+    // if the search request is empty, return immediately
+    if (req.add_count == 0) {
+        return;
+    }
+
+    auto callback = [&results](uint64_t leaf_index, index_type index) {
+        if (__builtin_expect(leaf_index < results.size(), 1)) {
+            results[leaf_index] = index;
+        }
+    };
+
+    lookup_range(
+        req, 0, req.constrained_rcprf.max_leaf(), delete_results, callback);
+}
+
 template<typename T>
 void DianaServer<T>::search(const SearchRequest&       req,
                             const basic_callback_type& post_callback,
@@ -169,17 +280,11 @@ void DianaServer<T>::search(const SearchRequest&       req,
         return;
     }
 
-    auto eval_callback
-        // cppcheck-suppress variableScope
-        = [this, &post_callback, delete_results](uint64_t /*leaf_index*/,
-                                                 search_token_key_type st) {
-              index_type index;
-              if (get_unmask(st.data(), index, delete_results)) {
-                  post_callback(index);
-              }
-          };
-    req.constrained_rcprf.eval_range(
-        0, req.constrained_rcprf.max_leaf(), eval_callback);
+    auto callback = [&post_callback](uint64_t /*leaf_index*/,
+                                     index_type index) { post_callback(index); };
+
+    lookup_range(
+        req, 0, req.constrained_rcprf.max_leaf(), delete_results, callback);
 }
 
 template<typename T>
@@ -268,47 +373,98 @@ void DianaServer<T>::search_parallel(const SearchRequest&    req,
                    const uint8_t t_id,
                    const size_t  min_index,
                    const size_t  max_index) {
-        auto eval_callback
+        auto callback
             // cppcheck does not like nested lambda
             // cppcheck-suppress shadowVar
-            // Silence issues with cppcheck on lambda's variable scope
+            = [&post_callback, t_id](uint64_t leaf_index, index_type index) {
+                  post_callback(leaf_index, index, t_id);
+              };
+        lookup_range(req, min_index, max_index, delete_results, callback);
+    };
+
+    // The leaves are split in chunks shared between (at most) threads_count
+    // threads of the executor, including the current one. This way, the
+    // concurrent searches do not oversubscribe the cores.
+    executor_.run(req.add_count, search_chunk_size_, threads_count, job);
+}
+
+template<typename T>
+void DianaServer<T>::lookup_range(const SearchRequest&      req,
+                                  const uint64_t            min_index,
+                                  const uint64_t            max_index,
+                                  const bool                delete_results,
+                                  const leaf_callback_type& callback)
+{
+    if (lookup_batch_size_ <= 1) {
+        auto eval_callback
             // cppcheck-suppress variableScope
-            = [this, &post_callback, delete_results, t_id](
-                  uint64_t leaf_index, search_token_key_type st) {
+            = [this, &callback, delete_results](uint64_t              leaf_index,
+                                                search_token_key_type st) {
                   index_type index;
                   if (get_unmask(st.data(), index, delete_results)) {
-                      post_callback(leaf_index, index, t_id);
+                      callback(leaf_index, index);
                   }
               };
         req.constrained_rcprf.eval_range(min_index, max_index, eval_callback);
-    };
-
-    std::vector<std::thread> threads;
-
-    threads_count = std::min<uint8_t>(
-        std::min<uint32_t>(threads_count, req.add_count), 0xFF);
-
-
-    size_t step      = req.add_count / threads_count;
-    size_t remaining = req.add_count % threads_count;
-
-    size_t min = 0;
-    size_t max = step;
+        return;
+    }
 
-    for (uint8_t t = 0; t < threads_count; t++) {
-        if (t < remaining) {
-            max++;
+    // Buffer the derived update tokens and fetch the corresponding entries
+    // with a single multi-get query per batch
+    const size_t batch_size
+        = std::min<size_t>(lookup_batch_size_, max_index - min_index + 1);
+
+    std::vector<uint64_t>          leaves(batch_size);
+    std::vector<update_token_type> tokens(batch_size);
+    std::vector<index_type>        masks(batch_size);
+    std::vector<index_type>        values(batch_size);
+    std::unique_ptr<bool[]>        found(new bool[batch_size]);
+    size_t                         pending = 0;
+
+    auto flush_batch = [this,
+                        &callback,
+                        delete_results,
+                        &leaves,
+                        &tokens,
+                        &masks,
+                        &values,
+                        &found,
+                        &pending]() {
+        edb_.multi_get(tokens.data(), pending, values.data(), found.get());
+
+        for (size_t i = 0; i < pending; i++) {
+            if (found[i]) {
+                if (delete_results) {
+                    edb_.remove(tokens[i]);
+                }
+                callback(leaves[i], xor_mask(values[i], masks[i]));
+            } else {
+                /* LCOV_EXCL_START */
+                logger::logger()->error(
+                    "We were supposed to find an entry. Accessed key: "
+                    + utility::hex_string(tokens[i]));
+                /* LCOV_EXCL_STOP */
+            }
         }
+        pending = 0;
+    };
 
-        threads.push_back(
-            std::thread(job, t, min, std::min<size_t>(max, req.add_count) - 1));
-
-        min = max;
-        max += step;
-    }
+    auto eval_callback
+        // cppcheck-suppress variableScope
+        = [batch_size, &leaves, &tokens, &masks, &pending, &flush_batch](
+              uint64_t leaf_index, search_token_key_type st) {
+              leaves[pending] = leaf_index;
+              gen_update_token_mask<T>(
+                  st.data(), tokens[pending], masks[pending]);
+
+              if (++pending == batch_size) {
+                  flush_batch();
+              }
+          };
+    req.constrained_rcprf.eval_range(min_index, max_index, eval_callback);
 
-    for (auto& t : threads) {
-        t.join();
+    if (pending > 0) {
+        flush_batch();
     }
 }
 
@@ -322,10 +478,30 @@ void DianaServer<T>::insert(const UpdateRequest<T>& req)
     edb_.put(req.token, req.index);
 }
 
+template<typename T>
+void DianaServer<T>::insert(const std::vector<UpdateRequest<T>>& reqs,
+                            bool                                 disable_wal)
+{
+    logger::logger()->debug("Received " + std::to_string(reqs.size())
+                            + " updates");
+
+    rocksdb::WriteBatch batch;
+    for (const auto& req : reqs) {
+        sophos::RockDBWrapper::put(batch, req.token, req.index);
+    }
+    edb_.write(batch, disable_wal);
+}
+
 template<typename T>
 void DianaServer<T>::flush_edb()
 {
     edb_.flush();
 }
+
+template<typename T>
+void DianaServer<T>::sync_edb(bool wal_disabled)
+{
+    edb_.sync(wal_disabled);
+}
 } // namespace diana
 } // namespace sse
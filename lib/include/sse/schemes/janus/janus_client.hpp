@@ -37,6 +37,11 @@ public:
     DeletionRequest  removal_request(const std::string& keyword,
                                      const index_type   index);
 
+    // Keep the counters of the search, insertion and deletion maps in memory
+    // (see RocksDBCounter::enable_cache)
+    void enable_counter_cache(std::chrono::milliseconds checkpoint_period
+                              = std::chrono::milliseconds(1000));
+
     //            std::list<UpdateRequest<T>>   bulk_insertion_request(const
     //            std::list<std::pair<std::string, index_type>> &update_list);
     //
@@ -33,6 +33,12 @@ public:
     std::list<index_type> search(SearchRequest& req);
     std::list<index_type> search_parallel(SearchRequest& req,
                                           uint8_t        diana_threads_count);
+
+    // Replace the content of results by the search's results
+    void search(SearchRequest& req, std::vector<index_type>& results);
+    void search_parallel(SearchRequest&           req,
+                         uint8_t                  diana_threads_count,
+                         std::vector<index_type>& results);
     void                  search_parallel(SearchRequest& req,
                                           uint8_t        diana_threads_count,
                                           const std::function<void(index_type)>& post_callback);
@@ -281,18 +281,44 @@ public:
     using get_callback_type
         = std::function<void(std::experimental::optional<T>)>;
 
+    using bucket_cache_type = abstractio::PageCache<payload_type>;
+
 
     using param_type = std::string;
 
     explicit CuckooHashTable(const std::string& path);
 
+    // Read the table through the given IO scheduler
+    CuckooHashTable(const std::string&                       path,
+                    std::unique_ptr<abstractio::Scheduler>&& scheduler);
+
+
+    // Throws std::out_of_range if the key is not in the table
+    T get(const Key& key);
+
+    // Returns an empty optional if the key is not in the table
+    std::experimental::optional<T> try_get(const Key& key);
 
-    T    get(const Key& key);
     void async_get(const Key& key, get_callback_type callback);
 
 
     void use_direct_IO(bool flag);
 
+    // Cache the buckets read from the table, within a memory budget (in
+    // bytes). A zero budget disables the cache.
+    void use_bucket_cache(
+        size_t byte_budget,
+        size_t n_shards = bucket_cache_type::kDefaultShardsCount);
+
+    const std::shared_ptr<bucket_cache_type>& bucket_cache() const noexcept
+    {
+        return table.cache();
+    }
+
+    // Serve all the reads from a memory mapping of the table (see
+    // awonvm_vector::map_memory)
+    void use_memory_map(bool populate = false, bool huge_pages = false);
+
 private:
     using table_type = abstractio::awonvm_vector<payload_type, PAGE_SIZE>;
     table_type table;
@@ -329,6 +355,34 @@ CuckooHashTable<PAGE_SIZE,
     std::cerr << "Table size: " << table_size << "\n";
 }
 
+template<size_t PAGE_SIZE,
+         class Key,
+         class T,
+         class KeySerializer,
+         class ValueSerializer,
+         class CuckooHasher>
+CuckooHashTable<PAGE_SIZE,
+                Key,
+                T,
+                KeySerializer,
+                ValueSerializer,
+                CuckooHasher>::
+    CuckooHashTable(const std::string&                       path,
+                    std::unique_ptr<abstractio::Scheduler>&& scheduler)
+    : table(path, std::move(scheduler), false)
+{
+    if (!table.is_committed()) {
+        throw std::runtime_error("Table not committed");
+    }
+
+    table_size = table.size();
+
+    if (table_size % 2 != 0) {
+        throw std::runtime_error("Invalid Cuckoo table size");
+    }
+    table_size /= 2;
+}
+
 
 template<size_t PAGE_SIZE,
          class Key,
@@ -342,6 +396,28 @@ T CuckooHashTable<PAGE_SIZE,
                   KeySerializer,
                   ValueSerializer,
                   CuckooHasher>::get(const Key& key)
+{
+    std::experimental::optional<T> value = try_get(key);
+
+    if (!value) {
+        throw std::out_of_range("Key not found");
+    }
+    return *value;
+}
+
+template<size_t PAGE_SIZE,
+         class Key,
+         class T,
+         class KeySerializer,
+         class ValueSerializer,
+         class CuckooHasher>
+auto CuckooHashTable<PAGE_SIZE,
+                     Key,
+                     T,
+                     KeySerializer,
+                     ValueSerializer,
+                     CuckooHasher>::try_get(const Key& key)
+    -> std::experimental::optional<T>
 {
     CuckooKey search_key = CuckooHasher()(key);
 
@@ -351,19 +427,21 @@ T CuckooHashTable<PAGE_SIZE,
     std::array<uint8_t, kKeySize> ser_key;
     KeySerializer().serialize(key, ser_key.data());
 
-    payload_type val_0 = table.get(loc);
+    // no copy when the table is memory mapped
+    payload_type        buffer;
+    const payload_type& val_0 = table.view(loc, buffer);
     if (details::match_key<PAGE_SIZE>(val_0, ser_key)) {
         return ValueSerializer().deserialize(val_0.data() + kKeySize);
     }
 
     loc = search_key.h[1] % table_size;
 
-    payload_type val_1 = table.get(loc + table_size);
+    const payload_type& val_1 = table.view(loc + table_size, buffer);
 
     if (details::match_key<PAGE_SIZE>(val_1, ser_key)) {
         return ValueSerializer().deserialize(val_1.data() + kKeySize);
     }
-    throw std::out_of_range("Key not found");
+    return {};
 }
 
 
@@ -383,8 +461,9 @@ void CuckooHashTable<PAGE_SIZE,
 {
     struct CallBackState
     {
-        std::unique_ptr<payload_type> result{nullptr};
-        std::atomic<uint8_t>          completion_counter{0};
+        abstractio::pooled_ptr<payload_type> result{nullptr};
+        std::atomic<uint8_t>                 completion_counter{0};
+        std::atomic<bool>                    failed{false};
     };
 
     CuckooKey search_key = CuckooHasher()(key);
@@ -399,7 +478,8 @@ void CuckooHashTable<PAGE_SIZE,
     CallBackState* state = new CallBackState();
 
     auto inner_callback =
-        [state, ser_key, callback](std::unique_ptr<payload_type> read_value) {
+        [state, ser_key, callback](
+            abstractio::pooled_ptr<payload_type> read_value) {
             if (read_value) {
                 // check whether we are a match on the key
                 if (details::match_key<PAGE_SIZE>(*read_value.get(), ser_key)) {
@@ -430,10 +510,16 @@ void CuckooHashTable<PAGE_SIZE,
                 // using a unique_ptr (eg. using the completion counter as an
                 // additional flag), this is its role for the moment.
 
-                std::unique_ptr<payload_type> data = std::move(state->result);
+                abstractio::pooled_ptr<payload_type> data
+                    = std::move(state->result);
+                const bool failed = state->failed.load();
 
                 delete state;
 
+                if (failed) {
+                    // the caller got an exception instead
+                    return;
+                }
                 if (data) {
                     callback(
                         ValueSerializer().deserialize(data->data() + kKeySize));
@@ -447,8 +533,26 @@ void CuckooHashTable<PAGE_SIZE,
     // table.async_get(loc_0, inner_callback);
     // table.async_get(loc_1, inner_callback);
     using GetRequest = typename table_type::GetRequest;
-    table.async_gets(
-        {GetRequest(loc_0, inner_callback), GetRequest(loc_1, inner_callback)});
+    size_t submitted = 0;
+    try {
+        submitted = table.async_gets({GetRequest(loc_0, inner_callback),
+                                      GetRequest(loc_1, inner_callback)});
+    } catch (...) {
+        // none of the reads was submitted
+        delete state;
+        throw;
+    }
+
+    if (submitted < 2) {
+        // The second read will never complete: count it as completed, so that
+        // the first one frees the state (or do it here if it is already
+        // done). The callback is not called.
+        state->failed.store(true);
+        if (state->completion_counter.fetch_add(1) == 1) {
+            delete state;
+        }
+        throw std::runtime_error("Unable to submit the bucket reads");
+    }
 }
 
 
@@ -468,6 +572,45 @@ void CuckooHashTable<PAGE_SIZE,
     table.set_use_direct_access(flag);
 }
 
+template<size_t PAGE_SIZE,
+         class Key,
+         class T,
+         class KeySerializer,
+         class ValueSerializer,
+         class CuckooHasher>
+void CuckooHashTable<PAGE_SIZE,
+                     Key,
+                     T,
+                     KeySerializer,
+                     ValueSerializer,
+                     CuckooHasher>::use_bucket_cache(size_t byte_budget,
+                                                     size_t n_shards)
+{
+    if (byte_budget == 0) {
+        table.set_cache(nullptr);
+    } else {
+        table.set_cache(
+            std::make_shared<bucket_cache_type>(byte_budget, n_shards));
+    }
+}
+
+template<size_t PAGE_SIZE,
+         class Key,
+         class T,
+         class KeySerializer,
+         class ValueSerializer,
+         class CuckooHasher>
+void CuckooHashTable<PAGE_SIZE,
+                     Key,
+                     T,
+                     KeySerializer,
+                     ValueSerializer,
+                     CuckooHasher>::use_memory_map(bool populate,
+                                                   bool huge_pages)
+{
+    table.map_memory(populate, huge_pages);
+}
+
 
 } // namespace oceanus
 } // namespace sse
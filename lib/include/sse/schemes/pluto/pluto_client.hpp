@@ -51,10 +51,12 @@ public:
 
 
     SearchRequest search_request(const std::string& keyword) const;
+    SearchRequest search_request(const std::string& keyword,
+                                 uint32_t           complete_blocks_hint) const;
 
     std::vector<index_type> decode_search_results(
-        const SearchRequest&                    req,
-        const SearchResponse<kServerBucketSize> response);
+        const SearchRequest&                     req,
+        const SearchResponse<kServerBucketSize>& response);
 
 private:
     template<class TethysStashDecoder>
@@ -114,16 +116,29 @@ SearchRequest PlutoClient<TethysValueDecoder>::search_request(
     return sr;
 }
 
+template<class TethysValueDecoder>
+SearchRequest PlutoClient<TethysValueDecoder>::search_request(
+    const std::string& keyword,
+    uint32_t           complete_blocks_hint) const
+{
+    SearchRequest sr        = search_request(keyword);
+    sr.complete_blocks_hint = complete_blocks_hint;
+
+    return sr;
+}
+
 template<class TethysValueDecoder>
 std::vector<index_type> PlutoClient<TethysValueDecoder>::decode_search_results(
-    const SearchRequest&                    req,
-    const SearchResponse<kServerBucketSize> response)
+    const SearchRequest&                     req,
+    const SearchResponse<kServerBucketSize>& response)
 {
-    // first get the results stored in Tethys
-    tethys::SearchRequest   treq = {req.search_token, 1};
-    std::vector<index_type> results
-        = tethys::TethysClient<TethysValueDecoder>::decode_search_results(
-            treq, {response.tethys_bucket_pair}, stash, decrypt_decoder);
+    (void)req;
+
+    // first get the results stored in Tethys, decoded straight from the
+    // response's bucket pair
+    std::vector<index_type> results;
+    tethys::TethysClient<TethysValueDecoder>::decode_bucket_pair(
+        response.tethys_bucket_pair, stash, decrypt_decoder, results);
 
     // and append the results from the hash table
     results.reserve(results.size() + response.complete_lists.size());
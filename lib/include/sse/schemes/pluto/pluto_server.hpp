@@ -4,8 +4,14 @@
 #include <sse/schemes/tethys/details/tethys_utils.hpp>
 #include <sse/schemes/tethys/tethys_store.hpp>
 #include <sse/schemes/tethys/types.hpp>
+#include <sse/schemes/utils/logger.hpp>
+#include <sse/schemes/utils/thread_pool.hpp>
 
+#include <algorithm>
 #include <array>
+#include <atomic>
+#include <functional>
+#include <vector>
 
 namespace sse {
 namespace pluto {
@@ -27,23 +33,111 @@ public:
 
     static constexpr size_t kMasterPrfKeySize = tethys::kMasterPrfKeySize;
 
-    PlutoServer(const std::string& tethys_path, const ht_param_type& ht_param);
+    // Bounds of the number of hash table probes submitted at once by
+    // async_search. The size of a round doubles each time all its probes hit.
+    // With a block count hint, the first round covers all the hinted blocks.
+    static constexpr uint32_t kInitialProbeRoundSize   = 4;
+    static constexpr uint32_t kMaxProbeRoundSize       = 64;
+    static constexpr uint32_t kMaxHintedProbeRoundSize = 4096;
+
+    using search_response_type = SearchResponse<Params::kPageSize>;
+    using search_callback_type = std::function<void(search_response_type)>;
+
+    // The rounds of hash table probes following the first one are submitted
+    // from thread_pool
+    PlutoServer(const std::string&   tethys_path,
+                const ht_param_type& ht_param,
+                ThreadPool&          thread_pool
+                = ThreadPool::global_thread_pool());
+
+    // Read the Tethys table and the hash table through the given IO
+    // schedulers. Only available for hash tables stored in a file.
+    PlutoServer(const std::string&                       tethys_path,
+                const ht_param_type&                     ht_param,
+                std::unique_ptr<abstractio::Scheduler>&& tethys_scheduler,
+                std::unique_ptr<abstractio::Scheduler>&& ht_scheduler,
+                ThreadPool&                              thread_pool
+                = ThreadPool::global_thread_pool());
 
 
     SearchResponse<Params::kPageSize> search(
         const SearchRequest& search_request);
 
+    // Read the Tethys buckets and probe the hash table concurrently. Hash
+    // table probes are speculative: they are submitted in rounds, and the
+    // search stops at the first round with a miss (with an exact block count
+    // hint, there is a single round). The callback is called from an IO
+    // completion thread, or from the calling thread if no read could be
+    // submitted. If some reads could not be submitted, the response is
+    // flagged as failed.
+    void async_search(const SearchRequest& search_request,
+                      search_callback_type callback);
+
 
 private:
+    using ht_value_type = typename Params::ht_value_type;
+
+    struct SearchState
+    {
+        SearchRequest        request;
+        search_callback_type callback;
+        search_response_type response;
+
+        // the Tethys read and the hash table probes
+        std::atomic<uint8_t> pending_branches{2};
+
+        // set when some reads could not be submitted
+        std::atomic<bool> failed{false};
+
+        // probes of the current round
+        std::vector<std::experimental::optional<ht_value_type>> round_values;
+        std::atomic<uint32_t> round_completed{0};
+
+        SearchState(const SearchRequest& req, search_callback_type cb)
+            : request(req), callback(std::move(cb))
+        {
+        }
+    };
+
+    // The state is deleted after the completion of the last branch: it must
+    // not be accessed after this call
+    static void complete_search_branch(SearchState* state);
+
+    // Probe the hash table for the blocks first, ..., first+count-1
+    void probe_hash_table(SearchState* state, uint32_t first, uint32_t count);
+
+    // Account for the probes of the round, starting at the i-th one, that
+    // could not be submitted
+    static void abort_probe_round(SearchState*          state,
+                                  uint32_t              i,
+                                  uint32_t              count,
+                                  const std::exception& e);
+
     tethys_store_type tethys_store;
     ht_type           hash_table;
+    ThreadPool&       probe_thread_pool;
 };
 
 
 template<class Params>
 PlutoServer<Params>::PlutoServer(const std::string&   tethys_path,
-                                 const ht_param_type& ht_param)
-    : tethys_store(tethys_path, ""), hash_table(ht_param)
+                                 const ht_param_type& ht_param,
+                                 ThreadPool&          thread_pool)
+    : tethys_store(tethys_path, ""), hash_table(ht_param),
+      probe_thread_pool(thread_pool)
+{
+}
+
+template<class Params>
+PlutoServer<Params>::PlutoServer(
+    const std::string&                       tethys_path,
+    const ht_param_type&                     ht_param,
+    std::unique_ptr<abstractio::Scheduler>&& tethys_scheduler,
+    std::unique_ptr<abstractio::Scheduler>&& ht_scheduler,
+    ThreadPool&                              thread_pool)
+    : tethys_store(tethys_path, "", std::move(tethys_scheduler)),
+      hash_table(ht_param, std::move(ht_scheduler)),
+      probe_thread_pool(thread_pool)
 {
 }
 
@@ -57,23 +151,185 @@ auto PlutoServer<Params>::search(const SearchRequest& search_request)
         tethys::tethys_core_key_type key
             = tethys::details::derive_core_key(search_request.search_token, i);
 
-        try {
-            typename Params::ht_value_type v = hash_table.get(key);
+        std::experimental::optional<ht_value_type> v = hash_table.try_get(key);
 
-            res.complete_lists.reserve(res.complete_lists.size() + v.size());
-            res.complete_lists.insert(
-                res.complete_lists.end(), v.begin(), v.end());
-        } catch (const std::out_of_range& e) {
+        if (!v) {
             break;
         }
+        res.complete_lists.reserve(res.complete_lists.size() + v->size());
+        res.complete_lists.insert(
+            res.complete_lists.end(), v->begin(), v->end());
     }
 
     // get the bucket pair from the Tethys store
     tethys::tethys_core_key_type key
         = tethys::details::derive_core_key(search_request.search_token, 0);
-    res.tethys_bucket_pair = {key, tethys_store.get_buckets(key)};
+    res.tethys_bucket_pair.key = key;
+    tethys_store.get_buckets(key, res.tethys_bucket_pair.buckets);
 
     return res;
 }
+
+template<class Params>
+constexpr uint32_t PlutoServer<Params>::kInitialProbeRoundSize;
+template<class Params>
+constexpr uint32_t PlutoServer<Params>::kMaxProbeRoundSize;
+template<class Params>
+constexpr uint32_t PlutoServer<Params>::kMaxHintedProbeRoundSize;
+
+template<class Params>
+void PlutoServer<Params>::async_search(const SearchRequest& search_request,
+                                       search_callback_type callback)
+{
+    SearchState* state = new SearchState(search_request, std::move(callback));
+
+    // get the bucket pair from the Tethys store
+    tethys::tethys_core_key_type key
+        = tethys::details::derive_core_key(search_request.search_token, 0);
+
+    using views_type
+        = std::vector<tethys::BucketPairView<Params::kPageSize>>;
+
+    auto tethys_cb = [state, key](const views_type& views) {
+        tethys::KeyedBucketPair<Params::kPageSize>& pair
+            = state->response.tethys_bucket_pair;
+
+        pair.key               = key;
+        pair.buckets.index_0   = views[0].index_0;
+        pair.buckets.index_1   = views[0].index_1;
+        pair.buckets.payload_0 = *views[0].payload_0;
+        pair.buckets.payload_1 = *views[0].payload_1;
+
+        complete_search_branch(state);
+    };
+
+    try {
+        tethys_store.async_get_bucket_views({key}, tethys_cb);
+    } catch (const std::exception& e) {
+        // tethys_cb will never be called
+        logger::logger()->error("Unable to read the Tethys buckets: "
+                                + std::string(e.what()));
+        state->failed.store(true);
+        complete_search_branch(state);
+    }
+
+    // one more probe than the hint, to check that there is no other block
+    uint32_t first_round_size = kInitialProbeRoundSize;
+    if (search_request.complete_blocks_hint) {
+        first_round_size = static_cast<uint32_t>(
+            std::min<uint64_t>(*search_request.complete_blocks_hint + 1ULL,
+                               kMaxHintedProbeRoundSize));
+    }
+
+    // the first key for the hash table has index 1
+    probe_hash_table(state, 1, first_round_size);
+}
+
+template<class Params>
+void PlutoServer<Params>::complete_search_branch(SearchState* state)
+{
+    // the two branches write distinct members of the response: the counter
+    // publishes them to the last one
+    uint8_t remaining = state->pending_branches.fetch_sub(1) - 1;
+
+    if (remaining == 0) {
+        search_callback_type callback = std::move(state->callback);
+        search_response_type response = std::move(state->response);
+        response.failed               = state->failed.load();
+        delete state;
+
+        callback(std::move(response));
+    }
+}
+
+template<class Params>
+void PlutoServer<Params>::probe_hash_table(SearchState* state,
+                                           uint32_t     first,
+                                           uint32_t     count)
+{
+    // the previous round is over: nobody else accesses the round members
+    state->round_values.assign(count, {});
+    state->round_completed = 0;
+
+    for (uint32_t i = 0; i < count; i++) {
+        tethys::tethys_core_key_type key = tethys::details::derive_core_key(
+            state->request.search_token, first + i);
+
+        auto probe_cb = [this, state, first, count, i](
+                            std::experimental::optional<ht_value_type> v) {
+            state->round_values[i] = std::move(v);
+
+            uint32_t completed = state->round_completed.fetch_add(1) + 1;
+            if (completed != count) {
+                return;
+            }
+
+            if (state->failed.load()) {
+                // the search is incomplete anyway
+                complete_search_branch(state);
+                return;
+            }
+
+            std::vector<index_type>& lists = state->response.complete_lists;
+            for (const auto& value : state->round_values) {
+                if (!value) {
+                    // the keyword has no more complete block
+                    complete_search_branch(state);
+                    return;
+                }
+                lists.reserve(lists.size() + value->size());
+                lists.insert(lists.end(), value->begin(), value->end());
+            }
+
+            // All the probes hit: there might be more blocks. Do not submit
+            // the next round from the IO completion thread: the submission
+            // can block until this very thread reaps some completions.
+            const uint32_t next_first = first + count;
+            const uint32_t next_count = std::min(2 * count, kMaxProbeRoundSize);
+            try {
+                probe_thread_pool.enqueue(
+                    [this, state, next_first, next_count]() {
+                        probe_hash_table(state, next_first, next_count);
+                    });
+            } catch (const std::exception& e) {
+                logger::logger()->error("Unable to probe the hash table: "
+                                        + std::string(e.what()));
+                state->failed.store(true);
+                complete_search_branch(state);
+            }
+        };
+
+        // the state might have been deleted by the last callback of the
+        // round: do not touch it after the last probe (unless the submission
+        // failed, in which case probe_cb will never be called)
+        try {
+            hash_table.async_get(key, probe_cb);
+        } catch (const std::exception& e) {
+            abort_probe_round(state, i, count, e);
+            return;
+        }
+    }
+}
+
+template<class Params>
+void PlutoServer<Params>::abort_probe_round(SearchState*          state,
+                                            uint32_t              i,
+                                            uint32_t              count,
+                                            const std::exception& e)
+{
+    logger::logger()->error("Unable to probe the hash table: "
+                            + std::string(e.what()));
+
+    // the callbacks of the probes i, ..., count-1 will never be called:
+    // count them as completed, and let the last completed probe end the
+    // branch (or do it here if they are all done)
+    state->failed.store(true);
+    const uint32_t missing = count - i;
+    const uint32_t completed
+        = state->round_completed.fetch_add(missing) + missing;
+    if (completed == count) {
+        complete_search_branch(state);
+    }
+}
 } // namespace pluto
 } // namespace sse
\ No newline at end of file
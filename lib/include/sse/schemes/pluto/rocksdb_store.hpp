@@ -2,12 +2,15 @@
 
 #include <sse/schemes/pluto/types.hpp>
 #include <sse/schemes/utils/logger.hpp>
+// NOLINTNEXTLINE
+#include <sse/schemes/utils/optional.hpp>
 
 #include <rocksdb/db.h>
 #include <rocksdb/memtablerep.h>
 #include <rocksdb/options.h>
 #include <rocksdb/table.h>
 
+#include <functional>
 #include <memory>
 
 namespace sse {
@@ -33,9 +36,15 @@ public:
     void insert(const tethys::tethys_core_key_type& key,
                 const std::array<index_type, N>&    value);
 
+    // Throws std::out_of_range if the key is not in the store
     template<size_t N>
     std::array<index_type, N> get(const tethys::tethys_core_key_type& key);
 
+    // Returns an empty optional if the key is not in the store
+    template<size_t N>
+    std::experimental::optional<std::array<index_type, N>> try_get(
+        const tethys::tethys_core_key_type& key);
+
 private:
     std::unique_ptr<rocksdb::DB> db;
 };
@@ -65,6 +74,20 @@ void GenericRocksDBStore::insert(const tethys::tethys_core_key_type& key,
 template<size_t N>
 std::array<index_type, N> GenericRocksDBStore::get(
     const tethys::tethys_core_key_type& key)
+{
+    std::experimental::optional<std::array<index_type, N>> content
+        = try_get<N>(key);
+
+    if (!content) {
+        throw std::out_of_range("Key not found");
+    }
+
+    return *content;
+}
+
+template<size_t N>
+std::experimental::optional<std::array<index_type, N>> GenericRocksDBStore::
+    try_get(const tethys::tethys_core_key_type& key)
 {
     rocksdb::Slice k_s(reinterpret_cast<const char*>(key.data()),
                        tethys::kTethysCoreKeySize);
@@ -72,14 +95,13 @@ std::array<index_type, N> GenericRocksDBStore::get(
     std::string     value;
     rocksdb::Status s = db->Get(rocksdb::ReadOptions(false, true), k_s, &value);
 
-    std::array<index_type, N> content;
-
-    if (s.ok()) {
-        ::memcpy(content.data(), value.data(), N * sizeof(index_type));
-    } else {
-        throw std::out_of_range("Key not found");
+    if (!s.ok()) {
+        return {};
     }
 
+    std::array<index_type, N> content;
+    ::memcpy(content.data(), value.data(), N * sizeof(index_type));
+
     return content;
 }
 
@@ -88,7 +110,11 @@ template<size_t N>
 class RocksDBStoreBuilder
 {
 public:
+    using value_type = std::array<index_type, N>;
     using param_type = GenericRocksDBStoreParams;
+    using get_callback_type
+        = std::function<void(std::experimental::optional<value_type>)>;
+
     explicit RocksDBStoreBuilder(const param_type& params) : store(params)
     {
     }
@@ -108,6 +134,20 @@ public:
         return store.get<N>(key);
     }
 
+    std::experimental::optional<value_type> try_get(
+        const tethys::tethys_core_key_type& key)
+    {
+        return store.try_get<N>(key);
+    }
+
+    // RocksDB has no asynchronous interface: the callback is called before
+    // returning
+    void async_get(const tethys::tethys_core_key_type& key,
+                   get_callback_type                   callback)
+    {
+        callback(store.try_get<N>(key));
+    }
+
 private:
     GenericRocksDBStore store;
 };
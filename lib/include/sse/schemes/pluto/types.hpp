@@ -5,6 +5,8 @@
 #include <sse/schemes/tethys/encoders/encode_encrypt.hpp>
 #include <sse/schemes/tethys/encoders/encode_separate.hpp>
 #include <sse/schemes/tethys/types.hpp>
+// NOLINTNEXTLINE
+#include <sse/schemes/utils/optional.hpp>
 
 namespace sse {
 namespace pluto {
@@ -14,6 +16,11 @@ using index_type = tethys::index_type;
 struct SearchRequest
 {
     tethys::search_token_type search_token;
+
+    // Number of complete blocks of the keyword, when known by the client. The
+    // server then submits all the hash table probes at once. A wrong hint
+    // only costs extra probes.
+    std::experimental::optional<uint32_t> complete_blocks_hint;
 };
 
 template<size_t PAGE_SIZE>
@@ -21,6 +28,10 @@ struct SearchResponse
 {
     std::vector<index_type>            complete_lists;
     tethys::KeyedBucketPair<PAGE_SIZE> tethys_bucket_pair;
+
+    // Set by an asynchronous search when some of its reads could not be
+    // submitted: the response is then incomplete
+    bool failed{false};
 };
 
 struct PlutoKeySerializer
@@ -23,15 +23,20 @@
 
 #include <sse/schemes/sophos/sophos_common.hpp>
 #include <sse/schemes/utils/rocksdb_wrapper.hpp>
+#include <sse/schemes/utils/thread_pool.hpp>
 
 #include <sse/crypto/prf.hpp>
 #include <sse/crypto/tdp.hpp>
 
 #include <array>
+#include <chrono>
 #include <fstream>
 #include <functional>
+#include <list>
 #include <mutex>
 #include <string>
+#include <utility>
+#include <vector>
 
 namespace sse {
 namespace sophos {
@@ -60,6 +65,10 @@ public:
 
     size_t keyword_count() const;
 
+    // Keep the keyword counters in memory (see RocksDBCounter::enable_cache)
+    void enable_counter_cache(std::chrono::milliseconds checkpoint_period
+                              = std::chrono::milliseconds(1000));
+
     std::string private_key() const;
     std::string public_key() const;
 
@@ -69,6 +78,15 @@ public:
     UpdateRequest insertion_request(const std::string& keyword,
                                     const index_type   index);
 
+    // Generate the update requests of a list of insertions, in the same
+    // order. The insertions are grouped by keyword: the search token of the
+    // first insertion of a keyword is computed from the keyword's seed, and
+    // the next ones are obtained with a single inversion of the TDP each. The
+    // keywords are processed in parallel, using the given pool.
+    std::list<UpdateRequest> bulk_insertion_request(
+        const std::list<std::pair<std::string, index_type>>& update_list,
+        ThreadPool& pool = ThreadPool::global_thread_pool());
+
     const crypto::Prf<kDerivationKeySize>& derivation_prf() const;
     const sse::crypto::TdpInverse&         inverse_tdp() const;
 
@@ -85,8 +103,21 @@ private:
 
     static std::string get_keyword_index(const std::string& kw);
 
+    // Atomically increase the counter of keyword by count, and return the
+    // counter of the first reserved insertion
+    uint32_t reserve_counters(const std::string& keyword, uint32_t count);
+
+    // Generate the update requests of the insertions of indices for the
+    // keyword. The callback takes the request and the position of its index.
+    void keyword_insertion_requests(
+        const std::string&                                  keyword,
+        const std::vector<index_type>&                      indices,
+        const std::function<void(UpdateRequest&&, size_t)>& callback);
+
     crypto::Prf<crypto::Tdp::kRSAPrfSize> rsa_prg_;
 
+    // the counters are incremented with merge operands: the mutex is only
+    // needed if they are not atomic
     sophos::RocksDBCounter counter_map_;
     std::mutex             token_map_mtx_;
 };
@@ -22,6 +22,8 @@
 #pragma once
 
 #include <sse/schemes/sophos/sophos_common.hpp>
+#include <sse/schemes/sophos/tdp_checkpoint_cache.hpp>
+#include <sse/schemes/utils/range_executor.hpp>
 #include <sse/schemes/utils/rocksdb_wrapper.hpp>
 
 #include <sse/crypto/prf.hpp>
@@ -30,7 +32,9 @@
 #include <array>
 #include <fstream>
 #include <functional>
+#include <memory>
 #include <string>
+#include <vector>
 
 namespace sse {
 namespace sophos {
@@ -39,8 +43,18 @@ namespace sophos {
 class SophosServer
 {
 public:
+    // Number of search tokens buffered between the two stages of the parallel
+    // search
+    static constexpr size_t kPipelineQueueSize = 1024;
+
     SophosServer(const std::string& db_path, const std::string& tdp_pk);
 
+    // Parallel searches are run on the given executor, which can be shared
+    // between several servers. By default, the global executor is used.
+    SophosServer(const std::string&      db_path,
+                 const std::string&      tdp_pk,
+                 utility::RangeExecutor& executor);
+
     std::string public_key() const;
 
     std::list<index_type> search(SearchRequest& req);
@@ -52,6 +66,18 @@ public:
     std::list<index_type> search_parallel_light(SearchRequest& req,
                                                 uint8_t        thread_count);
 
+    // The following functions write the results in a vector, resized to
+    // req.add_count if needed. The i-th result is the one obtained from the
+    // i-th search token of the chain (i.e. from the most recent insertion to
+    // the oldest one).
+    void search(SearchRequest& req, std::vector<index_type>& results);
+    void search_parallel(SearchRequest&           req,
+                         uint8_t                  access_threads,
+                         std::vector<index_type>& results);
+    void search_parallel_light(SearchRequest&           req,
+                               uint8_t                  thread_count,
+                               std::vector<index_type>& results);
+
     void search_parallel_callback(SearchRequest&                  req,
                                   std::function<void(index_type)> post_callback,
                                   uint8_t rsa_thread_count,
@@ -64,10 +90,63 @@ public:
 
     void insert(const UpdateRequest& req);
 
+    // Insert all the requests with a single write batch
+    void insert(const std::vector<UpdateRequest>& reqs,
+                bool                              disable_wal = false);
+
+    // Make the previous insertions durable (see RockDBWrapper::sync)
+    void sync_edb(bool wal_disabled);
+
+    // Opt-in cache of the search tokens computed by the parallel searches
+    // (search_parallel), kept every interval tokens of a chain. The next
+    // parallel searches on the same keyword restart the computation of the
+    // chain from these checkpoints. These functions must not be called
+    // concurrently with a search.
+    void enable_checkpoint_cache(size_t interval, size_t max_checkpoints);
+    void disable_checkpoint_cache();
+
+    // Returns zeroed statistics if the cache is disabled
+    TdpCheckpointCache::Stats checkpoint_cache_stats() const;
+
 private:
+    // Callback taking the position of the search token in the chain, and the
+    // result as input
+    using indexed_callback_type = std::function<void(size_t, index_type)>;
+
+    // Element passed from the RSA stage to the access stage of the pipeline
+    struct PipelinedToken
+    {
+        search_token_type st;
+        size_t            index;
+    };
+
+    using checkpoint_type = TdpCheckpointCache::checkpoint_type;
+
+    // Part of a search token chain, computed by a single thread: the tokens
+    // of index first, first + step, ... up to end (excluded), starting from
+    // the token origin, of index origin_index
+    struct ChainSegment
+    {
+        search_token_type origin;
+        size_t            origin_index;
+        size_t            first;
+        size_t            end;
+        uint8_t           step;
+    };
+
+    // Two-stage parallel search: the RSA stage computes the search tokens,
+    // and the access stage derives the update tokens and looks them up
+    void pipelined_search(SearchRequest&               req,
+                          uint8_t                      access_threads,
+                          const indexed_callback_type& post_callback);
+
     RockDBWrapper edb_;
 
     sse::crypto::TdpMultPool public_tdp_;
+
+    utility::RangeExecutor& executor_;
+
+    std::unique_ptr<TdpCheckpointCache> checkpoint_cache_;
 };
 
 } // namespace sophos
@@ -0,0 +1,107 @@
+#pragma once
+
+#include <sse/schemes/sophos/sophos_common.hpp>
+
+#include <cstddef>
+#include <cstdint>
+
+#include <array>
+#include <list>
+#include <map>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+namespace sse {
+namespace sophos {
+
+// Size-bounded store of search tokens learned during previous searches.
+//
+// The search token chain of a keyword is deterministic: the token at a given
+// position (counted from the oldest insertion) never changes when new entries
+// are added. Hence, the tokens computed by a search can be kept as
+// checkpoints, from which the next searches on the same keyword can restart
+// the derivation of the older part of the chain, in parallel.
+//
+// The checkpoints are indexed by the derivation key of the keyword. When the
+// cache is full, the checkpoints of the least recently searched keywords are
+// evicted. All the member functions are thread-safe.
+class TdpCheckpointCache
+{
+public:
+    using key_type = std::array<uint8_t, kDerivationKeySize>;
+    // Position of the token in the chain (0 being the token of the oldest
+    // insertion), and the token itself
+    using checkpoint_type = std::pair<size_t, search_token_type>;
+
+    struct Stats
+    {
+        size_t lookups{0};
+        size_t hits{0};
+        size_t checkpoints_count{0};
+        size_t evicted_keywords{0};
+
+        double hit_rate() const
+        {
+            return (lookups == 0) ? 0.
+                                  : static_cast<double>(hits)
+                                        / static_cast<double>(lookups);
+        }
+    };
+
+    // A checkpoint is kept every interval tokens of a chain, and the cache
+    // holds at most max_checkpoints tokens.
+    TdpCheckpointCache(size_t interval, size_t max_checkpoints);
+
+    size_t interval() const
+    {
+        return interval_;
+    }
+
+    size_t max_checkpoints() const
+    {
+        return max_checkpoints_;
+    }
+
+    // Returns true if a checkpoint must be kept at the given position
+    bool is_checkpoint_position(size_t position) const
+    {
+        return ((position + 1) % interval_) == 0;
+    }
+
+    // Get the checkpoints of the keyword whose position is less than
+    // chain_length, sorted by increasing position. A lookup is a hit when at
+    // least one checkpoint is returned.
+    std::vector<checkpoint_type> lookup(const key_type& key,
+                                        size_t          chain_length);
+
+    // Add checkpoints to those of the keyword, and evict the least recently
+    // used keywords if the cache is full.
+    void insert(const key_type& key, std::vector<checkpoint_type> checkpoints);
+
+    void clear();
+
+    Stats stats() const;
+
+private:
+    struct Entry
+    {
+        std::map<size_t, search_token_type> checkpoints;
+        std::list<key_type>::iterator       lru_it;
+    };
+
+    // must be called with mtx_ held
+    void touch(Entry& entry);
+    void evict();
+
+    const size_t interval_;
+    const size_t max_checkpoints_;
+
+    mutable std::mutex        mtx_;
+    std::map<key_type, Entry> entries_;
+    std::list<key_type>       lru_list_; // most recently used first
+    Stats                     stats_;
+};
+
+} // namespace sophos
+} // namespace sse
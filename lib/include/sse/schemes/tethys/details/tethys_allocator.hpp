@@ -43,7 +43,9 @@ public:
 
     void insert(TethysAllocatorKey key, size_t list_length, size_t index);
 
-    void allocate();
+    // With parallel set, the max flow of every connected component of the
+    // allocation graph is computed independently, on the global thread pool
+    void allocate(MaxFlowAlgorithm algorithm = Dinic, bool parallel = true);
 
 
     static constexpr size_t kEmptyIndexValue = ~0UL;
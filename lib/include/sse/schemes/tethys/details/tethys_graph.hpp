@@ -7,6 +7,7 @@
 #include <cstdint>
 #include <sys/types.h>
 
+#include <iterator>
 #include <stdexcept>
 #include <vector>
 
@@ -126,6 +127,11 @@ public:
         return EdgePtr(edges.size() - 1);
     }
 
+    size_t size() const
+    {
+        return edges.size();
+    }
+
     Edge& operator[](EdgePtr ptr)
     {
         return edges[ptr.index];
@@ -185,17 +191,121 @@ private:
     std::vector<Edge> edges;
 };
 
+// The edges adjacent to a vertex are not stored in the vertex itself, but in
+// the graph's compressed adjacency (see TethysGraph::in_edges and
+// TethysGraph::out_edges).
 struct Vertex
 {
-    std::vector<EdgePtr> in_edges;
-    std::vector<EdgePtr> out_edges;
-    mutable EdgePtr      parent_edge;
-    size_t               component{0};
+    mutable EdgePtr parent_edge;
+    size_t          component{0};
+};
+
+// Compressed sparse row representation of the adjacency of a graph. For the
+// vertex of dense index i, the indices of its outgoing edges are
+// edge_indices[offsets[2i]..offsets[2i+1]) and the ones of its incoming
+// edges edge_indices[offsets[2i+1]..offsets[2i+2]), both in insertion order.
+template<class Index>
+struct CompressedAdjacency
+{
+    std::vector<Index> offsets;
+    std::vector<Index> edge_indices;
+
+    void clear()
+    {
+        // release the memory
+        std::vector<Index>().swap(offsets);
+        std::vector<Index>().swap(edge_indices);
+    }
+};
+
+// Non-owning range of edge pointers, read from a compressed adjacency. The
+// edges from position reciprocal_start on are returned as reciprocal edges.
+class EdgePtrRange
+{
+public:
+    class const_iterator
+    {
+    public:
+        using iterator_category = std::forward_iterator_tag;
+        using value_type        = EdgePtr;
+        using difference_type   = ptrdiff_t;
+        using pointer           = const EdgePtr*;
+        using reference         = EdgePtr;
+
+        const_iterator(const EdgePtrRange* range, size_t pos)
+            : range(range), pos(pos)
+        {
+        }
+
+        EdgePtr operator*() const
+        {
+            return (*range)[pos];
+        }
+
+        const_iterator& operator++()
+        {
+            pos++;
+            return *this;
+        }
+
+        bool operator==(const const_iterator& it) const
+        {
+            return pos == it.pos;
+        }
+
+        bool operator!=(const const_iterator& it) const
+        {
+            return pos != it.pos;
+        }
+
+    private:
+        const EdgePtrRange* range;
+        size_t              pos;
+    };
+
+    EdgePtrRange(const uint32_t* narrow_indices,
+                 const uint64_t* wide_indices,
+                 size_t          count,
+                 size_t          reciprocal_start)
+        : narrow_indices(narrow_indices), wide_indices(wide_indices),
+          count(count), reciprocal_start(reciprocal_start)
+    {
+    }
+
+    size_t size() const
+    {
+        return count;
+    }
+
+    bool empty() const
+    {
+        return count == 0;
+    }
+
+    EdgePtr operator[](size_t i) const
+    {
+        const size_t index
+            = (narrow_indices != nullptr) ? narrow_indices[i] : wide_indices[i];
+        return EdgePtr(i >= reciprocal_start, index);
+    }
+
+    const_iterator begin() const
+    {
+        return const_iterator(this, 0);
+    }
 
-    bool operator==(const Vertex& v) const
+    const_iterator end() const
     {
-        return (in_edges == v.in_edges) && (out_edges == v.out_edges);
+        return const_iterator(this, count);
     }
+
+private:
+    // exactly one of these is non null
+    const uint32_t* narrow_indices;
+    const uint64_t* wide_indices;
+
+    size_t count;
+    size_t reciprocal_start;
 };
 
 class VertexVec
@@ -230,11 +340,6 @@ public:
         return vertices[ptr.index];
     }
 
-    bool operator==(const VertexVec& vv) const
-    {
-        return (vertices == vv.vertices);
-    }
-
     iterator begin()
     {
         return vertices.begin();
@@ -269,6 +374,15 @@ enum EdgeOrientation : uint8_t
     ForcedRight = 1
 };
 
+enum MaxFlowAlgorithm : uint8_t
+{
+    // One augmenting path, found by a DFS, per iteration
+    FordFulkerson = 0,
+    // Blocking flows on BFS level graphs: O(V^2 E), with far fewer graph
+    // traversals than FordFulkerson on large graphs
+    Dinic = 1
+};
+
 class TethysGraph
 {
 public:
@@ -279,6 +393,8 @@ public:
         MaxFlowComputed
     };
 
+    static constexpr size_t kMaxFlowBatchVerticesCount = 4096;
+
     explicit TethysGraph(size_t n) : graph_size(n), vertices(n)
     {
         if (n == 0) {
@@ -301,6 +417,21 @@ public:
     std::vector<EdgePtr> find_source_sink_path(const size_t component,
                                                size_t*      path_flow) const;
 
+    // The adjacency is compressed once all the edges have been added: it is
+    // rebuilt by the first query following the insertion of an edge, so
+    // queries and insertions should not be interleaved. Edges must not be
+    // added while the graph is being read concurrently.
+    EdgePtrRange out_edges(VertexPtr ptr) const;
+    EdgePtrRange in_edges(VertexPtr ptr) const;
+
+    // Builds the compressed adjacency if an edge was added since the last
+    // call. Call it before querying the adjacency from several threads.
+    void compress_adjacency() const;
+
+    // The edges of the residual graph leaving a vertex: its outgoing edges
+    // followed by the reciprocals of its incoming edges
+    EdgePtrRange residual_edges(VertexPtr ptr) const;
+
     const Vertex& get_vertex(VertexPtr ptr) const;
     Vertex&       get_vertex(VertexPtr ptr);
 
@@ -314,18 +445,27 @@ public:
     }
 
 
+    // the adjacency is entirely determined by the edges
     bool operator==(const TethysGraph& g) const
     {
-        return (graph_size == g.graph_size) && (source == g.source)
-               && (sink == g.sink) && (vertices == g.vertices)
-               && (edges == g.edges);
+        return (graph_size == g.graph_size) && (edges == g.edges);
     }
 
-    void compute_connected_components();
+    // Labels the vertices with the index of their connected component
+    // (ignoring the source and the sink), using a parallel union-find. The
+    // components are numbered from 1, and the isolated vertices are put in
+    // component 0.
+    void compute_connected_components(ThreadPool& thread_pool
+                                      = ThreadPool::global_thread_pool());
 
-    void compute_residual_maxflow();
-    void parallel_compute_residual_maxflow(ThreadPool& thread_pool
-                                           = ThreadPool::global_thread_pool());
+    void compute_residual_maxflow(MaxFlowAlgorithm algorithm = FordFulkerson);
+
+    // Computes the max flow of every connected component independently. The
+    // components are processed largest first, and the small ones are
+    // grouped in batches of at least kMaxFlowBatchVerticesCount vertices.
+    void parallel_compute_residual_maxflow(
+        ThreadPool&      thread_pool = ThreadPool::global_thread_pool(),
+        MaxFlowAlgorithm algorithm   = FordFulkerson);
     void transform_residual_to_flow();
 
 
@@ -353,6 +493,69 @@ public:
 private:
     void reset_parent_edges() const;
 
+    // Range over the slots [first_slot, last_slot) of the offsets
+    EdgePtrRange adjacency_range(size_t first_slot,
+                                 size_t last_slot,
+                                 size_t reciprocal_slot) const;
+
+    void ford_fulkerson_residual_maxflow();
+    void dinic_residual_maxflow();
+
+    // Buffers of a Dinic computation
+    struct DinicWorkspace
+    {
+        std::vector<EdgePtr>   source_edges;
+        std::vector<VertexPtr> queue;
+        std::vector<EdgePtr>   path;
+    };
+
+    // Computes the max flow restricted to the vertices in [first, last),
+    // which must be a union of connected components. Only the entries of
+    // levels and current_edges for these vertices are used.
+    size_t dinic_maxflow(const VertexPtr*     first,
+                         const VertexPtr*     last,
+                         std::vector<size_t>& levels,
+                         std::vector<size_t>& current_edges,
+                         DinicWorkspace&      workspace,
+                         size_t&              phases);
+
+    // Dense index of a vertex, including the source and the sink
+    size_t vertex_index(VertexPtr ptr) const
+    {
+        if (ptr == kSourcePtr) {
+            return graph_size;
+        }
+        if (ptr == kSinkPtr) {
+            return graph_size + 1;
+        }
+        return ptr.index;
+    }
+
+    // The extremities of an edge of the residual graph
+    VertexPtr residual_edge_start(EdgePtr e_ptr) const
+    {
+        const Edge& e = edges[e_ptr];
+        return e_ptr.is_reciprocal ? e.end : e.start;
+    }
+
+    VertexPtr residual_edge_end(EdgePtr e_ptr) const
+    {
+        const Edge& e = edges[e_ptr];
+        return e_ptr.is_reciprocal ? e.start : e.end;
+    }
+
+    bool   dinic_compute_levels(const VertexPtr*     first,
+                                const VertexPtr*     last,
+                                std::vector<size_t>& levels,
+                                DinicWorkspace&      workspace,
+                                size_t&              sink_level) const;
+    size_t dinic_blocking_flow(const VertexPtr*           first,
+                               const VertexPtr*           last,
+                               const std::vector<size_t>& levels,
+                               size_t                     sink_level,
+                               std::vector<size_t>&       current_edges,
+                               DinicWorkspace&            workspace);
+
     State state{Building};
 
     const size_t graph_size;
@@ -362,6 +565,12 @@ private:
     VertexVec vertices;
     EdgeVec   edges;
 
+    // Edge indices are stored on 32 bits when the graph is small enough
+    mutable bool                          adjacency_compressed{false};
+    mutable bool                          use_wide_adjacency{false};
+    mutable CompressedAdjacency<uint32_t> narrow_adjacency;
+    mutable CompressedAdjacency<uint64_t> wide_adjacency;
+
     size_t n_components{0};
 };
 
@@ -149,47 +149,19 @@ public:
         const std::array<uint8_t, BLOCK_SIZE>& bucket_1,
         size_t                                 index_1)
     {
-        // start by decrypting the buckets
-        // std::array<uint8_t, BLOCK_SIZE> mask_0 = mask_prf.prf(
-        //     reinterpret_cast<uint8_t*>(&index_0), sizeof(size_t));
+        // decrypt the buckets in a single pass: libsodium's vectorized
+        // ChaCha20 generates the keystream and XORs it with the input
+        std::array<uint8_t, BLOCK_SIZE> plain_0;
+        std::array<uint8_t, BLOCK_SIZE> plain_1;
 
-        // std::array<uint8_t, BLOCK_SIZE> mask_1 = mask_prf.prf(
-        //     reinterpret_cast<uint8_t*>(&index_1), sizeof(size_t));
-
-
-        std::array<uint8_t, BLOCK_SIZE> mask_0;
-        std::array<uint8_t, BLOCK_SIZE> mask_1;
-        // NOLINTNEXTLINE(modernize-avoid-c-arrays)
-        uint8_t nonce[crypto_stream_chacha20_NONCEBYTES];
-
-        memset(nonce, 0x00, sizeof(nonce));
-        memcpy(nonce, reinterpret_cast<uint8_t*>(&index_0), sizeof(size_t));
-
-        crypto_stream_chacha20(
-            mask_0.data(), mask_0.size(), nonce, decryption_key.data());
-
-        memset(nonce, 0x00, sizeof(nonce));
-        memcpy(nonce, reinterpret_cast<uint8_t*>(&index_1), sizeof(size_t));
-
-        crypto_stream_chacha20(
-            mask_1.data(), mask_1.size(), nonce, decryption_key.data());
-
-
-        for (size_t i = 0; i < BLOCK_SIZE; i++) {
-            mask_0[i] ^= bucket_0[i]; // to avoid copies, we put the result in
-                                      // the keystream
-        }
-
-        for (size_t i = 0; i < BLOCK_SIZE; i++) {
-            mask_1[i] ^= bucket_1[i]; // to avoid copies, we put the result in
-                                      // the keystream
-        }
+        decrypt_bucket(bucket_0, index_0, plain_0);
+        decrypt_bucket(bucket_1, index_1, plain_1);
 
         auto res
-            = decoder.decode_buckets(key, mask_0, index_0, mask_1, index_1);
+            = decoder.decode_buckets(key, plain_0, index_0, plain_1, index_1);
 
-        sodium_memzero(mask_0.data(), mask_0.size());
-        sodium_memzero(mask_1.data(), mask_1.size());
+        sodium_memzero(plain_0.data(), plain_0.size());
+        sodium_memzero(plain_1.data(), plain_1.size());
 
         return res;
     }
@@ -219,6 +191,23 @@ public:
     }
 
 private:
+    void decrypt_bucket(const std::array<uint8_t, BLOCK_SIZE>& bucket,
+                        size_t                                 index,
+                        std::array<uint8_t, BLOCK_SIZE>&       out) const
+    {
+        // NOLINTNEXTLINE(modernize-avoid-c-arrays)
+        uint8_t nonce[crypto_stream_chacha20_NONCEBYTES];
+
+        memset(nonce, 0x00, sizeof(nonce));
+        memcpy(nonce, reinterpret_cast<uint8_t*>(&index), sizeof(size_t));
+
+        crypto_stream_chacha20_xor(out.data(),
+                                   bucket.data(),
+                                   BLOCK_SIZE,
+                                   nonce,
+                                   decryption_key.data());
+    }
+
     BaseDecoder decoder;
     key_type    decryption_key;
 
@@ -5,9 +5,11 @@
 #include <cassert>
 #include <cstring>
 
+#include <algorithm>
 #include <array>
 #include <istream>
 #include <ostream>
+#include <type_traits>
 
 namespace sse {
 namespace tethys {
@@ -255,6 +257,9 @@ struct EncodeSeparateEncoder
 template<class Key, class T, size_t PAGESIZE>
 struct EncodeSeparateDecoder
 {
+    static_assert(std::is_trivially_copyable<T>::value,
+                  "Decoded values are copied bytewise out of the buckets");
+
     using encoder_type = EncodeSeparateEncoder<Key, T, PAGESIZE>;
 
 
@@ -297,16 +302,16 @@ struct EncodeSeparateDecoder
             offset += sizeof(list_key);
 
             if (list_key == key) {
-                // match on the key
-                results.reserve(results.size() + list_length);
-
-                for (size_t i = 0; i < list_length; i++) {
-                    T value;
-                    memcpy(&value, bucket.data() + offset, sizeof(value));
-                    offset += sizeof(value);
-
-                    results.push_back(value);
-                }
+                // match on the key: the list entries are stored contiguously,
+                // copy them all at once (never reading past the bucket)
+                list_length = std::min<uint64_t>(
+                    list_length, (bucket.size() - offset) / sizeof(T));
+
+                const size_t results_size = results.size();
+                results.resize(results_size + list_length);
+                memcpy(results.data() + results_size,
+                       bucket.data() + offset,
+                       list_length * sizeof(T));
 
                 break;
             }
@@ -9,6 +9,7 @@
 #include <sse/crypto/prf.hpp>
 
 #include <array>
+#include <chrono>
 
 
 namespace sse {
@@ -56,15 +57,29 @@ public:
     SearchRequest search_request(const std::string& keyword,
                                  bool               log_not_found = true) const;
 
+    // Keep the keyword counters in memory (see RocksDBCounter::enable_cache)
+    void enable_counter_cache(std::chrono::milliseconds checkpoint_period
+                              = std::chrono::milliseconds(1000))
+    {
+        counter_db.enable_cache(checkpoint_period);
+    }
+
     std::vector<index_type> decode_search_results(
-        const SearchRequest&                req,
-        std::vector<keyed_bucket_pair_type> bucket_pairs);
+        const SearchRequest&                       req,
+        const std::vector<keyed_bucket_pair_type>& bucket_pairs);
 
     static std::vector<index_type> decode_search_results(
-        const SearchRequest&                req,
-        std::vector<keyed_bucket_pair_type> bucket_pairs,
-        const stash_type&                   stash,
-        decrypt_decoder_type&               decrypt_decoder);
+        const SearchRequest&                       req,
+        const std::vector<keyed_bucket_pair_type>& bucket_pairs,
+        const stash_type&                          stash,
+        decrypt_decoder_type&                      decrypt_decoder);
+
+    // Appends the entries decoded from a single bucket pair, and the
+    // matching stash entries, to results
+    static void decode_bucket_pair(const keyed_bucket_pair_type& key_bucket,
+                                   const stash_type&             stash,
+                                   decrypt_decoder_type&    decrypt_decoder,
+                                   std::vector<index_type>& results);
 
 private:
     template<class StashDecoder>
@@ -140,8 +155,8 @@ SearchRequest TethysClient<ValueDecoder>::search_request(
 
 template<class ValueDecoder>
 std::vector<index_type> TethysClient<ValueDecoder>::decode_search_results(
-    const SearchRequest&                req,
-    std::vector<keyed_bucket_pair_type> keyed_bucket_pairs)
+    const SearchRequest&                       req,
+    const std::vector<keyed_bucket_pair_type>& keyed_bucket_pairs)
 {
     return TethysClient<ValueDecoder>::decode_search_results(
         req, keyed_bucket_pairs, stash, decrypt_decoder);
@@ -149,36 +164,46 @@ std::vector<index_type> TethysClient<ValueDecoder>::decode_search_results(
 
 template<class ValueDecoder>
 std::vector<index_type> TethysClient<ValueDecoder>::decode_search_results(
-    const SearchRequest&                req,
-    std::vector<keyed_bucket_pair_type> keyed_bucket_pairs,
-    const stash_type&                   stash,
-    decrypt_decoder_type&               decrypt_decoder)
+    const SearchRequest&                       req,
+    const std::vector<keyed_bucket_pair_type>& keyed_bucket_pairs,
+    const stash_type&                          stash,
+    decrypt_decoder_type&                      decrypt_decoder)
 {
     (void)req;
     std::vector<index_type> results;
 
     for (const keyed_bucket_pair_type& key_bucket : keyed_bucket_pairs) {
-        std::vector<index_type> bucket_res
-            = decrypt_decoder.decode_buckets(key_bucket.key,
-                                             key_bucket.buckets.payload_0,
-                                             key_bucket.buckets.index_0,
-                                             key_bucket.buckets.payload_1,
-                                             key_bucket.buckets.index_1);
+        decode_bucket_pair(key_bucket, stash, decrypt_decoder, results);
+    }
 
-        results.reserve(results.size() + bucket_res.size());
-        results.insert(results.end(), bucket_res.begin(), bucket_res.end());
+    return results;
+}
 
+template<class ValueDecoder>
+void TethysClient<ValueDecoder>::decode_bucket_pair(
+    const keyed_bucket_pair_type& key_bucket,
+    const stash_type&             stash,
+    decrypt_decoder_type&         decrypt_decoder,
+    std::vector<index_type>&      results)
+{
+    std::vector<index_type> bucket_res
+        = decrypt_decoder.decode_buckets(key_bucket.key,
+                                         key_bucket.buckets.payload_0,
+                                         key_bucket.buckets.index_0,
+                                         key_bucket.buckets.payload_1,
+                                         key_bucket.buckets.index_1);
 
-        auto stash_it = stash.find(key_bucket.key);
+    results.reserve(results.size() + bucket_res.size());
+    results.insert(results.end(), bucket_res.begin(), bucket_res.end());
 
-        if (stash_it != stash.end()) {
-            const std::vector<index_type>& stash_res = stash_it->second;
-            results.reserve(results.size() + stash_res.size());
-            results.insert(results.end(), stash_res.begin(), stash_res.end());
-        }
-    }
 
-    return results;
+    auto stash_it = stash.find(key_bucket.key);
+
+    if (stash_it != stash.end()) {
+        const std::vector<index_type>& stash_res = stash_it->second;
+        results.reserve(results.size() + stash_res.size());
+        results.insert(results.end(), stash_res.begin(), stash_res.end());
+    }
 }
 
 } // namespace tethys
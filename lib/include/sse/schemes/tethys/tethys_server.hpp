@@ -10,6 +10,8 @@
 #include <sse/crypto/prf.hpp>
 
 #include <array>
+#include <functional>
+#include <vector>
 
 
 namespace sse {
@@ -29,12 +31,19 @@ class TethysServer
 public:
     static constexpr size_t kServerBucketSize = Store::kPayloadSize;
     using keyed_bucket_pair_type = KeyedBucketPair<kServerBucketSize>;
+    using search_callback_type
+        = std::function<void(std::vector<keyed_bucket_pair_type>)>;
 
     explicit TethysServer(const std::string& store_path);
 
     std::vector<keyed_bucket_pair_type> search(
         const SearchRequest& search_request);
 
+    // Submit the reads of all the blocks at once. The callback is called from
+    // the IO completion thread.
+    void async_search(const SearchRequest& search_request,
+                      search_callback_type callback);
+
 private:
     Store tethys_store;
 };
@@ -51,23 +60,52 @@ std::vector<typename TethysServer<Store>::keyed_bucket_pair_type> TethysServer<
 // auto TethysServer<Store>::search(const search_token_type& search_token)
 // -> std::vector<keyed_bucket_pair_type>
 {
-    std::vector<keyed_bucket_pair_type> bucket_pairs;
+    std::vector<keyed_bucket_pair_type> bucket_pairs(
+        search_request.block_count);
 
     for (uint32_t i = 0; i < search_request.block_count; i++) {
         // derive the key from the search token in counter mode
-        tethys_core_key_type key
+        bucket_pairs[i].key
             = details::derive_core_key(search_request.search_token, i);
 
+        // read the buckets directly in the response
+        tethys_store.get_buckets(bucket_pairs[i].key, bucket_pairs[i].buckets);
+    }
+
 
-        BucketPair<kServerBucketSize> buckets = tethys_store.get_buckets(key);
+    return bucket_pairs;
+}
 
-        keyed_bucket_pair_type keyed_buckets{key, buckets};
+template<class Store>
+void TethysServer<Store>::async_search(const SearchRequest& search_request,
+                                       search_callback_type callback)
+{
+    std::vector<tethys_core_key_type> keys;
+    keys.reserve(search_request.block_count);
 
-        bucket_pairs.push_back(keyed_buckets);
+    for (uint32_t i = 0; i < search_request.block_count; i++) {
+        keys.push_back(
+            details::derive_core_key(search_request.search_token, i));
     }
 
+    using views_type = std::vector<BucketPairView<kServerBucketSize>>;
 
-    return bucket_pairs;
+    auto buckets_cb = [keys, callback](const views_type& views) {
+        // the only copy of the buckets, from the read buffers to the response
+        std::vector<keyed_bucket_pair_type> res(views.size());
+
+        for (size_t i = 0; i < views.size(); i++) {
+            res[i].key               = keys[i];
+            res[i].buckets.index_0   = views[i].index_0;
+            res[i].buckets.index_1   = views[i].index_1;
+            res[i].buckets.payload_0 = *views[i].payload_0;
+            res[i].buckets.payload_1 = *views[i].payload_1;
+        }
+
+        callback(std::move(res));
+    };
+
+    tethys_store.async_get_bucket_views(keys, buckets_cb);
 }
 
 
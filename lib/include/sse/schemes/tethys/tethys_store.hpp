@@ -7,9 +7,11 @@
 
 #include <cstdint>
 
+#include <algorithm>
 #include <array>
 #include <fstream>
 #include <map>
+#include <memory>
 #include <string>
 #include <vector>
 
@@ -31,18 +33,30 @@ class TethysStore
 public:
     static constexpr size_t kPayloadSize = PAGE_SIZE;
     using payload_type                   = std::array<uint8_t, kPayloadSize>;
+    using bucket_ptr                     = abstractio::pooled_ptr<payload_type>;
+
+    using bucket_cache_type = abstractio::PageCache<payload_type>;
 
     using key_type     = Key;
     using value_type   = T;
     using decoder_type = ValueDecoder;
 
     using get_buckets_callback_type
-        = std::function<void(std::unique_ptr<payload_type>, size_t)>;
+        = std::function<void(bucket_ptr, size_t)>;
 
     using get_list_callback_type = std::function<void(std::vector<T>)>;
+    using get_lists_callback_type
+        = std::function<void(std::vector<std::vector<T>>)>;
+    using get_bucket_views_callback_type
+        = std::function<void(const std::vector<BucketPairView<PAGE_SIZE>>&)>;
 
     TethysStore(const std::string& table_path, const std::string& stash_path);
 
+    // Read the table through the given IO scheduler
+    TethysStore(const std::string&                       table_path,
+                const std::string&                       stash_path,
+                std::unique_ptr<abstractio::Scheduler>&& scheduler);
+
     // we have to specificy templated constructors inside the class definition
     // (they do not have a name that can be 'templated')
 
@@ -66,6 +80,21 @@ public:
 
     void use_direct_IO(bool flag);
 
+    // Cache the buckets read from the table, within a memory budget (in
+    // bytes). A zero budget disables the cache.
+    void use_bucket_cache(
+        size_t byte_budget,
+        size_t n_shards = bucket_cache_type::kDefaultShardsCount);
+
+    const std::shared_ptr<bucket_cache_type>& bucket_cache() const noexcept
+    {
+        return table.cache();
+    }
+
+    // Serve all the reads from a memory mapping of the table (see
+    // awonvm_vector::map_memory)
+    void use_memory_map(bool populate = false, bool huge_pages = false);
+
     static std::vector<T> decode_list(const Key&          key,
                                       ValueDecoder&       decoder,
                                       const payload_type& bucket_0,
@@ -79,6 +108,8 @@ public:
                                       size_t              bucket_1_index);
 
     BucketPair<PAGE_SIZE> get_buckets(const Key& key);
+    // Read the buckets directly in bucket_pair
+    void get_buckets(const Key& key, BucketPair<PAGE_SIZE>& bucket_pair);
 
     std::vector<T> get_list(const Key& key, ValueDecoder& decoder);
 
@@ -91,7 +122,44 @@ public:
                         get_list_callback_type callback);
     void async_get_list(const Key& key, get_list_callback_type callback);
 
+    // Batched version of async_get_list: the buckets of all the keys are read
+    // with a single call to async_gets (each distinct bucket being read only
+    // once), and the callback is called once all the lists are decoded. The
+    // i-th list passed to the callback is the one of keys[i].
+    void async_get_lists(const std::vector<Key>& keys,
+                         ValueDecoder&           decoder,
+                         get_lists_callback_type callback);
+    void async_get_lists(const std::vector<Key>& keys,
+                         get_lists_callback_type callback);
+
+    // Same as async_get_lists, but without decoding the buckets. The views
+    // point to the read buffers, and are only valid during the callback.
+    void async_get_bucket_views(const std::vector<Key>&        keys,
+                                get_bucket_views_callback_type callback);
+
 private:
+    // State shared by the reads of a batch of keys
+    struct BucketBatch
+    {
+        std::vector<Key>                   keys;
+        std::vector<std::array<size_t, 2>> bucket_slots; // slots of each key
+        std::vector<size_t>                bucket_indices; // one per slot
+        std::vector<bucket_ptr>            buckets;        // one per slot
+        std::atomic<size_t>                completion_counter{0};
+        std::atomic<bool>                  failed{false};
+    };
+
+    using batch_callback_type = std::function<void(BucketBatch&)>;
+
+    std::array<size_t, 2> bucket_indices(const Key& key) const;
+
+    std::vector<T> stash_list(const Key& key) const;
+
+    // Read the buckets of the keys, and call callback from the IO completion
+    // thread once they have all been read.
+    void async_get_bucket_batch(const std::vector<Key>& keys,
+                                batch_callback_type     callback);
+
     void load_stash(const std::string& stash_path, EmptyDecoder& stash_decoder)
     {
         (void)stash_path;
@@ -137,6 +205,27 @@ TethysStore<PAGE_SIZE, Key, T, TethysHasher, ValueDecoder>::TethysStore(
     std::cerr << "Stash size: " << stash.size() << "\n";
 }
 
+template<size_t PAGE_SIZE,
+         class Key,
+         class T,
+         class TethysHasher,
+         class ValueDecoder>
+TethysStore<PAGE_SIZE, Key, T, TethysHasher, ValueDecoder>::TethysStore(
+    const std::string&                       table_path,
+    const std::string&                       stash_path,
+    std::unique_ptr<abstractio::Scheduler>&& scheduler)
+    : table(table_path, std::move(scheduler), false)
+{
+    if (!table.is_committed()) {
+        throw std::runtime_error("Table not committed");
+    }
+    table_size = table.size();
+
+    ValueDecoder stash_decoder;
+
+    load_stash(stash_path, stash_decoder);
+}
+
 template<size_t PAGE_SIZE,
          class Key,
          class T,
@@ -183,6 +272,33 @@ void TethysStore<PAGE_SIZE, Key, T, TethysHasher, ValueDecoder>::use_direct_IO(
     table.set_use_direct_access(flag);
 }
 
+template<size_t PAGE_SIZE,
+         class Key,
+         class T,
+         class TethysHasher,
+         class ValueDecoder>
+void TethysStore<PAGE_SIZE, Key, T, TethysHasher, ValueDecoder>::
+    use_bucket_cache(size_t byte_budget, size_t n_shards)
+{
+    if (byte_budget == 0) {
+        table.set_cache(nullptr);
+    } else {
+        table.set_cache(
+            std::make_shared<bucket_cache_type>(byte_budget, n_shards));
+    }
+}
+
+template<size_t PAGE_SIZE,
+         class Key,
+         class T,
+         class TethysHasher,
+         class ValueDecoder>
+void TethysStore<PAGE_SIZE, Key, T, TethysHasher, ValueDecoder>::
+    use_memory_map(bool populate, bool huge_pages)
+{
+    table.map_memory(populate, huge_pages);
+}
+
 template<size_t PAGE_SIZE,
          class Key,
          class T,
@@ -223,29 +339,84 @@ template<size_t PAGE_SIZE,
          class T,
          class TethysHasher,
          class ValueDecoder>
-BucketPair<PAGE_SIZE> TethysStore<PAGE_SIZE,
+std::array<size_t, 2> TethysStore<PAGE_SIZE,
                                   Key,
                                   T,
                                   TethysHasher,
-                                  ValueDecoder>::get_buckets(const Key& key)
+                                  ValueDecoder>::bucket_indices(const Key& key)
+    const
 {
     details::TethysAllocatorKey tethys_key = TethysHasher()(key);
 
-    BucketPair<PAGE_SIZE> bucket_pair;
-
     size_t half_graph_size       = table_size / 2;
     size_t remaining_graphs_size = table_size - half_graph_size;
 
-    bucket_pair.index_0 = tethys_key.h[0] % half_graph_size;
-    bucket_pair.index_1
-        = half_graph_size + tethys_key.h[1] % remaining_graphs_size;
+    return {{tethys_key.h[0] % half_graph_size,
+             half_graph_size + tethys_key.h[1] % remaining_graphs_size}};
+}
+
+template<size_t PAGE_SIZE,
+         class Key,
+         class T,
+         class TethysHasher,
+         class ValueDecoder>
+std::vector<T> TethysStore<PAGE_SIZE, Key, T, TethysHasher, ValueDecoder>::
+    stash_list(const Key& key) const
+{
+    auto stash_it = stash.find(key);
+
+    if (stash_it != stash.end()) {
+        return stash_it->second;
+    }
+    return {};
+}
 
-    bucket_pair.payload_0 = table.get(bucket_pair.index_0);
-    bucket_pair.payload_1 = table.get(bucket_pair.index_1);
+template<size_t PAGE_SIZE,
+         class Key,
+         class T,
+         class TethysHasher,
+         class ValueDecoder>
+BucketPair<PAGE_SIZE> TethysStore<PAGE_SIZE,
+                                  Key,
+                                  T,
+                                  TethysHasher,
+                                  ValueDecoder>::get_buckets(const Key& key)
+{
+    BucketPair<PAGE_SIZE> bucket_pair;
+
+    get_buckets(key, bucket_pair);
 
     return bucket_pair;
 }
 
+template<size_t PAGE_SIZE,
+         class Key,
+         class T,
+         class TethysHasher,
+         class ValueDecoder>
+void TethysStore<PAGE_SIZE, Key, T, TethysHasher, ValueDecoder>::get_buckets(
+    const Key&             key,
+    BucketPair<PAGE_SIZE>& bucket_pair)
+{
+    std::array<size_t, 2> indices = bucket_indices(key);
+
+    bucket_pair.index_0 = indices[0];
+    bucket_pair.index_1 = indices[1];
+
+    // the views only differ from the pair's payloads when the table is
+    // memory mapped
+    const payload_type& payload_0
+        = table.view(indices[0], bucket_pair.payload_0);
+    if (&payload_0 != &bucket_pair.payload_0) {
+        bucket_pair.payload_0 = payload_0;
+    }
+    const payload_type& payload_1
+        = table.view(indices[1], bucket_pair.payload_1);
+    if (&payload_1 != &bucket_pair.payload_1) {
+        bucket_pair.payload_1 = payload_1;
+    }
+}
+
 template<size_t PAGE_SIZE,
          class Key,
          class T,
@@ -254,21 +425,18 @@ template<size_t PAGE_SIZE,
 std::vector<T> TethysStore<PAGE_SIZE, Key, T, TethysHasher, ValueDecoder>::
     get_list(const Key& key, ValueDecoder& decoder)
 {
-    std::vector<T> stash_res;
+    std::vector<T> stash_res = stash_list(key);
 
-    auto stash_it = stash.find(key);
+    std::array<size_t, 2> indices = bucket_indices(key);
 
-    if (stash_it != stash.end()) {
-        stash_res = stash_it->second;
-    }
+    // decode the buckets in place when the table is memory mapped
+    alignas(PAGE_SIZE) payload_type buffer_0;
+    alignas(PAGE_SIZE) payload_type buffer_1;
+    const payload_type& bucket_0 = table.view(indices[0], buffer_0);
+    const payload_type& bucket_1 = table.view(indices[1], buffer_1);
 
-    BucketPair<PAGE_SIZE> buckets    = get_buckets(key);
-    std::vector<T>        bucket_res = decode_list(key,
-                                            decoder,
-                                            buckets.payload_0,
-                                            buckets.index_0,
-                                            buckets.payload_1,
-                                            buckets.index_1);
+    std::vector<T> bucket_res = decode_list(
+        key, decoder, bucket_0, indices[0], bucket_1, indices[1]);
 
     bucket_res.reserve(bucket_res.size() + stash_res.size());
     bucket_res.insert(bucket_res.end(), stash_res.begin(), stash_res.end());
@@ -297,30 +465,29 @@ template<size_t PAGE_SIZE,
 void TethysStore<PAGE_SIZE, Key, T, TethysHasher, ValueDecoder>::
     async_get_buckets(const Key& key, get_buckets_callback_type callback)
 {
-    details::TethysAllocatorKey tethys_key = TethysHasher()(key);
-
-    size_t half_graph_size       = table_size / 2;
-    size_t remaining_graphs_size = table_size - half_graph_size;
+    std::array<size_t, 2> indices = bucket_indices(key);
 
-    size_t bucket_0_index = tethys_key.h[0] % half_graph_size;
-    size_t bucket_1_index
-        = half_graph_size + tethys_key.h[1] % remaining_graphs_size;
+    size_t bucket_0_index = indices[0];
+    size_t bucket_1_index = indices[1];
 
 
     auto bucket_0_cb
-        = [bucket_0_index, callback](std::unique_ptr<payload_type> bucket) {
+        = [bucket_0_index, callback](bucket_ptr bucket) {
               callback(std::move(bucket), bucket_0_index);
           };
 
     auto bucket_1_cb
-        = [bucket_1_index, callback](std::unique_ptr<payload_type> bucket) {
+        = [bucket_1_index, callback](bucket_ptr bucket) {
               callback(std::move(bucket), bucket_1_index);
           };
 
 
     using GetRequest = typename table_type::GetRequest;
-    table.async_gets({GetRequest(bucket_0_index, bucket_0_cb),
-                      GetRequest(bucket_1_index, bucket_1_cb)});
+    if (table.async_gets({GetRequest(bucket_0_index, bucket_0_cb),
+                          GetRequest(bucket_1_index, bucket_1_cb)})
+        != 2) {
+        throw std::runtime_error("Unable to submit the bucket reads");
+    }
 }
 
 template<size_t PAGE_SIZE,
@@ -332,8 +499,7 @@ template<class CallbackState>
 void TethysStore<PAGE_SIZE, Key, T, TethysHasher, ValueDecoder>::
     async_get_list_helper(get_list_callback_type callback, CallbackState* state)
 {
-    auto bucket_cb = [this, callback, state](
-                         std::unique_ptr<payload_type> bucket, size_t index) {
+    auto bucket_cb = [this, callback, state](bucket_ptr bucket, size_t index) {
         uint8_t completed = state->completion_counter.fetch_add(1) + 1;
 
         if (completed == 1) {
@@ -344,13 +510,7 @@ void TethysStore<PAGE_SIZE, Key, T, TethysHasher, ValueDecoder>::
             state->bucket_1 = std::move(bucket);
 
 
-            std::vector<T> stash_res;
-
-            auto stash_it = stash.find(state->key);
-
-            if (stash_it != stash.end()) {
-                stash_res = stash_it->second;
-            }
+            std::vector<T> stash_res = stash_list(state->key);
 
             std::vector<T> bucket_res = this->decode_list(state->key,
                                                           state->get_decoder(),
@@ -383,13 +543,13 @@ void TethysStore<PAGE_SIZE, Key, T, TethysHasher, ValueDecoder>::async_get_list(
 {
     struct CallBackState
     {
-        Key                           key;
-        std::unique_ptr<payload_type> bucket_0;
-        std::unique_ptr<payload_type> bucket_1;
-        size_t                        index_0{SIZE_MAX};
-        size_t                        index_1{SIZE_MAX};
-        std::atomic<uint8_t>          completion_counter{0};
-        ValueDecoder                  decoder;
+        Key                  key;
+        bucket_ptr           bucket_0;
+        bucket_ptr           bucket_1;
+        size_t               index_0{SIZE_MAX};
+        size_t               index_1{SIZE_MAX};
+        std::atomic<uint8_t> completion_counter{0};
+        ValueDecoder         decoder;
 
         explicit CallBackState(const Key& k) : key(k){};
 
@@ -416,13 +576,13 @@ void TethysStore<PAGE_SIZE, Key, T, TethysHasher, ValueDecoder>::async_get_list(
 {
     struct CallBackState
     {
-        Key                           key;
-        std::unique_ptr<payload_type> bucket_0;
-        std::unique_ptr<payload_type> bucket_1;
-        size_t                        index_0{SIZE_MAX};
-        size_t                        index_1{SIZE_MAX};
-        std::atomic<uint8_t>          completion_counter{0};
-        ValueDecoder*                 decoder;
+        Key                  key;
+        bucket_ptr           bucket_0;
+        bucket_ptr           bucket_1;
+        size_t               index_0{SIZE_MAX};
+        size_t               index_1{SIZE_MAX};
+        std::atomic<uint8_t> completion_counter{0};
+        ValueDecoder*        decoder;
 
         CallBackState(const Key& k, ValueDecoder& dec)
             : key(k), decoder(&dec){};
@@ -438,5 +598,187 @@ void TethysStore<PAGE_SIZE, Key, T, TethysHasher, ValueDecoder>::async_get_list(
     async_get_list_helper<CallBackState>(std::move(callback), state);
 }
 
+template<size_t PAGE_SIZE,
+         class Key,
+         class T,
+         class TethysHasher,
+         class ValueDecoder>
+void TethysStore<PAGE_SIZE, Key, T, TethysHasher, ValueDecoder>::
+    async_get_bucket_batch(const std::vector<Key>& keys,
+                           batch_callback_type     callback)
+{
+    BucketBatch* batch = new BucketBatch();
+    batch->keys        = keys;
+    batch->bucket_slots.resize(keys.size());
+
+    // the lists of a keyword can share buckets: only submit one read per
+    // distinct bucket
+    std::vector<std::array<size_t, 2>> key_indices;
+    key_indices.reserve(keys.size());
+    batch->bucket_indices.reserve(2 * keys.size());
+
+    for (const auto& key : keys) {
+        key_indices.push_back(bucket_indices(key));
+        batch->bucket_indices.push_back(key_indices.back()[0]);
+        batch->bucket_indices.push_back(key_indices.back()[1]);
+    }
+    std::sort(batch->bucket_indices.begin(), batch->bucket_indices.end());
+    batch->bucket_indices.erase(std::unique(batch->bucket_indices.begin(),
+                                            batch->bucket_indices.end()),
+                                batch->bucket_indices.end());
+
+    for (size_t i = 0; i < keys.size(); i++) {
+        for (size_t j = 0; j < 2; j++) {
+            batch->bucket_slots[i][j]
+                = std::lower_bound(batch->bucket_indices.begin(),
+                                   batch->bucket_indices.end(),
+                                   key_indices[i][j])
+                  - batch->bucket_indices.begin();
+        }
+    }
+
+    const size_t n_buckets = batch->bucket_indices.size();
+    batch->buckets.resize(n_buckets);
+
+    if (n_buckets == 0) {
+        callback(*batch);
+        delete batch;
+        return;
+    }
+
+    using GetRequest = typename table_type::GetRequest;
+    std::vector<GetRequest> requests;
+    requests.reserve(n_buckets);
+
+    for (size_t slot = 0; slot < n_buckets; slot++) {
+        auto bucket_cb = [batch, slot, callback](bucket_ptr bucket) {
+            // every callback fills its own slot, and the counter increment
+            // publishes it to the last one
+            batch->buckets[slot] = std::move(bucket);
+
+            size_t completed = batch->completion_counter.fetch_add(1) + 1;
+
+            if (completed == batch->buckets.size()) {
+                if (!batch->failed.load()) {
+                    callback(*batch);
+                }
+                delete batch;
+            }
+        };
+        requests.emplace_back(batch->bucket_indices[slot], bucket_cb);
+    }
+
+    size_t submitted = 0;
+    try {
+        submitted = table.async_gets(requests);
+    } catch (...) {
+        // none of the reads was submitted
+        delete batch;
+        throw;
+    }
+
+    if (submitted < n_buckets) {
+        // The callbacks of the last reads will never be called: count them as
+        // completed, so that the last in-flight read frees the batch (or do
+        // it here if they are all done).
+        batch->failed.store(true);
+        const size_t missing = n_buckets - submitted;
+        const size_t completed
+            = batch->completion_counter.fetch_add(missing) + missing;
+        if (completed == n_buckets) {
+            delete batch;
+        }
+        throw std::runtime_error("Unable to submit all the bucket reads");
+    }
+}
+
+template<size_t PAGE_SIZE,
+         class Key,
+         class T,
+         class TethysHasher,
+         class ValueDecoder>
+void TethysStore<PAGE_SIZE, Key, T, TethysHasher, ValueDecoder>::
+    async_get_lists(const std::vector<Key>& keys,
+                    ValueDecoder&           decoder,
+                    get_lists_callback_type callback)
+{
+    ValueDecoder* decoder_ptr = &decoder;
+
+    auto batch_cb = [this, decoder_ptr, callback](BucketBatch& batch) {
+        std::vector<std::vector<T>> lists;
+        lists.reserve(batch.keys.size());
+
+        for (size_t i = 0; i < batch.keys.size(); i++) {
+            const Key&   key    = batch.keys[i];
+            const size_t slot_0 = batch.bucket_slots[i][0];
+            const size_t slot_1 = batch.bucket_slots[i][1];
+
+            std::vector<T> list
+                = this->decode_list(key,
+                                    *decoder_ptr,
+                                    *(batch.buckets[slot_0]),
+                                    batch.bucket_indices[slot_0],
+                                    *(batch.buckets[slot_1]),
+                                    batch.bucket_indices[slot_1]);
+
+            std::vector<T> stash_res = stash_list(key);
+            list.reserve(list.size() + stash_res.size());
+            list.insert(list.end(), stash_res.begin(), stash_res.end());
+
+            lists.push_back(std::move(list));
+        }
+
+        callback(std::move(lists));
+    };
+
+    async_get_bucket_batch(keys, batch_cb);
+}
+
+template<size_t PAGE_SIZE,
+         class Key,
+         class T,
+         class TethysHasher,
+         class ValueDecoder>
+void TethysStore<PAGE_SIZE, Key, T, TethysHasher, ValueDecoder>::
+    async_get_lists(const std::vector<Key>& keys,
+                    get_lists_callback_type callback)
+{
+    // the decoder must outlive the reads
+    auto decoder = std::make_shared<ValueDecoder>();
+
+    async_get_lists(
+        keys, *decoder, [decoder, callback](std::vector<std::vector<T>> lists) {
+            callback(std::move(lists));
+        });
+}
+
+template<size_t PAGE_SIZE,
+         class Key,
+         class T,
+         class TethysHasher,
+         class ValueDecoder>
+void TethysStore<PAGE_SIZE, Key, T, TethysHasher, ValueDecoder>::
+    async_get_bucket_views(const std::vector<Key>&        keys,
+                           get_bucket_views_callback_type callback)
+{
+    auto batch_cb = [callback](BucketBatch& batch) {
+        std::vector<BucketPairView<PAGE_SIZE>> views(batch.keys.size());
+
+        for (size_t i = 0; i < batch.keys.size(); i++) {
+            const size_t slot_0 = batch.bucket_slots[i][0];
+            const size_t slot_1 = batch.bucket_slots[i][1];
+
+            views[i].index_0   = batch.bucket_indices[slot_0];
+            views[i].index_1   = batch.bucket_indices[slot_1];
+            views[i].payload_0 = batch.buckets[slot_0].get();
+            views[i].payload_1 = batch.buckets[slot_1].get();
+        }
+
+        callback(views);
+    };
+
+    async_get_bucket_batch(keys, batch_cb);
+}
+
 } // namespace tethys
-} // namespace sse
\ No newline at end of file
+} // namespace sse
@@ -1,14 +1,22 @@
 
 #pragma once
 
+#include <sse/schemes/abstractio/append_log.hpp>
 #include <sse/schemes/abstractio/awonvm_vector.hpp>
 #include <sse/schemes/abstractio/kv_serializer.hpp>
 #include <sse/schemes/tethys/core_types.hpp>
 #include <sse/schemes/tethys/details/tethys_allocator.hpp>
+#include <sse/schemes/utils/range_executor.hpp>
 
+#include <algorithm>
 #include <array>
+#include <condition_variable>
 #include <fstream>
+#include <limits>
+#include <memory>
+#include <mutex>
 #include <string>
+#include <type_traits>
 #include <vector>
 
 namespace sse {
@@ -19,9 +27,20 @@ struct TethysStoreBuilderParam
     std::string tethys_table_path;
     std::string tethys_stash_path;
 
+    // When set, the inserted lists are spilled to a scratch file at this path
+    // instead of being kept in memory until the store is built. The file is
+    // removed once the builder is destroyed.
+    std::string spill_path;
+
+    // Write the table with direct IOs, bypassing the page cache
+    bool direct_io{false};
+
     size_t max_n_elements;
     double epsilon;
 
+    details::MaxFlowAlgorithm maxflow_algorithm{details::Dinic};
+    bool                      parallel_maxflow{true};
+
     size_t graph_size(size_t bucket_size) const
     {
         return details::tethys_graph_size(max_n_elements, bucket_size, epsilon);
@@ -50,14 +69,30 @@ public:
     static constexpr size_t kMaxListSize
         = kBucketSize - value_encoder_type::kListControlValues;
 
+    // spilled lists are written and read back as raw bytes
+    static_assert(std::is_trivially_copyable<T>::value,
+                  "Tethys values must be trivially copyable");
+
     explicit TethysStoreBuilder(TethysStoreBuilderParam p);
 
     void insert_list(const Key& key, const std::vector<T>& val);
 
+    // The pages of the table are encoded concurrently: the block encoding
+    // functions of the encoder (start_block_encoding, encode and
+    // finish_block_encoding) must be safe to call from several threads.
     void build();
     void build(ValueEncoder& encoder, StashEncoder& stash_encoder);
 
 private:
+    // The table is written by batches of kWriteBatchSize pages, and encoded
+    // by runs of kBatchesPerRun batches, a page at a time. At most
+    // kMaxInFlightWrites batches are written at the same time: a run is
+    // encoded while the previous one is written.
+    static constexpr size_t kWriteBatchSize    = 64;
+    static constexpr size_t kBatchesPerRun     = 8;
+    static constexpr size_t kMaxInFlightWrites = 2 * kBatchesPerRun;
+    static constexpr size_t kEncodingChunkSize = 1;
+
     struct TethysData
     {
         using key_type   = Key;
@@ -72,13 +107,95 @@ private:
         }
     };
 
+    // In spill mode, only the key and the position of the list in the spill
+    // log are kept in memory
+    struct SpilledList
+    {
+        Key      key;
+        uint64_t offset; // in bytes
+        size_t   length; // in elements
+    };
+
+    bool is_spilling() const noexcept
+    {
+        return spill_log != nullptr;
+    }
+
+    const Key& list_key(size_t index) const;
+
+    // Returns the values of the index-th list. In spill mode, the list is
+    // read in buffer. Can be called concurrently once the log is flushed.
+    const std::vector<T>& list_values(size_t          index,
+                                      std::vector<T>& buffer) const;
+
+    void encode_page(ValueEncoder&               encoder,
+                     const details::TethysGraph& graph,
+                     size_t                      v_index,
+                     payload_type&               payload,
+                     std::vector<T>&             values_buffer) const;
+
     TethysStoreBuilderParam  params;
     details::TethysAllocator allocator;
     std::vector<TethysData>  data;
 
+    std::vector<SpilledList>               spilled_data;
+    std::unique_ptr<abstractio::AppendLog> spill_log;
+
     bool is_built{false};
 };
 
+template<size_t PAGE_SIZE,
+         class Key,
+         class T,
+         class TethysHasher,
+         class ValueEncoder,
+         class StashEncoder>
+constexpr size_t TethysStoreBuilder<PAGE_SIZE,
+                                    Key,
+                                    T,
+                                    TethysHasher,
+                                    ValueEncoder,
+                                    StashEncoder>::kWriteBatchSize;
+
+template<size_t PAGE_SIZE,
+         class Key,
+         class T,
+         class TethysHasher,
+         class ValueEncoder,
+         class StashEncoder>
+constexpr size_t TethysStoreBuilder<PAGE_SIZE,
+                                    Key,
+                                    T,
+                                    TethysHasher,
+                                    ValueEncoder,
+                                    StashEncoder>::kBatchesPerRun;
+
+template<size_t PAGE_SIZE,
+         class Key,
+         class T,
+         class TethysHasher,
+         class ValueEncoder,
+         class StashEncoder>
+constexpr size_t TethysStoreBuilder<PAGE_SIZE,
+                                    Key,
+                                    T,
+                                    TethysHasher,
+                                    ValueEncoder,
+                                    StashEncoder>::kMaxInFlightWrites;
+
+template<size_t PAGE_SIZE,
+         class Key,
+         class T,
+         class TethysHasher,
+         class ValueEncoder,
+         class StashEncoder>
+constexpr size_t TethysStoreBuilder<PAGE_SIZE,
+                                    Key,
+                                    T,
+                                    TethysHasher,
+                                    ValueEncoder,
+                                    StashEncoder>::kEncodingChunkSize;
+
 template<size_t PAGE_SIZE,
          class Key,
          class T,
@@ -94,6 +211,9 @@ TethysStoreBuilder<PAGE_SIZE,
     : params(std::move(p)),
       allocator(params.graph_size(kBucketSize), kBucketSize)
 {
+    if (!params.spill_path.empty()) {
+        spill_log.reset(new abstractio::AppendLog(params.spill_path));
+    }
 }
 
 template<size_t PAGE_SIZE,
@@ -115,15 +235,21 @@ void TethysStoreBuilder<PAGE_SIZE,
             "The Tethys builder has already been commited");
     }
 
-    // copy the data
-    data.push_back(TethysData(key, val));
-
-    size_t value_index = data.size() - 1;
+    size_t value_index;
+    if (is_spilling()) {
+        uint64_t offset = spill_log->append(val.data(), val.size() * sizeof(T));
+        spilled_data.push_back(SpilledList{key, offset, val.size()});
+        value_index = spilled_data.size() - 1;
+    } else {
+        // copy the data
+        data.push_back(TethysData(key, val));
+        value_index = data.size() - 1;
+    }
 
     // insert the data in the allocator
     // TethysAllocatorKey tethys_key = TethysHasher()(key);
     details::TethysAllocatorKey tethys_key
-        = TethysHasher()(data[value_index].key); // avoid copies
+        = TethysHasher()(list_key(value_index)); // avoid copies
 
     // we have to update the hashed key to ensure we have a bipartite graph
     size_t half_graph_size = params.graph_size(kBucketSize) / 2;
@@ -179,93 +305,140 @@ void TethysStoreBuilder<PAGE_SIZE,
     size_t graph_size = params.graph_size(kBucketSize);
 
     abstractio::awonvm_vector<payload_type, PAGE_SIZE> tethys_table(
-        params.tethys_table_path);
+        params.tethys_table_path, params.direct_io);
     tethys_table.reserve(params.graph_size(kBucketSize));
 
     // run the allocation algorithm
-    allocator.allocate();
+    allocator.allocate(params.maxflow_algorithm, params.parallel_maxflow);
 
 
+    const details::TethysGraph& graph = allocator.get_allocation_graph();
+    // the pages are encoded concurrently
+    graph.compress_adjacency();
+
     // tell the encoder that we are about to start the encoding of the graph
-    encoder.start_tethys_encoding(allocator.get_allocation_graph());
+    encoder.start_tethys_encoding(graph);
+
+    if (is_spilling()) {
+        // the lists are read back from the log during the encoding
+        spill_log->flush();
+    }
 
-    for (size_t v_index = 0; v_index < graph_size; v_index++) {
-        const details::Vertex& v
-            = allocator.get_allocation_graph()
-                  .inner_vertices()[details::VertexPtr(v_index)];
+    utility::RangeExecutor& executor
+        = utility::RangeExecutor::global_executor();
+    const uint8_t participants_count = static_cast<uint8_t>(
+        std::min<size_t>(executor.threads_count() + 1,
+                         std::numeric_limits<uint8_t>::max()));
 
-        payload_type payload;
-        std::fill(payload.begin(), payload.end(), 0xFF);
-        size_t written_bytes = 0;
+    // one buffer per participant, to read the spilled lists
+    std::vector<std::vector<T>> values_buffers(participants_count);
 
-        // declare the start of a new block to the encoder
-        written_bytes += encoder.start_block_encoding(payload.data(), v_index);
+    // The batches are written asynchronously, from buffers aligned for direct
+    // IOs. Before encoding a new run, wait for enough write slots to be free.
+    abstractio::AlignedBufferPool batch_pool(
+        kWriteBatchSize * sizeof(payload_type), PAGE_SIZE, kMaxInFlightWrites);
 
-        // start with incoming edges
-        for (auto e_ptr : v.in_edges) {
-            const auto& e = allocator.get_allocation_graph().get_edge(e_ptr);
+    std::mutex              writes_lock;
+    std::condition_variable writes_cv;
+    size_t                  in_flight_writes = 0;
+    bool                    write_failed     = false;
 
-            if (e.value_index == details::TethysAllocator::kEmptyIndexValue) {
-                // this is a placeholder edge that we do not need to
-                // consider
-                continue;
-            }
+    auto wait_writes = [&](size_t max_in_flight) {
+        std::unique_lock<std::mutex> lock(writes_lock);
+        writes_cv.wait(lock, [&] { return in_flight_writes <= max_in_flight; });
+    };
 
-            const TethysData& d = data[e.value_index];
+    const size_t run_size = kWriteBatchSize * kBatchesPerRun;
 
-            size_t encoding_length
-                = encoder.encode(payload.data() + written_bytes,
-                                 v_index,
-                                 d.key,
-                                 d.values,
-                                 TethysAssignmentInfo(e, IncomingEdge));
+    try {
+        for (size_t run_start = 0; run_start < graph_size;
+             run_start += run_size) {
+            const size_t run_count = std::min(run_size, graph_size - run_start);
+            const size_t batches_count
+                = (run_count + kWriteBatchSize - 1) / kWriteBatchSize;
 
-            written_bytes += encoding_length;
-            if (written_bytes > sizeof(payload_type)) {
-                throw std::out_of_range("Out of bound write during encoding");
-            }
-        }
+            wait_writes(kMaxInFlightWrites - batches_count);
 
-        // then outgoing edges
-        for (auto e_ptr : v.out_edges) {
-            const auto& e = allocator.get_allocation_graph().get_edge(e_ptr);
-            if (e.value_index == details::TethysAllocator::kEmptyIndexValue) {
-                // this is a placeholder edge that we do not need to
-                // consider
-                continue;
-            }
-            const TethysData& d = data[e.value_index];
-
-            size_t encoding_length
-                = encoder.encode(payload.data() + written_bytes,
-                                 v_index,
-                                 d.key,
-                                 d.values,
-                                 TethysAssignmentInfo(e, OutgoingEdge));
-
-            written_bytes += encoding_length;
-            if (written_bytes > sizeof(payload_type)) {
-                throw std::out_of_range("Out of bound write during encoding");
+            std::array<payload_type*, kBatchesPerRun> batches;
+            for (size_t b = 0; b < batches_count; b++) {
+                batches[b] = static_cast<payload_type*>(batch_pool.acquire());
             }
-        }
 
-        // declare the end of the block to the encoder
-        written_bytes
-            += encoder.finish_block_encoding(payload.data(),
-                                             v_index,
-                                             written_bytes,
-                                             payload.size() - written_bytes);
+            auto job = [&](uint8_t slot, size_t min, size_t max) {
+                for (size_t i = min; i <= max; i++) {
+                    encode_page(
+                        encoder,
+                        graph,
+                        run_start + i,
+                        batches[i / kWriteBatchSize][i % kWriteBatchSize],
+                        values_buffers[slot]);
+                }
+            };
+            try {
+                executor.run(
+                    run_count, kEncodingChunkSize, participants_count, job);
+            } catch (...) {
+                for (size_t b = 0; b < batches_count; b++) {
+                    batch_pool.release(batches[b]);
+                }
+                throw;
+            }
 
-        if (written_bytes > sizeof(payload_type)) {
-            throw std::out_of_range("Out of bound write during encoding");
+            for (size_t b = 0; b < batches_count; b++) {
+                payload_type* pages       = batches[b];
+                const size_t  batch_start = run_start + b * kWriteBatchSize;
+                const size_t  count
+                    = std::min(kWriteBatchSize, graph_size - batch_start);
+
+                auto write_callback = [&, pages, count](int64_t res) {
+                    batch_pool.release(pages);
+
+                    std::lock_guard<std::mutex> lock(writes_lock);
+                    if (res
+                        != static_cast<int64_t>(count * sizeof(payload_type))) {
+                        write_failed = true;
+                    }
+                    in_flight_writes--;
+                    writes_cv.notify_all();
+                };
+
+                {
+                    std::lock_guard<std::mutex> lock(writes_lock);
+                    in_flight_writes++;
+                }
+                size_t storage_index = 0;
+                try {
+                    storage_index = tethys_table.async_push_back(
+                        pages, count, write_callback);
+                } catch (...) {
+                    {
+                        std::lock_guard<std::mutex> lock(writes_lock);
+                        in_flight_writes--;
+                    }
+                    for (size_t r = b; r < batches_count; r++) {
+                        batch_pool.release(batches[r]);
+                    }
+                    throw;
+                }
+
+                if (storage_index != batch_start) {
+                    for (size_t r = b + 1; r < batches_count; r++) {
+                        batch_pool.release(batches[r]);
+                    }
+                    throw std::runtime_error(
+                        "Vertex index and storage index are offset");
+                }
+            }
         }
+    } catch (...) {
+        // the pending writes use the batch buffers
+        wait_writes(0);
+        throw;
+    }
+    wait_writes(0);
 
-        size_t storage_index = tethys_table.push_back(payload);
-
-        if (storage_index != v_index) {
-            throw std::runtime_error(
-                "Vertex index and storage index are offset");
-        }
+    if (write_failed) {
+        throw std::runtime_error("Error while writing the Tethys table");
     }
 
     encoder.finish_tethys_table_encoding();
@@ -276,6 +449,8 @@ void TethysStoreBuilder<PAGE_SIZE,
 
     // now, we have to take care of the stash
     if (allocator.get_stashed_edges().size() > 0) {
+        std::vector<T>& values_buffer = values_buffers.front();
+
         std::ofstream stash_file;
         stash_file.open(params.tethys_stash_path);
 
@@ -290,13 +465,12 @@ void TethysStoreBuilder<PAGE_SIZE,
                 // consider
                 continue;
             }
-            const TethysData&                d = data[e.value_index];
             TethysStashSerializationValue<T> v(
-                &d.values,
+                &list_values(e.value_index, values_buffer),
                 TethysAssignmentInfo(
                     e, IncomingEdge)); // the orientation does not matter. Yet,
                                        // we have a specified convention
-            serializer.serialize(d.key, v, stash_encoder);
+            serializer.serialize(list_key(e.value_index), v, stash_encoder);
         }
 
 
@@ -309,5 +483,127 @@ void TethysStoreBuilder<PAGE_SIZE,
     is_built = true;
 }
 
+template<size_t PAGE_SIZE,
+         class Key,
+         class T,
+         class TethysHasher,
+         class ValueEncoder,
+         class StashEncoder>
+void TethysStoreBuilder<PAGE_SIZE,
+                        Key,
+                        T,
+                        TethysHasher,
+                        ValueEncoder,
+                        StashEncoder>::
+    encode_page(ValueEncoder&               encoder,
+                const details::TethysGraph& graph,
+                size_t                      v_index,
+                payload_type&               payload,
+                std::vector<T>&             values_buffer) const
+{
+    const details::VertexPtr v_ptr(v_index);
+
+    std::fill(payload.begin(), payload.end(), 0xFF);
+    size_t written_bytes = 0;
+
+    // declare the start of a new block to the encoder
+    written_bytes += encoder.start_block_encoding(payload.data(), v_index);
+
+    // start with incoming edges
+    for (auto e_ptr : graph.in_edges(v_ptr)) {
+        const auto& e = graph.get_edge(e_ptr);
+
+        if (e.value_index == details::TethysAllocator::kEmptyIndexValue) {
+            // this is a placeholder edge that we do not need to
+            // consider
+            continue;
+        }
+
+        size_t encoding_length = encoder.encode(
+            payload.data() + written_bytes,
+            v_index,
+            list_key(e.value_index),
+            list_values(e.value_index, values_buffer),
+            TethysAssignmentInfo(e, IncomingEdge));
+
+        written_bytes += encoding_length;
+        if (written_bytes > sizeof(payload_type)) {
+            throw std::out_of_range("Out of bound write during encoding");
+        }
+    }
+
+    // then outgoing edges
+    for (auto e_ptr : graph.out_edges(v_ptr)) {
+        const auto& e = graph.get_edge(e_ptr);
+        if (e.value_index == details::TethysAllocator::kEmptyIndexValue) {
+            // this is a placeholder edge that we do not need to
+            // consider
+            continue;
+        }
+        size_t encoding_length = encoder.encode(
+            payload.data() + written_bytes,
+            v_index,
+            list_key(e.value_index),
+            list_values(e.value_index, values_buffer),
+            TethysAssignmentInfo(e, OutgoingEdge));
+
+        written_bytes += encoding_length;
+        if (written_bytes > sizeof(payload_type)) {
+            throw std::out_of_range("Out of bound write during encoding");
+        }
+    }
+
+    // declare the end of the block to the encoder
+    written_bytes
+        += encoder.finish_block_encoding(payload.data(),
+                                         v_index,
+                                         written_bytes,
+                                         payload.size() - written_bytes);
+
+    if (written_bytes > sizeof(payload_type)) {
+        throw std::out_of_range("Out of bound write during encoding");
+    }
+}
+
+template<size_t PAGE_SIZE,
+         class Key,
+         class T,
+         class TethysHasher,
+         class ValueEncoder,
+         class StashEncoder>
+const Key& TethysStoreBuilder<PAGE_SIZE,
+                              Key,
+                              T,
+                              TethysHasher,
+                              ValueEncoder,
+                              StashEncoder>::list_key(size_t index) const
+{
+    return is_spilling() ? spilled_data[index].key : data[index].key;
+}
+
+template<size_t PAGE_SIZE,
+         class Key,
+         class T,
+         class TethysHasher,
+         class ValueEncoder,
+         class StashEncoder>
+const std::vector<T>& TethysStoreBuilder<
+    PAGE_SIZE,
+    Key,
+    T,
+    TethysHasher,
+    ValueEncoder,
+    StashEncoder>::list_values(size_t index, std::vector<T>& buffer) const
+{
+    if (!is_spilling()) {
+        return data[index].values;
+    }
+
+    const SpilledList& l = spilled_data[index];
+    buffer.resize(l.length);
+    spill_log->read(l.offset, buffer.data(), l.length * sizeof(T));
+    return buffer;
+}
+
 } // namespace tethys
 } // namespace sse
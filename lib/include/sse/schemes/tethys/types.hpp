@@ -37,6 +37,18 @@ struct BucketPair
     std::array<uint8_t, N> payload_1;
 };
 
+// Non-owning version of BucketPair: the payloads live in the store's buffers
+// (or in its memory mapping), and are only valid for the duration of the
+// callback receiving the view
+template<size_t N>
+struct BucketPairView
+{
+    size_t                        index_0{~0UL};
+    size_t                        index_1{~0UL};
+    const std::array<uint8_t, N>* payload_0{nullptr};
+    const std::array<uint8_t, N>* payload_1{nullptr};
+};
+
 template<size_t N>
 struct KeyedBucketPair
 {
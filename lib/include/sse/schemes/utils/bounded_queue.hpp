@@ -0,0 +1,119 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+#include <atomic>
+#include <memory>
+
+namespace sse {
+namespace utility {
+
+// Bounded lock-free multi-producer/multi-consumer queue, implemented as a
+// ring buffer in which every cell carries a sequence number (D. Vyukov's
+// algorithm). Both operations are non-blocking: they fail when the queue is
+// full (resp. empty).
+template<typename T>
+class BoundedQueue
+{
+public:
+    static constexpr size_t kCacheLineSize = 64;
+
+    // The capacity is rounded up to the next power of 2
+    explicit BoundedQueue(size_t capacity)
+        : mask_(round_capacity(capacity) - 1),
+          buffer_(new Cell[round_capacity(capacity)]), enqueue_pos_(0),
+          dequeue_pos_(0)
+    {
+        for (size_t i = 0; i <= mask_; i++) {
+            buffer_[i].sequence.store(i, std::memory_order_relaxed);
+        }
+    }
+
+    BoundedQueue(const BoundedQueue&) = delete;
+    BoundedQueue& operator=(const BoundedQueue&) = delete;
+
+    size_t capacity() const
+    {
+        return mask_ + 1;
+    }
+
+    bool try_push(const T& value)
+    {
+        Cell*  cell;
+        size_t pos = enqueue_pos_.load(std::memory_order_relaxed);
+        for (;;) {
+            cell             = &buffer_[pos & mask_];
+            const size_t seq = cell->sequence.load(std::memory_order_acquire);
+            const intptr_t diff
+                = static_cast<intptr_t>(seq) - static_cast<intptr_t>(pos);
+            if (diff == 0) {
+                if (enqueue_pos_.compare_exchange_weak(
+                        pos, pos + 1, std::memory_order_relaxed)) {
+                    break;
+                }
+            } else if (diff < 0) {
+                // full
+                return false;
+            } else {
+                pos = enqueue_pos_.load(std::memory_order_relaxed);
+            }
+        }
+        cell->data = value;
+        cell->sequence.store(pos + 1, std::memory_order_release);
+        return true;
+    }
+
+    bool try_pop(T& value)
+    {
+        Cell*  cell;
+        size_t pos = dequeue_pos_.load(std::memory_order_relaxed);
+        for (;;) {
+            cell             = &buffer_[pos & mask_];
+            const size_t seq = cell->sequence.load(std::memory_order_acquire);
+            const intptr_t diff
+                = static_cast<intptr_t>(seq) - static_cast<intptr_t>(pos + 1);
+            if (diff == 0) {
+                if (dequeue_pos_.compare_exchange_weak(
+                        pos, pos + 1, std::memory_order_relaxed)) {
+                    break;
+                }
+            } else if (diff < 0) {
+                // empty
+                return false;
+            } else {
+                pos = dequeue_pos_.load(std::memory_order_relaxed);
+            }
+        }
+        value = cell->data;
+        cell->sequence.store(pos + mask_ + 1, std::memory_order_release);
+        return true;
+    }
+
+private:
+    struct Cell
+    {
+        std::atomic<size_t> sequence;
+        T                   data;
+    };
+
+    static size_t round_capacity(size_t capacity)
+    {
+        size_t c = 2;
+        while (c < capacity) {
+            c <<= 1;
+        }
+        return c;
+    }
+
+    const size_t            mask_;
+    std::unique_ptr<Cell[]> buffer_;
+
+    // keep the producers' and the consumers' positions on different cache
+    // lines
+    alignas(kCacheLineSize) std::atomic<size_t> enqueue_pos_;
+    alignas(kCacheLineSize) std::atomic<size_t> dequeue_pos_;
+};
+
+} // namespace utility
+} // namespace sse
@@ -0,0 +1,82 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace sse {
+namespace utility {
+
+// Long-lived pool of workers splitting integer ranges between them.
+//
+// Every call to run() splits its range in chunks that are claimed one by one
+// by the threads participating to the job (the calling thread included).
+// A job is handed to the workers as a set of tickets, one per participant
+// slot. Whenever another job is waiting, a worker puts its ticket back at the
+// end of the queue after each chunk, so that concurrent jobs progress at the
+// same pace, whatever their size.
+class RangeExecutor
+{
+public:
+    // Job processing the indices between min and max (both included). The
+    // slot argument is in [0, max_participants) and identifies the
+    // participant calling the job: a slot is never used by two threads at the
+    // same time.
+    using range_job_type
+        = std::function<void(uint8_t slot, size_t min, size_t max)>;
+
+    explicit RangeExecutor(unsigned threads_count);
+    ~RangeExecutor();
+
+    RangeExecutor(const RangeExecutor&) = delete;
+    RangeExecutor& operator=(const RangeExecutor&) = delete;
+
+    // Process the range [0, count) by chunks of chunk_size indices, using at
+    // most max_participants threads (the calling thread included). Blocks
+    // until the whole range has been processed. If a job throws, the first
+    // exception is rethrown once all the chunks have been processed.
+    void run(size_t                count,
+             size_t                chunk_size,
+             uint8_t               max_participants,
+             const range_job_type& job);
+
+    size_t threads_count() const
+    {
+        return workers_.size();
+    }
+
+    static RangeExecutor& global_executor();
+
+private:
+    struct Task;
+    struct Ticket
+    {
+        std::shared_ptr<Task> task;
+        uint8_t               slot;
+    };
+
+    void worker_loop();
+
+    // Process the next unclaimed chunk of the task, if any.
+    // Returns false if all the chunks were already claimed.
+    static bool process_chunk(Task& task, uint8_t slot);
+
+    std::vector<std::thread> workers_;
+    std::deque<Ticket>       tickets_;
+
+    std::mutex              queue_mtx_;
+    std::condition_variable queue_cv_;
+    bool                    stop_{false};
+};
+
+} // namespace utility
+} // namespace sse
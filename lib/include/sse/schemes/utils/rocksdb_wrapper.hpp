@@ -27,14 +27,36 @@
 #include <rocksdb/memtablerep.h>
 #include <rocksdb/options.h>
 #include <rocksdb/table.h>
+#include <rocksdb/version.h>
+#include <rocksdb/write_batch.h>
 
+#include <chrono>
 #include <iostream>
 #include <list>
 #include <memory>
+#include <vector>
+
+// The batched MultiGet interface, filling pinnable slices instead of
+// allocating one string per value, was introduced in RocksDB 6.4
+#if (ROCKSDB_MAJOR > 6) || (ROCKSDB_MAJOR == 6 && ROCKSDB_MINOR >= 4)
+#define SSE_ROCKSDB_HAS_BATCHED_MULTIGET 1
+#endif
 
 namespace sse {
 namespace sophos {
 
+// Tuning of the bulk ingestion paths
+struct WriteBatchOptions
+{
+    // Number of puts grouped in a single write batch
+    size_t batch_size{1024};
+
+    // Skip the write-ahead log. The batched writes are then only durable once
+    // the memtables are flushed, which is done when the ingestion is
+    // finalized (see the sync functions).
+    bool disable_wal{false};
+};
+
 class RockDBWrapper
 {
 public:
@@ -51,9 +73,32 @@ public:
                     const uint8_t  key_length,
                     V&             data) const;
 
+    // Lookup count keys at once. found[i] is set to true iff keys[i] is in the
+    // database, in which case the associated value is copied to data[i].
+    // Returns the number of keys that were found.
+    template<size_t N, typename V>
+    inline size_t multi_get(const std::array<uint8_t, N>* keys,
+                            const size_t                  count,
+                            V*                            data,
+                            bool*                         found) const;
+
     template<size_t N, typename V>
     inline bool put(const std::array<uint8_t, N>& key, const V& data);
 
+    // Add a put to a write batch, to be committed with write()
+    template<size_t N, typename V>
+    static inline void put(rocksdb::WriteBatch&          batch,
+                           const std::array<uint8_t, N>& key,
+                           const V&                      data);
+
+    // Atomically commit a write batch, optionally skipping the write-ahead
+    // log
+    inline bool write(rocksdb::WriteBatch& batch, bool disable_wal = false);
+
+    // Make the previous writes durable: flush the memtables if the writes
+    // skipped the write-ahead log, sync the write-ahead log otherwise.
+    inline bool sync(bool wal_disabled);
+
     template<size_t N>
     inline bool remove(const std::array<uint8_t, N>& key);
 
@@ -179,6 +224,52 @@ bool RockDBWrapper::get(const uint8_t* key,
     return s.ok();
 }
 
+template<size_t N, typename V>
+size_t RockDBWrapper::multi_get(const std::array<uint8_t, N>* keys,
+                                const size_t                  count,
+                                V*                            data,
+                                bool*                         found) const
+{
+    if (count == 0) {
+        return 0;
+    }
+
+    std::vector<rocksdb::Slice> k_s;
+    k_s.reserve(count);
+    for (size_t i = 0; i < count; i++) {
+        k_s.emplace_back(reinterpret_cast<const char*>(keys[i].data()), N);
+    }
+
+    size_t found_count = 0;
+
+#ifdef SSE_ROCKSDB_HAS_BATCHED_MULTIGET
+    std::vector<rocksdb::PinnableSlice> values(count);
+    std::vector<rocksdb::Status>        statuses(count);
+
+    db_->MultiGet(rocksdb::ReadOptions(false, true),
+                  db_->DefaultColumnFamily(),
+                  count,
+                  k_s.data(),
+                  values.data(),
+                  statuses.data());
+#else
+    // Fallback for older RocksDB versions: the values are still fetched in a
+    // single call, but are copied in newly allocated strings
+    std::vector<std::string>     values;
+    std::vector<rocksdb::Status> statuses
+        = db_->MultiGet(rocksdb::ReadOptions(false, true), k_s, &values);
+#endif
+
+    for (size_t i = 0; i < count; i++) {
+        found[i] = statuses[i].ok();
+        if (found[i]) {
+            ::memcpy(&data[i], values[i].data(), sizeof(V));
+            found_count++;
+        }
+    }
+
+    return found_count;
+}
 
 template<size_t N, typename V>
 bool RockDBWrapper::put(const std::array<uint8_t, N>& key, const V& data)
@@ -200,6 +291,58 @@ bool RockDBWrapper::put(const std::array<uint8_t, N>& key, const V& data)
     return s.ok();
 }
 
+template<size_t N, typename V>
+void RockDBWrapper::put(rocksdb::WriteBatch&          batch,
+                        const std::array<uint8_t, N>& key,
+                        const V&                      data)
+{
+    rocksdb::Slice k_s(reinterpret_cast<const char*>(key.data()), N);
+    rocksdb::Slice k_v(reinterpret_cast<const char*>(&data), sizeof(V));
+
+    batch.Put(k_s, k_v);
+}
+
+bool RockDBWrapper::write(rocksdb::WriteBatch& batch, bool disable_wal)
+{
+    rocksdb::WriteOptions options;
+    options.disableWAL = disable_wal;
+
+    rocksdb::Status s = db_->Write(options, &batch);
+
+    /* LCOV_EXCL_START */
+    if (!s.ok()) {
+        logger::logger()->error("Unable to write a batch of "
+                                + std::to_string(batch.Count())
+                                + " entries in the database\nRocksdb status: "
+                                + s.ToString());
+    }
+    /* LCOV_EXCL_STOP */
+
+    return s.ok();
+}
+
+bool RockDBWrapper::sync(bool wal_disabled)
+{
+    rocksdb::Status s;
+
+    if (wal_disabled) {
+        rocksdb::FlushOptions options;
+        options.wait = true;
+
+        s = db_->Flush(options);
+    } else {
+        s = db_->SyncWAL();
+    }
+
+    /* LCOV_EXCL_START */
+    if (!s.ok()) {
+        logger::logger()->error("DB sync failed: " + s.ToString());
+    }
+    /* LCOV_EXCL_STOP */
+
+    return s.ok();
+}
+
 template<size_t N>
 bool RockDBWrapper::remove(const std::array<uint8_t, N>& key)
 {
@@ -251,16 +394,47 @@ class RocksDBCounter
 {
 public:
     RocksDBCounter() = delete;
-    explicit RocksDBCounter(const std::string& path);
-    inline ~RocksDBCounter()
-    {
-        delete db_;
-    };
+    // When merge_increments is set, the increments are written as RocksDB
+    // merge operands instead of read-modify-write sequences, and the
+    // counters are reserved lock-free from in-memory atomic counters. A
+    // database containing merge operands must always be opened with
+    // merge_increments set.
+    explicit RocksDBCounter(const std::string& path,
+                            bool               merge_increments = false);
+    ~RocksDBCounter();
 
     bool get(const std::string& key, uint32_t& val) const;
 
     bool get_and_increment(const std::string& key, uint32_t& val);
 
+    // Same as get_and_increment for all the keys at once: vals[i] is set to
+    // the new counter of keys[i]. A key can appear several times, in which
+    // case it is incremented once per occurrence. The counters are read with
+    // a single MultiGet, and written with a single write batch.
+    bool get_and_increment(const std::vector<std::string>& keys,
+                           std::vector<uint32_t>&          vals,
+                           bool                            disable_wal = false);
+
+    // Reserve count consecutive counters for key: first is set to the first
+    // reserved counter (0 if the key was not in the database), and the
+    // counter of key becomes the last reserved one.
+    bool reserve(const std::string& key, uint32_t count, uint32_t& first);
+
+    // Returns true if get_and_increment and reserve are atomic, i.e. if the
+    // cache or the merge-based increments are enabled. Otherwise, the callers
+    // must serialize the increments of a same key.
+    bool atomic_increments() const
+    {
+        return merge_increments_ || cache_ != nullptr;
+    }
+
+    bool merge_increments() const
+    {
+        return merge_increments_;
+    }
+
+    // With merge-based increments, the following functions must not be
+    // called concurrently with an increment of the same key.
     bool increment(const std::string& key, uint32_t default_value = 0);
 
     bool set(const std::string& key, uint32_t val);
@@ -269,6 +443,31 @@ public:
 
     void flush(bool blocking = true);
 
+    // See RockDBWrapper::sync
+    bool sync(bool wal_disabled);
+
+    // Put an in-memory cache in front of the database. The cache is split in
+    // lock-striped shards, and the modified counters are written back to the
+    // database (write-behind) by checkpoints: every checkpoint_period (if it
+    // is not zero), when checkpoint(), flush() or sync() are called, and on
+    // destruction. A checkpoint writes all the modified counters in a single
+    // synced write batch: after a crash, the database holds the state of the
+    // last completed checkpoint.
+    // When enabled, the cache takes precedence over the merge-based
+    // increments. Must not be called concurrently with the other member
+    // functions.
+    void enable_cache(std::chrono::milliseconds checkpoint_period
+                      = std::chrono::milliseconds(1000));
+
+    bool cache_enabled() const
+    {
+        return cache_ != nullptr;
+    }
+
+    // Write the modified cached counters back to the database. Returns true
+    // if the cache is disabled.
+    bool checkpoint();
+
     inline uint64_t approximate_size() const
     {
         uint64_t v = 0;
@@ -278,7 +477,14 @@ public:
     }
 
 private:
-    rocksdb::DB* db_;
+    class Cache;
+    class Reservations;
+
+    rocksdb::DB*           db_;
+    std::unique_ptr<Cache> cache_;
+
+    const bool                    merge_increments_;
+    std::unique_ptr<Reservations> reservations_;
 };
 
 
@@ -72,6 +72,14 @@ JanusClient::JanusClient(const std::string&         search_counter_map_path,
 {
 }
 
+void JanusClient::enable_counter_cache(
+    std::chrono::milliseconds checkpoint_period)
+{
+    insertion_client_.enable_counter_cache(checkpoint_period);
+    deletion_client_.enable_counter_cache(checkpoint_period);
+    search_counter_map_.enable_cache(checkpoint_period);
+}
+
 std::string JanusClient::meta_keyword(const std::string& kw,
                                       uint32_t           search_counter)
 {
@@ -94,8 +94,17 @@ JanusServer::JanusServer(const std::string& db_add_path,
 
 std::list<index_type> JanusServer::search(SearchRequest& req)
 {
-    std::list<crypto::punct::ciphertext_type> insertions
-        = insertion_server_.search(req.insertion_search_request, true);
+    std::vector<index_type> results;
+
+    search(req, results);
+
+    return std::list<index_type>(results.begin(), results.end());
+}
+
+void JanusServer::search(SearchRequest& req, std::vector<index_type>& results)
+{
+    std::vector<crypto::punct::ciphertext_type> insertions;
+    insertion_server_.search(req.insertion_search_request, insertions, true);
 
     std::list<crypto::punct::key_share_type> key_shares
         = deletion_server_.search(req.deletion_search_request, true);
@@ -125,12 +134,13 @@ std::list<index_type> JanusServer::search(SearchRequest& req)
         std::make_move_iterator(std::end(key_shares))});
 
 
-    std::list<index_type>         results;
     std::list<cached_result_type> cached_res_list;
 
     // get previously cached elements
     cached_results_edb_.get(req.keyword_token, cached_res_list);
 
+    results.clear();
+    results.reserve(cached_res_list.size() + insertions.size());
 
     // filter the previously cached elements to remove newly removed entries
     auto it = cached_res_list.begin();
@@ -145,7 +155,7 @@ std::list<index_type> JanusServer::search(SearchRequest& req)
     }
 
 
-    for (auto ct : insertions) {
+    for (const auto& ct : insertions) {
         index_type r;
         if (decryptor.decrypt(ct, r)) {
             results.push_back(r);
@@ -155,30 +165,43 @@ std::list<index_type> JanusServer::search(SearchRequest& req)
 
     // store results in the cache
     cached_results_edb_.put(req.keyword_token, cached_res_list);
-
-
-    return results;
 }
 
 std::list<index_type> JanusServer::search_parallel(SearchRequest& req,
                                                    uint8_t diana_threads_count)
 {
-    // use one result list per thread so to avoid using locks
-    std::vector<std::list<index_type>> result_lists(diana_threads_count + 1);
+    std::vector<index_type> results;
 
-    auto callback = [&result_lists](index_type i, uint8_t thread_id) {
-        result_lists[thread_id].push_back(i);
+    search_parallel(req, diana_threads_count, results);
+
+    return std::list<index_type>(results.begin(), results.end());
+}
+
+void JanusServer::search_parallel(SearchRequest&           req,
+                                  uint8_t                  diana_threads_count,
+                                  std::vector<index_type>& results)
+{
+    // use one result vector per thread so to avoid using locks
+    std::vector<std::vector<index_type>> result_vectors(diana_threads_count
+                                                        + 1);
+
+    auto callback = [&result_vectors](index_type i, uint8_t thread_id) {
+        result_vectors[thread_id].push_back(i);
     };
 
     search_parallel(req, diana_threads_count, callback);
 
-    // merge the result lists
-    std::list<index_type> results(std::move(result_lists[0]));
-    for (size_t i = 1; i < result_lists.size(); i++) {
-        results.splice(results.end(), result_lists[i]);
+    // merge the result vectors
+    size_t results_count = 0;
+    for (const auto& v : result_vectors) {
+        results_count += v.size();
     }
 
-    return results;
+    results.clear();
+    results.reserve(results_count);
+    for (const auto& v : result_vectors) {
+        results.insert(results.end(), v.begin(), v.end());
+    }
 }
 
 void JanusServer::search_parallel(
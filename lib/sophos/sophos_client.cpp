@@ -25,7 +25,10 @@
 #include <sse/schemes/utils/utils.hpp>
 
 #include <algorithm>
+#include <future>
 #include <iostream>
+#include <iterator>
+#include <map>
 
 namespace sse {
 namespace sophos {
@@ -44,7 +47,7 @@ SophosClient::SophosClient(const std::string&      token_map_path,
                            crypto::Key<kKeySize>&& derivation_master_key,
                            crypto::Key<kKeySize>&& rsa_prg_key)
     : k_prf_(std::move(derivation_master_key)), inverse_tdp_(tdp_private_key),
-      rsa_prg_(std::move(rsa_prg_key)), counter_map_(token_map_path)
+      rsa_prg_(std::move(rsa_prg_key)), counter_map_(token_map_path, true)
 {
 }
 
@@ -55,6 +58,12 @@ size_t SophosClient::keyword_count() const
     return counter_map_.approximate_size();
 }
 
+void SophosClient::enable_counter_cache(
+    std::chrono::milliseconds checkpoint_period)
+{
+    counter_map_.enable_cache(checkpoint_period);
+}
+
 std::string SophosClient::public_key() const
 {
     return inverse_tdp_.public_key();
@@ -125,7 +134,13 @@ UpdateRequest SophosClient::insertion_request(const std::string& keyword,
     // retrieve the counter
     uint32_t kw_counter;
 
-    bool success = counter_map_.get_and_increment(keyword, kw_counter);
+    bool success;
+    if (counter_map_.atomic_increments()) {
+        success = counter_map_.get_and_increment(keyword, kw_counter);
+    } else {
+        std::lock_guard<std::mutex> lock(token_map_mtx_);
+        success = counter_map_.get_and_increment(keyword, kw_counter);
+    }
 
     if (!success) {
         throw std::runtime_error(
@@ -167,5 +182,117 @@ UpdateRequest SophosClient::insertion_request(const std::string& keyword,
 
     return req;
 }
+
+uint32_t SophosClient::reserve_counters(const std::string& keyword,
+                                        uint32_t           count)
+{
+    uint32_t first_counter;
+    bool     success;
+
+    if (counter_map_.atomic_increments()) {
+        success = counter_map_.reserve(keyword, count, first_counter);
+    } else {
+        std::lock_guard<std::mutex> lock(token_map_mtx_);
+        success = counter_map_.reserve(keyword, count, first_counter);
+    }
+
+    if (!success) {
+        throw std::runtime_error(
+            "Unable to increment the keyword counter for keyword \"" + keyword
+            + "\"");
+    }
+
+    return first_counter;
+}
+
+void SophosClient::keyword_insertion_requests(
+    const std::string&                                  keyword,
+    const std::vector<index_type>&                      indices,
+    const std::function<void(UpdateRequest&&, size_t)>& callback)
+{
+    const std::string seed = get_keyword_index(keyword);
+
+    uint32_t kw_counter
+        = reserve_counters(keyword, static_cast<uint32_t>(indices.size()));
+
+    auto deriv_key = derivation_prf().prf(
+        reinterpret_cast<const uint8_t*>(seed.data()), kKeywordIndexSize);
+    crypto::Prf<kUpdateTokenSize> derivation_prf(
+        crypto::Key<kKeySize>(deriv_key.data()));
+
+    // only the first token is computed from ST0, the next ones are obtained
+    // by a single inversion of the previous one
+    search_token_type st = inverse_tdp().generate_array(rsa_prg_, seed);
+    if (kw_counter != 0) {
+        st = inverse_tdp().invert_mult(st, kw_counter);
+    }
+
+    for (size_t i = 0; i < indices.size(); i++) {
+        if (i != 0) {
+            st = inverse_tdp().invert(st);
+        }
+
+        UpdateRequest                         req;
+        std::array<uint8_t, kUpdateTokenSize> mask;
+
+        gen_update_token_masks(derivation_prf, st.data(), req.token, mask);
+        req.index = utility::xor_mask(indices[i], mask);
+
+        callback(std::move(req), i);
+    }
+}
+
+std::list<UpdateRequest> SophosClient::bulk_insertion_request(
+    const std::list<std::pair<std::string, index_type>>& update_list,
+    ThreadPool&                                          pool)
+{
+    // group the updates by keyword, and remember their position in the list
+    using keyword_updates_type
+        = std::pair<std::vector<index_type>, std::vector<size_t>>;
+    std::map<std::string, keyword_updates_type> keyword_updates;
+
+    size_t pos = 0;
+    for (const auto& update : update_list) {
+        auto& kw_updates = keyword_updates[update.first];
+        kw_updates.first.push_back(update.second);
+        kw_updates.second.push_back(pos++);
+    }
+
+    std::vector<UpdateRequest> requests(update_list.size());
+
+    auto keyword_job = [this, &requests](const std::string&          keyword,
+                                         const keyword_updates_type& kw_updates) {
+        keyword_insertion_requests(
+            keyword,
+            kw_updates.first,
+            [&requests, &kw_updates](UpdateRequest&& req, size_t i) {
+                requests[kw_updates.second[i]] = std::move(req);
+            });
+    };
+
+    if (keyword_updates.size() == 1) {
+        // no need to go through the pool
+        keyword_job(keyword_updates.begin()->first,
+                    keyword_updates.begin()->second);
+    } else {
+        std::vector<std::future<void>> futures;
+        futures.reserve(keyword_updates.size());
+        for (const auto& kw_updates : keyword_updates) {
+            futures.push_back(pool.enqueue([&keyword_job, &kw_updates]() {
+                keyword_job(kw_updates.first, kw_updates.second);
+            }));
+        }
+        // wait for all the jobs before rethrowing a possible exception
+        for (auto& f : futures) {
+            f.wait();
+        }
+        for (auto& f : futures) {
+            f.get();
+        }
+    }
+
+    return std::list<UpdateRequest>(std::make_move_iterator(requests.begin()),
+                                    std::make_move_iterator(requests.end()));
+}
 } // namespace sophos
 } // namespace sse
@@ -36,6 +36,7 @@
 
 #include <grpcpp/grpcpp.h>
 
+#include <algorithm>
 #include <chrono>
 #include <fstream>
 #include <iostream>
@@ -269,25 +270,40 @@ const SophosClient& SophosClientRunner::client() const
 std::list<uint64_t> SophosClientRunner::search(
     const std::string&                   keyword,
     const std::function<void(uint64_t)>& receive_callback) const
+{
+    std::vector<uint64_t> results;
+
+    search(keyword, results, receive_callback);
+
+    return std::list<uint64_t>(results.begin(), results.end());
+}
+
+void SophosClientRunner::search(
+    const std::string&                   keyword,
+    std::vector<uint64_t>&               results,
+    const std::function<void(uint64_t)>& receive_callback) const
 {
     logger::logger()->trace("Search keyword: " + keyword);
 
     grpc::ClientContext          context;
     sophos::SearchRequestMessage message;
-    sophos::SearchReply          reply;
+    sophos::BatchedSearchReply   reply;
 
     message = request_to_message(client_->search_request(keyword));
 
-    std::unique_ptr<grpc::ClientReader<sophos::SearchReply>> reader(
-        stub_->search(&context, message));
-    std::list<uint64_t> results;
+    std::unique_ptr<grpc::ClientReader<sophos::BatchedSearchReply>> reader(
+        stub_->batch_search(&context, message));
 
+    results.clear();
+    results.reserve(message.add_count());
 
     while (reader->Read(&reply)) {
-        results.push_back(reply.result());
+        for (uint64_t res : reply.results()) {
+            results.push_back(res);
 
-        if (receive_callback != nullptr) {
-            receive_callback(reply.result());
+            if (receive_callback != nullptr) {
+                receive_callback(res);
+            }
         }
     }
     grpc::Status status = reader->Finish();
@@ -296,8 +312,6 @@ std::list<uint64_t> SophosClientRunner::search(
     } else {
         logger::logger()->error("Search failed: " + status.error_message());
     }
-
-    return results;
 }
 
 void SophosClientRunner::insert(const std::string& keyword, uint64_t index)
@@ -340,6 +354,33 @@ void SophosClientRunner::insert_in_session(const std::string& keyword,
     bulk_update_state_.mtx.unlock();
 }
 
+void SophosClientRunner::insert_in_session(
+    const std::list<std::pair<std::string, uint64_t>>& update_list)
+{
+    if (!bulk_update_state_.is_up) {
+        throw std::runtime_error("Invalid state: the update session is not up");
+    }
+
+    std::list<UpdateRequest> message_list
+        = client_->bulk_insertion_request(update_list);
+
+    bulk_update_state_.mtx.lock();
+
+    bool success = std::all_of(
+        message_list.begin(),
+        message_list.end(),
+        [this](const UpdateRequest& req) {
+            return this->bulk_update_state_.writer->Write(
+                request_to_message(req));
+        });
+
+    if (!success) {
+        logger::logger()->error("Update session: broken stream.");
+    }
+
+    bulk_update_state_.mtx.unlock();
+}
+
 void SophosClientRunner::start_update_session()
 {
     if (bulk_update_state_.writer) {
@@ -393,9 +434,12 @@ bool SophosClientRunner::load_inverted_index(const std::string& path)
                                      const std::list<unsigned>& docs) {
             auto work = [this, &counter](const std::string&         keyword,
                                          const std::list<unsigned>& documents) {
+                // the tokens of a keyword are computed incrementally
+                std::list<std::pair<std::string, uint64_t>> update_list;
                 for (unsigned doc : documents) {
-                    this->insert_in_session(keyword, doc);
+                    update_list.emplace_back(keyword, doc);
                 }
+                this->insert_in_session(update_list);
                 counter++;
 
                 if ((counter % 100) == 0) {
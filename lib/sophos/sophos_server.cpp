@@ -20,12 +20,16 @@
 
 
 #include <sse/schemes/sophos/sophos_server.hpp>
+#include <sse/schemes/utils/bounded_queue.hpp>
 #include <sse/schemes/utils/logger.hpp>
 #include <sse/schemes/utils/thread_pool.hpp>
 #include <sse/schemes/utils/utils.hpp>
 
 #include <algorithm>
+#include <atomic>
+#include <condition_variable>
 #include <iostream>
+#include <mutex>
 
 namespace sse {
 namespace sophos {
@@ -33,8 +37,16 @@ namespace sophos {
 
 SophosServer::SophosServer(const std::string& db_path,
                            const std::string& tdp_pk)
+    : SophosServer(db_path, tdp_pk, utility::RangeExecutor::global_executor())
+{
+}
+
+SophosServer::SophosServer(const std::string&      db_path,
+                           const std::string&      tdp_pk,
+                           utility::RangeExecutor& executor)
     : edb_(db_path),
-      public_tdp_(tdp_pk, 2 * std::thread::hardware_concurrency())
+      public_tdp_(tdp_pk, 2 * std::thread::hardware_concurrency()),
+      executor_(executor)
 {
 }
 
@@ -45,15 +57,24 @@ std::string SophosServer::public_key() const
 
 std::list<index_type> SophosServer::search(SearchRequest& req)
 {
-    std::list<index_type> results;
+    std::vector<index_type> results;
 
+    search(req, results);
+
+    return std::list<index_type>(results.begin(), results.end());
+}
+
+void SophosServer::search_callback(
+    SearchRequest&                         req,
+    const std::function<void(index_type)>& post_callback)
+{
     search_token_type st = req.token;
 
+
     logger::logger()->debug("Search token: " + utility::hex_string(req.token)
                             + "\nDerivation key: "
                             + utility::hex_string(req.derivation_key));
 
-
     crypto::Prf<kUpdateTokenSize> derivation_prf(
         crypto::Key<kDerivationKeySize>(req.derivation_key.data()));
 
@@ -63,19 +84,14 @@ std::list<index_type> SophosServer::search(SearchRequest& req)
         std::array<uint8_t, kUpdateTokenSize> mask;
         gen_update_token_masks(derivation_prf, st.data(), ut, mask);
 
-        logger::logger()->debug("Search token: ("
-                                + std::to_string(req.add_count - i - 1) + ", "
-                                + utility::hex_string(st) + ")\nDerived token: "
-                                + utility::hex_string(ut));
-
+        logger::logger()->debug("Derived token: " + utility::hex_string(ut));
 
         bool found = edb_.get(ut, r);
 
         if (found) {
             logger::logger()->debug("Found: " + utility::hex_string(r));
-
             r = utility::xor_mask(r, mask);
-            results.push_back(r);
+            post_callback(r);
         } else {
             /* LCOV_EXCL_START */
             logger::logger()->error("We were supposed to find something!");
@@ -84,16 +100,36 @@ std::list<index_type> SophosServer::search(SearchRequest& req)
 
         st = public_tdp_.eval(st);
     }
+}
 
-    return results;
-} // namespace sophos
+std::list<index_type> SophosServer::search_parallel(SearchRequest& req,
+                                                    uint8_t access_threads)
+{
+    std::vector<index_type> results;
 
-void SophosServer::search_callback(
-    SearchRequest&                         req,
-    const std::function<void(index_type)>& post_callback)
+    search_parallel(req, access_threads, results);
+
+    return std::list<index_type>(results.begin(), results.end());
+}
+
+std::list<index_type> SophosServer::search_parallel_light(SearchRequest& req,
+                                                          uint8_t thread_count)
 {
-    search_token_type st = req.token;
+    std::vector<index_type> results;
+
+    search_parallel_light(req, thread_count, results);
+
+    return std::list<index_type>(results.begin(), results.end());
+}
+
+void SophosServer::search(SearchRequest& req, std::vector<index_type>& results)
+{
+    if (results.size() < req.add_count) {
+        // resize the vector if needed
+        results.resize(req.add_count);
+    }
 
+    search_token_type st = req.token;
 
     logger::logger()->debug("Search token: " + utility::hex_string(req.token)
                             + "\nDerivation key: "
@@ -114,8 +150,7 @@ void SophosServer::search_callback(
 
         if (found) {
             logger::logger()->debug("Found: " + utility::hex_string(r));
-            r = utility::xor_mask(r, mask);
-            post_callback(r);
+            results[i] = utility::xor_mask(r, mask);
         } else {
             /* LCOV_EXCL_START */
             logger::logger()->error("We were supposed to find something!");
@@ -126,33 +161,130 @@ void SophosServer::search_callback(
     }
 }
 
-std::list<index_type> SophosServer::search_parallel(SearchRequest& req,
-                                                    uint8_t access_threads)
+void SophosServer::search_parallel(SearchRequest&           req,
+                                   uint8_t                  access_threads,
+                                   std::vector<index_type>& results)
 {
-    std::list<index_type> results;
-    std::mutex            res_mutex;
+    if (results.size() < req.add_count) {
+        // resize the vector if needed
+        results.resize(req.add_count);
+    }
 
-    search_token_type st = req.token;
+    // every result is written at its own position: no need to lock
+    auto callback
+        = [&results](size_t i, index_type v) { results[i] = v; };
+
+    pipelined_search(req, access_threads, callback);
+}
+
+void SophosServer::pipelined_search(SearchRequest&               req,
+                                    uint8_t                      access_threads,
+                                    const indexed_callback_type& post_callback)
+{
+    if (req.add_count == 0) {
+        return;
+    }
 
     logger::logger()->debug("Search token: " + utility::hex_string(req.token)
                             + "\nDerivation key: "
                             + utility::hex_string(req.derivation_key));
 
-
     crypto::Prf<kUpdateTokenSize> derivation_prf(
         crypto::Key<kDerivationKeySize>(req.derivation_key.data()));
 
-    ThreadPool access_pool(access_threads);
+    // the search tokens computed by the RSA stage, waiting to be derived and
+    // looked up by the access stage
+    utility::BoundedQueue<PipelinedToken> token_queue(kPipelineQueueSize);
+
+    // The chain is split in segments, computed independently by the RSA
+    // stage. The segments starting at a checkpoint cover the older part of
+    // the chain, and the tokens more recent than the last checkpoint (the
+    // whole chain if there is none) are computed by interleaved stripes, the
+    // stripe s computing the tokens s + kN.
+    std::vector<checkpoint_type> checkpoints;
+    if (checkpoint_cache_) {
+        checkpoints
+            = checkpoint_cache_->lookup(req.derivation_key, req.add_count);
+    }
+
+    // index (in the chain, starting from the most recent token) of the most
+    // recent checkpoint
+    const size_t top_end = (checkpoints.empty())
+                               ? req.add_count
+                               : req.add_count - 1 - checkpoints.back().first;
 
-    auto access_job = [&derivation_prf, this, &results, &res_mutex](
-                          const std::string& st_string) {
+    std::vector<ChainSegment> segments;
+
+    // use at least two stripes of RSA computations, and at most 255 as the
+    // stride of a stripe is an 8 bits integer
+    const size_t max_rsa_stripes
+        = std::max<unsigned>(std::thread::hardware_concurrency(), 2);
+    const size_t n_rsa_stripes
+        = std::min<size_t>({max_rsa_stripes, top_end, 0xFF});
+
+    for (size_t stripe = 0; stripe < n_rsa_stripes; stripe++) {
+        segments.push_back(ChainSegment{req.token,
+                                        0,
+                                        stripe,
+                                        top_end,
+                                        static_cast<uint8_t>(n_rsa_stripes)});
+    }
+    for (size_t i = 0; i < checkpoints.size(); i++) {
+        const size_t first = req.add_count - 1 - checkpoints[i].first;
+        const size_t end   = (i == 0)
+                               ? req.add_count
+                               : req.add_count - 1 - checkpoints[i - 1].first;
+        segments.push_back(
+            ChainSegment{checkpoints[i].second, first, first, end, 1});
+    }
+
+    const size_t n_segments    = segments.size();
+    const size_t n_access_jobs = std::max<uint8_t>(access_threads, 1);
+
+    std::atomic<size_t> finished_segments(0);
+
+    // The access jobs sleep on access_cv when the queue is empty. The RSA
+    // stage goes through access_mtx before notifying, so that a wake-up
+    // cannot be lost between a failed pop and the wait.
+    std::mutex              access_mtx;
+    std::condition_variable access_cv;
+
+    auto notify_access = [&access_mtx, &access_cv](bool all) {
+        {
+            std::lock_guard<std::mutex> lock(access_mtx);
+        }
+        if (all) {
+            access_cv.notify_all();
+        } else {
+            access_cv.notify_one();
+        }
+    };
+
+    // tokens of the stripes at the checkpoint positions, to be added to the
+    // cache
+    std::vector<checkpoint_type> new_checkpoints;
+    std::mutex                   new_checkpoints_mtx;
+
+    auto record_checkpoint = [this,
+                              &req,
+                              &new_checkpoints,
+                              &new_checkpoints_mtx,
+                              top_end](const PipelinedToken& item) {
+        if (!checkpoint_cache_ || item.index >= top_end) {
+            return;
+        }
+        const size_t position = req.add_count - 1 - item.index;
+        if (checkpoint_cache_->is_checkpoint_position(position)) {
+            std::lock_guard<std::mutex> lock(new_checkpoints_mtx);
+            new_checkpoints.emplace_back(position, item.st);
+        }
+    };
+
+    auto access = [&derivation_prf, this, &req, &post_callback](
+                      const PipelinedToken& item) {
         update_token_type                     token;
         std::array<uint8_t, kUpdateTokenSize> mask;
-        gen_update_token_masks(
-            derivation_prf,
-            reinterpret_cast<const uint8_t*>(st_string.data()),
-            token,
-            mask);
+        gen_update_token_masks(derivation_prf, item.st.data(), token, mask);
 
         index_type r;
 
@@ -162,72 +294,136 @@ std::list<index_type> SophosServer::search_parallel(SearchRequest& req,
 
         if (found) {
             logger::logger()->debug("Found: " + utility::hex_string(r));
+
+            post_callback(item.index, utility::xor_mask(r, mask));
         } else {
             /* LCOV_EXCL_START */
-            logger::logger()->error("We were supposed to find something!");
-            return;
+            logger::logger()->error(
+                "We were supposed to find a value mapped to key "
+                + utility::hex_string(token) + " ("
+                + std::to_string(item.index)
+                + "-th derived key from search token "
+                + utility::hex_string(req.token) + ")");
             /* LCOV_EXCL_STOP */
         }
-
-        index_type v = utility::xor_mask(r, mask);
-
-        res_mutex.lock();
-        results.push_back(v);
-        res_mutex.unlock();
     };
 
-
-    // the rsa job launched with input index,max computes all the RSA tokens of
-    // order i + kN up to max
-    auto rsa_job = [this, &st, &access_job, &access_pool](
-                       const uint8_t index, const size_t max, const uint8_t N) {
-        search_token_type local_st = st;
-        if (index != 0) {
-            local_st = public_tdp_.eval(local_st, index);
+    // When the queue is full, the access stage is lagging behind, and the
+    // RSA stage performs the lookups itself.
+    auto rsa_segment = [this,
+                        &token_queue,
+                        &access,
+                        &record_checkpoint,
+                        &notify_access](const ChainSegment& segment) {
+        PipelinedToken item;
+        item.st    = segment.origin;
+        item.index = segment.first;
+
+        if (segment.first != segment.origin_index) {
+            item.st = public_tdp_.eval(
+                item.st,
+                static_cast<uint8_t>(segment.first - segment.origin_index));
         }
 
-        if (index < max) {
-            // this is a valid search token, we have to derive it and do a
-            // lookup
-            std::string st_string(reinterpret_cast<char*>(local_st.data()),
-                                  local_st.size());
-            access_pool.enqueue(access_job, st_string);
+        while (item.index < segment.end) {
+            record_checkpoint(item);
+
+            while (!token_queue.try_push(item)) {
+                PipelinedToken pending;
+                if (token_queue.try_pop(pending)) {
+                    access(pending);
+                }
+            }
+            notify_access(false);
+
+            item.index += segment.step;
+            if (item.index < segment.end) {
+                item.st = public_tdp_.eval(item.st, segment.step);
+            }
         }
+    };
 
-        for (size_t i = index + N; i < max; i += N) {
-            local_st = public_tdp_.eval(local_st, N);
-
-            std::string st_string(reinterpret_cast<char*>(local_st.data()),
-                                  local_st.size());
-            access_pool.enqueue(access_job, st_string);
+    // The access jobs run until all the segments are finished and the queue
+    // is empty.
+    auto access_job = [&token_queue,
+                       &access,
+                       &finished_segments,
+                       &access_mtx,
+                       &access_cv,
+                       n_segments]() {
+        PipelinedToken item;
+        for (;;) {
+            bool popped = token_queue.try_pop(item);
+            if (!popped) {
+                std::unique_lock<std::mutex> lock(access_mtx);
+                access_cv.wait(lock, [&]() {
+                    // read the counter before popping: once all the
+                    // segments are finished, a failed pop means that the
+                    // queue is empty for good
+                    const bool done = (finished_segments.load() == n_segments);
+                    popped          = token_queue.try_pop(item);
+                    return popped || done;
+                });
+            }
+            if (!popped) {
+                return;
+            }
+            access(item);
         }
     };
 
-    std::vector<std::thread> rsa_threads;
+    auto finish_segment = [&finished_segments, &notify_access]() {
+        finished_segments++;
+        notify_access(true);
+    };
 
-    // use at least two threads to make the RSA computations
-    unsigned n_rsa_threads
-        = std::max<unsigned>(std::thread::hardware_concurrency(), 2);
+    // The executor claims the chunks in order: the access jobs (the last
+    // chunks) only start once every RSA segment has been claimed by a
+    // thread. Hence, the access jobs never wait for a segment that no thread
+    // is running, even when the executor is busy.
+    auto job = [&segments,
+                &rsa_segment,
+                &access_job,
+                &finish_segment,
+                n_segments](uint8_t /*slot*/, size_t min, size_t max) {
+        for (size_t c = min; c <= max; c++) {
+            if (c < n_segments) {
+                try {
+                    rsa_segment(segments[c]);
+                } catch (...) {
+                    // do not let the access jobs wait forever
+                    finish_segment();
+                    throw;
+                }
+                finish_segment();
+            } else {
+                access_job();
+            }
+        }
+    };
 
-    for (unsigned t = 0; t < n_rsa_threads; t++) {
-        rsa_threads.emplace_back(rsa_job, t, req.add_count, n_rsa_threads);
-    }
+    executor_.run(n_segments + n_access_jobs,
+                  1,
+                  static_cast<uint8_t>(
+                      std::min<size_t>(max_rsa_stripes + n_access_jobs, 0xFF)),
+                  job);
 
-    for (unsigned t = 0; t < n_rsa_threads; t++) {
-        rsa_threads[t].join();
+    if (checkpoint_cache_) {
+        checkpoint_cache_->insert(req.derivation_key,
+                                  std::move(new_checkpoints));
     }
-
-    access_pool.join();
-
-    return results;
 }
 
-std::list<index_type> SophosServer::search_parallel_light(SearchRequest& req,
-                                                          uint8_t thread_count)
+void SophosServer::search_parallel_light(SearchRequest&           req,
+                                         uint8_t                  thread_count,
+                                         std::vector<index_type>& results)
 {
-    search_token_type     st = req.token;
-    std::list<index_type> results;
-    std::mutex            res_mutex;
+    if (results.size() < req.add_count) {
+        // resize the vector if needed
+        results.resize(req.add_count);
+    }
+
+    search_token_type st = req.token;
 
     logger::logger()->debug("Search token: " + utility::hex_string(req.token)
                             + "\nDerivation key: "
@@ -236,13 +432,12 @@ std::list<index_type> SophosServer::search_parallel_light(SearchRequest& req,
     crypto::Prf<kUpdateTokenSize> derivation_prf(
         crypto::Key<kDerivationKeySize>(req.derivation_key.data()));
 
-    auto derive_access = [&derivation_prf, this, &results, &res_mutex](
-                             const search_token_type st, size_t i) {
+    auto derive_access = [&derivation_prf, this, &results](
+                             const search_token_type& st, size_t i) {
         update_token_type                     token;
         std::array<uint8_t, kUpdateTokenSize> mask;
         gen_update_token_masks(derivation_prf, st.data(), token, mask);
 
-
         index_type r;
 
         logger::logger()->debug("Derived token: " + utility::hex_string(token));
@@ -252,12 +447,7 @@ std::list<index_type> SophosServer::search_parallel_light(SearchRequest& req,
         if (found) {
             logger::logger()->debug("Found: " + utility::hex_string(r));
 
-            index_type v = utility::xor_mask(r, mask);
-
-            res_mutex.lock();
-            results.push_back(v);
-            res_mutex.unlock();
-
+            results[i] = utility::xor_mask(r, mask);
         } else {
             /* LCOV_EXCL_START */
             logger::logger()->error(
@@ -282,22 +472,18 @@ std::list<index_type> SophosServer::search_parallel_light(SearchRequest& req,
         if (index < max) {
             // this is a valid search token, we have to derive it and do a
             // lookup
-
             derive_access(local_st, index);
         }
 
         for (size_t i = index + N; i < max; i += N) {
             local_st = public_tdp_.eval(local_st, N);
 
-            derive_access(local_st, index);
+            derive_access(local_st, i);
         }
     };
 
     std::vector<std::thread> rsa_threads;
 
-    //    unsigned n_threads =
-    //    std::thread::hardware_concurrency()-access_threads;
-
     for (uint8_t t = 0; t < thread_count; t++) {
         rsa_threads.emplace_back(job, t, req.add_count, thread_count);
     }
@@ -305,8 +491,6 @@ std::list<index_type> SophosServer::search_parallel_light(SearchRequest& req,
     for (uint8_t t = 0; t < thread_count; t++) {
         rsa_threads[t].join();
     }
-
-    return results;
 }
 
 void SophosServer::search_parallel_callback(
@@ -481,6 +665,25 @@ void SophosServer::search_parallel_light_callback(
     }
 }
 
+void SophosServer::enable_checkpoint_cache(size_t interval,
+                                           size_t max_checkpoints)
+{
+    checkpoint_cache_.reset(new TdpCheckpointCache(interval, max_checkpoints));
+}
+
+void SophosServer::disable_checkpoint_cache()
+{
+    checkpoint_cache_.reset();
+}
+
+TdpCheckpointCache::Stats SophosServer::checkpoint_cache_stats() const
+{
+    if (!checkpoint_cache_) {
+        return TdpCheckpointCache::Stats();
+    }
+    return checkpoint_cache_->stats();
+}
+
 void SophosServer::insert(const UpdateRequest& req)
 {
     logger::logger()->debug("Update: (" + utility::hex_string(req.token) + ", "
@@ -489,5 +692,23 @@ void SophosServer::insert(const UpdateRequest& req)
     //    edb_.add(req.token, req.index);
     edb_.put(req.token, req.index);
 }
+
+void SophosServer::insert(const std::vector<UpdateRequest>& reqs,
+                          bool                              disable_wal)
+{
+    logger::logger()->debug("Bulk update: " + std::to_string(reqs.size())
+                            + " entries");
+
+    rocksdb::WriteBatch batch;
+    for (const auto& req : reqs) {
+        RockDBWrapper::put(batch, req.token, req.index);
+    }
+    edb_.write(batch, disable_wal);
+}
+
+void SophosServer::sync_edb(bool wal_disabled)
+{
+    edb_.sync(wal_disabled);
+}
 } // namespace sophos
 } // namespace sse
@@ -21,6 +21,7 @@
 #include "sophos/sophos_server_runner.hpp"
 
 #include "sophos/sophos_server_runner_private.hpp"
+#include "utils/batched_reply_writer.hpp"
 
 #include <sse/schemes/utils/logger.hpp>
 #include <sse/schemes/utils/utils.hpp>
@@ -29,9 +30,11 @@
 
 #include <grpcpp/grpcpp.h>
 
+#include <algorithm>
 #include <atomic>
 #include <fstream>
 #include <thread>
+#include <vector>
 
 
 namespace sse {
@@ -170,14 +173,15 @@ grpc::Status SophosImpl::sync_search(
     }
 
     logger::logger()->trace("Start synchronous search...");
-    std::list<uint64_t> res_list;
 
     auto req = message_to_request(mes);
 
+    std::vector<uint64_t> res_list(req.add_count);
+
     {
         SearchBenchmark bench("Sophos synchronous search");
 
-        res_list = server_->search_parallel(req, 2);
+        server_->search_parallel(req, 2, res_list);
         bench.set_count(res_list.size());
     }
 
@@ -246,6 +250,58 @@ grpc::Status SophosImpl::async_search(
 }
 
 
+grpc::Status SophosImpl::batch_search(
+    __attribute__((unused)) grpc::ServerContext*    context,
+    const sophos::SearchRequestMessage*             mes,
+    grpc::ServerWriter<sophos::BatchedSearchReply>* writer)
+{
+    if (!server_) {
+        // problem, the server is already set up
+        return grpc::Status(grpc::FAILED_PRECONDITION,
+                            "The server is not set up");
+    }
+
+    logger::logger()->trace("Start search (batched replies)...");
+    auto req = message_to_request(mes);
+
+    // the replies are written by the batch writer's own thread
+    utility::BatchedReplyWriter<sophos::BatchedSearchReply> batch_writer(
+        writer, search_batch_size_);
+
+    auto post_callback
+        = [&batch_writer](index_type i) { batch_writer.push(i); };
+
+    {
+        SearchBenchmark bench("Sophos batched search");
+
+        if (!async_search_) {
+            std::vector<uint64_t> res_list(req.add_count);
+
+            server_->search_parallel(req, 2, res_list);
+            batch_writer.push(res_list.begin(), res_list.end());
+        } else if (mes->add_count() >= 40) {
+            server_->search_parallel_callback(
+                req, post_callback, std::thread::hardware_concurrency(), 8, 1);
+        } else if (mes->add_count() >= 2) {
+            server_->search_parallel_light_callback(
+                req, post_callback, std::thread::hardware_concurrency());
+        } else {
+            server_->search_callback(req, post_callback);
+        }
+        bench.set_count(batch_writer.finish());
+    }
+
+    if (batch_writer.failed()) {
+        logger::logger()->warn("Batched search: unable to write the replies");
+        return grpc::Status(grpc::UNAVAILABLE,
+                            "Unable to write the search replies");
+    }
+
+    logger::logger()->trace("Batched search done");
+
+    return grpc::Status::OK;
+}
+
 grpc::Status SophosImpl::insert(__attribute__((unused))
                                 grpc::ServerContext*                context,
                                 const sophos::UpdateRequestMessage* mes,
@@ -283,9 +339,23 @@ grpc::Status SophosImpl::bulk_insert(
 
     sophos::UpdateRequestMessage mes;
 
+    const size_t batch_size
+        = std::max<size_t>(bulk_write_options_.batch_size, 1);
+    std::vector<UpdateRequest> batch;
+    batch.reserve(batch_size);
+
     while (reader->Read(&mes)) {
-        server_->insert(message_to_request(&mes));
+        batch.push_back(message_to_request(&mes));
+
+        if (batch.size() >= batch_size) {
+            server_->insert(batch, bulk_write_options_.disable_wal);
+            batch.clear();
+        }
     }
+    if (!batch.empty()) {
+        server_->insert(batch, bulk_write_options_.disable_wal);
+    }
+    server_->sync_edb(bulk_write_options_.disable_wal);
 
     logger::logger()->trace("Updating (bulk)... done");
 
@@ -303,6 +373,26 @@ void SophosImpl::set_search_asynchronously(bool flag)
     async_search_ = flag;
 }
 
+size_t SophosImpl::search_batch_size() const
+{
+    return search_batch_size_;
+}
+
+void SophosImpl::set_search_batch_size(size_t batch_size)
+{
+    search_batch_size_ = batch_size;
+}
+
+const WriteBatchOptions& SophosImpl::bulk_write_options() const
+{
+    return bulk_write_options_;
+}
+
+void SophosImpl::set_bulk_write_options(const WriteBatchOptions& options)
+{
+    bulk_write_options_ = options;
+}
+
 SearchRequest message_to_request(const SearchRequestMessage* mes)
 {
     SearchRequest req;
@@ -365,6 +455,20 @@ void SophosServerRunner::set_async_search(bool flag)
     service_->set_search_asynchronously(flag);
 }
 
+void SophosServerRunner::set_search_batch_size(size_t batch_size)
+{
+    service_->set_search_batch_size(batch_size);
+}
+
+void SophosServerRunner::set_bulk_write_options(size_t batch_size, bool disable_wal)
+{
+    WriteBatchOptions options;
+    options.batch_size  = batch_size;
+    options.disable_wal = disable_wal;
+
+    service_->set_bulk_write_options(options);
+}
+
 void SophosServerRunner::wait()
 {
     server_->Wait();
@@ -39,6 +39,9 @@ namespace sophos {
 class SophosImpl final : public sophos::Sophos::Service
 {
 public:
+    // Default number of results sent in a single batched search reply
+    static constexpr size_t kDefaultSearchBatchSize = 1024;
+
     explicit SophosImpl(std::string path);
 
     grpc::Status setup(grpc::ServerContext*        context,
@@ -58,6 +61,11 @@ public:
                               const sophos::SearchRequestMessage*      mes,
                               grpc::ServerWriter<sophos::SearchReply>* writer);
 
+    grpc::Status batch_search(
+        grpc::ServerContext*                            context,
+        const sophos::SearchRequestMessage*             mes,
+        grpc::ServerWriter<sophos::BatchedSearchReply>* writer) override;
+
     grpc::Status insert(grpc::ServerContext*                context,
                         const sophos::UpdateRequestMessage* mes,
                         google::protobuf::Empty*            e) override;
@@ -70,6 +78,12 @@ public:
     bool search_asynchronously() const;
     void set_search_asynchronously(bool flag);
 
+    size_t search_batch_size() const;
+    void   set_search_batch_size(size_t batch_size);
+
+    const WriteBatchOptions& bulk_write_options() const;
+    void set_bulk_write_options(const WriteBatchOptions& options);
+
 
 private:
     static const char* pk_file;
@@ -81,6 +95,10 @@ private:
     std::mutex update_mtx_;
 
     bool async_search_;
+
+    size_t search_batch_size_{kDefaultSearchBatchSize};
+
+    WriteBatchOptions bulk_write_options_;
 };
 
 SearchRequest message_to_request(const SearchRequestMessage* mes);
@@ -0,0 +1,115 @@
+#include <sse/schemes/sophos/tdp_checkpoint_cache.hpp>
+
+#include <algorithm>
+
+namespace sse {
+namespace sophos {
+
+TdpCheckpointCache::TdpCheckpointCache(size_t interval, size_t max_checkpoints)
+    : interval_(std::max<size_t>(interval, 1)),
+      max_checkpoints_(max_checkpoints)
+{
+}
+
+void TdpCheckpointCache::touch(Entry& entry)
+{
+    lru_list_.splice(lru_list_.begin(), lru_list_, entry.lru_it);
+}
+
+void TdpCheckpointCache::evict()
+{
+    while (stats_.checkpoints_count > max_checkpoints_ && !lru_list_.empty()) {
+        auto it = entries_.find(lru_list_.back());
+
+        stats_.checkpoints_count -= it->second.checkpoints.size();
+        stats_.evicted_keywords++;
+
+        entries_.erase(it);
+        lru_list_.pop_back();
+    }
+}
+
+std::vector<TdpCheckpointCache::checkpoint_type> TdpCheckpointCache::lookup(
+    const key_type& key,
+    size_t          chain_length)
+{
+    std::vector<checkpoint_type> res;
+
+    std::lock_guard<std::mutex> lock(mtx_);
+    stats_.lookups++;
+
+    auto it = entries_.find(key);
+    if (it == entries_.end()) {
+        return res;
+    }
+    touch(it->second);
+
+    const auto& checkpoints = it->second.checkpoints;
+    for (auto cp_it = checkpoints.begin();
+         cp_it != checkpoints.end() && cp_it->first < chain_length;
+         ++cp_it) {
+        res.emplace_back(*cp_it);
+    }
+
+    if (!res.empty()) {
+        stats_.hits++;
+    }
+    return res;
+}
+
+void TdpCheckpointCache::insert(const key_type&              key,
+                                std::vector<checkpoint_type> checkpoints)
+{
+    if (checkpoints.empty() || max_checkpoints_ == 0) {
+        return;
+    }
+
+    std::sort(checkpoints.begin(),
+              checkpoints.end(),
+              [](const checkpoint_type& a, const checkpoint_type& b) {
+                  return a.first < b.first;
+              });
+
+    std::lock_guard<std::mutex> lock(mtx_);
+
+    auto it = entries_.find(key);
+    if (it == entries_.end()) {
+        lru_list_.push_front(key);
+        it                = entries_.emplace(key, Entry()).first;
+        it->second.lru_it = lru_list_.begin();
+    } else {
+        touch(it->second);
+    }
+
+    auto& entry_checkpoints = it->second.checkpoints;
+    for (auto& cp : checkpoints) {
+        // a keyword cannot hold more checkpoints than the whole cache: drop
+        // the most recent positions
+        if (entry_checkpoints.size() >= max_checkpoints_) {
+            break;
+        }
+        if (entry_checkpoints.insert(std::move(cp)).second) {
+            stats_.checkpoints_count++;
+        }
+    }
+
+    evict();
+}
+
+void TdpCheckpointCache::clear()
+{
+    std::lock_guard<std::mutex> lock(mtx_);
+
+    entries_.clear();
+    lru_list_.clear();
+    stats_.checkpoints_count = 0;
+}
+
+TdpCheckpointCache::Stats TdpCheckpointCache::stats() const
+{
+    std::lock_guard<std::mutex> lock(mtx_);
+    return stats_;
+}
+
+} // namespace sophos
+} // namespace sse
@@ -3,6 +3,7 @@
 #include <cmath>
 
 #include <stdexcept>
+#include <vector>
 
 namespace sse {
 namespace tethys {
@@ -63,7 +64,7 @@ void TethysAllocator::insert(TethysAllocatorKey key,
     allocation_graph.add_edge(index, list_length, key.h[0], key.h[1]);
 }
 
-void TethysAllocator::allocate()
+void TethysAllocator::allocate(MaxFlowAlgorithm algorithm, bool parallel)
 {
     if (allocated) {
         throw std::invalid_argument("The allocation algorithm was already run");
@@ -88,12 +89,18 @@ void TethysAllocator::allocate()
     // vertex, and e.capacity - e.flow - e.rec_flow elements to the stash.
 
 
-    // Step 1.: enumerate through the vertices
+    // Step 1.: enumerate through the vertices. The outdegrees are all
+    // computed before adding the new edges: adding an edge invalidates the
+    // graph's compressed adjacency, which would be rebuilt at every query.
 
+    std::vector<size_t> out_capacities(tethys_graph_size);
     for (size_t i = 0; i < tethys_graph_size; i++) {
-        VertexPtr v_ptr(i);
+        out_capacities[i]
+            = allocation_graph.get_vertex_out_capacity(VertexPtr(i));
+    }
 
-        size_t d = allocation_graph.get_vertex_out_capacity(v_ptr);
+    for (size_t i = 0; i < tethys_graph_size; i++) {
+        size_t d = out_capacities[i];
 
         if (d > page_size) {
             // Step 1.a.
@@ -106,12 +113,17 @@ void TethysAllocator::allocate()
         }
     }
 
-    // Step 2.: Compute max flow on the graph
-    allocation_graph.compute_residual_maxflow();
-    // allocation_graph.parallel_compute_residual_maxflow();
+    // Step 2.: Compute max flow on the graph. Any max flow gives an optimal
+    // allocation, so the algorithm only changes the running time.
+    if (parallel) {
+        allocation_graph.parallel_compute_residual_maxflow(
+            ThreadPool::global_thread_pool(), algorithm);
+    } else {
+        allocation_graph.compute_residual_maxflow(algorithm);
+    }
 
     // here, we should transform the residual maxflow graph, obtained from the
-    // Ford-Fulkerson algorithm to the real maxflow graph using the following
+    // maxflow algorithm to the real maxflow graph using the following
     // line: allocation_graph.transform_residual_to_flow();
 
     // But remember: in step 3. we must flip every edge that carries flow. This
@@ -129,10 +141,12 @@ void TethysAllocator::allocate()
     // to deal with overflowing bins.
 
     // go through the vertices
-    for (Vertex& v : allocation_graph.inner_vertices()) {
+    for (size_t i = 0; i < tethys_graph_size; i++) {
+        const VertexPtr v_ptr(i);
+
         size_t load = 0;
         // go through the incoming edges first
-        for (EdgePtr e_ptr : v.in_edges) {
+        for (EdgePtr e_ptr : allocation_graph.in_edges(v_ptr)) {
             Edge& e = allocation_graph.get_edge(e_ptr);
 
             // we are not interested in the edges whose one of the extremity is
@@ -153,7 +167,7 @@ void TethysAllocator::allocate()
             }
         }
         // and now through the outgoing edges
-        for (EdgePtr e_ptr : v.out_edges) {
+        for (EdgePtr e_ptr : allocation_graph.out_edges(v_ptr)) {
             Edge& e = allocation_graph.get_edge(e_ptr);
             // we are not interested in the edges whose one of the extremity is
             // the source or the sink
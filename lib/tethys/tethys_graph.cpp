@@ -5,9 +5,14 @@
 #include <cassert>
 #include <climits>
 
+#include <algorithm>
+#include <atomic>
 #include <deque>
+#include <future>
+#include <limits>
 #include <numeric>
 #include <stdexcept>
+#include <thread>
 
 namespace sse {
 namespace tethys {
@@ -64,9 +69,8 @@ EdgePtr TethysGraph::add_edge(size_t value_index,
     // add the edge and get the corresponding pointer
     EdgePtr e_ptr = edges.push_back(e);
 
-    // add the pointer to the new edge to its ingoing and outgoing vertices
-    vertices[e.start].out_edges.push_back(e_ptr);
-    vertices[e.end].in_edges.push_back(e_ptr);
+    // the adjacency will be rebuilt with the new edge
+    adjacency_compressed = false;
 
     return e_ptr;
 }
@@ -91,9 +95,8 @@ EdgePtr TethysGraph::add_edge_from_source(size_t value_index,
     // add the edge and get the corresponding pointer
     EdgePtr e_ptr = edges.push_back(e);
 
-    // add the pointer to the new edge to its ingoing and outgoing vertices
-    source.out_edges.push_back(e_ptr);
-    vertices[e.end].in_edges.push_back(e_ptr);
+    // the adjacency will be rebuilt with the new edge
+    adjacency_compressed = false;
 
     return e_ptr;
 }
@@ -120,13 +123,119 @@ EdgePtr TethysGraph::add_edge_to_sink(size_t value_index,
     // add the edge and get the corresponding pointer
     EdgePtr e_ptr = edges.push_back(e);
 
-    // add the pointer to the new edge to its ingoing and outgoing vertices
-    vertices[e.start].out_edges.push_back(e_ptr);
-    sink.in_edges.push_back(e_ptr);
+    // the adjacency will be rebuilt with the new edge
+    adjacency_compressed = false;
 
     return e_ptr;
 }
 
+template<class Index>
+static void build_compressed_adjacency(const EdgeVec&              edges,
+                                       size_t                      graph_size,
+                                       CompressedAdjacency<Index>& adjacency)
+{
+    // the source and the sink come after the graph's vertices
+    auto dense_index = [graph_size](VertexPtr ptr) -> size_t {
+        if (ptr == kSourcePtr) {
+            return graph_size;
+        }
+        if (ptr == kSinkPtr) {
+            return graph_size + 1;
+        }
+        return ptr.index;
+    };
+
+    const size_t n_slots = 2 * (graph_size + 2);
+
+    adjacency.offsets.assign(n_slots + 1, 0);
+    adjacency.edge_indices.resize(2 * edges.size());
+
+    // count the edges in every slot ...
+    for (const Edge& e : edges) {
+        adjacency.offsets[2 * dense_index(e.start) + 1]++;
+        adjacency.offsets[2 * dense_index(e.end) + 2]++;
+    }
+
+    // ... turn the counts into offsets ...
+    for (size_t slot = 0; slot < n_slots; slot++) {
+        adjacency.offsets[slot + 1] += adjacency.offsets[slot];
+    }
+
+    // ... and place the edges, in insertion order
+    std::vector<Index> cursors(adjacency.offsets.begin(),
+                               adjacency.offsets.end() - 1);
+
+    for (size_t i = 0; i < edges.size(); i++) {
+        const Edge& e = edges[EdgePtr(i)];
+
+        adjacency.edge_indices[cursors[2 * dense_index(e.start)]++] = i;
+        adjacency.edge_indices[cursors[2 * dense_index(e.end) + 1]++] = i;
+    }
+}
+
+void TethysGraph::compress_adjacency() const
+{
+    if (adjacency_compressed) {
+        return;
+    }
+
+    narrow_adjacency.clear();
+    wide_adjacency.clear();
+
+    // every edge appears twice in the adjacency
+    use_wide_adjacency
+        = (2 * edges.size() > std::numeric_limits<uint32_t>::max());
+
+    if (use_wide_adjacency) {
+        build_compressed_adjacency(edges, graph_size, wide_adjacency);
+    } else {
+        build_compressed_adjacency(edges, graph_size, narrow_adjacency);
+    }
+
+    adjacency_compressed = true;
+}
+
+EdgePtrRange TethysGraph::adjacency_range(size_t first_slot,
+                                          size_t last_slot,
+                                          size_t reciprocal_slot) const
+{
+    compress_adjacency();
+
+    if (use_wide_adjacency) {
+        const auto& offsets = wide_adjacency.offsets;
+        return EdgePtrRange(nullptr,
+                            wide_adjacency.edge_indices.data()
+                                + offsets[first_slot],
+                            offsets[last_slot] - offsets[first_slot],
+                            offsets[reciprocal_slot] - offsets[first_slot]);
+    }
+
+    const auto& offsets = narrow_adjacency.offsets;
+    return EdgePtrRange(narrow_adjacency.edge_indices.data()
+                            + offsets[first_slot],
+                        nullptr,
+                        offsets[last_slot] - offsets[first_slot],
+                        offsets[reciprocal_slot] - offsets[first_slot]);
+}
+
+EdgePtrRange TethysGraph::out_edges(VertexPtr ptr) const
+{
+    const size_t slot = 2 * vertex_index(ptr);
+    return adjacency_range(slot, slot + 1, slot + 1);
+}
+
+EdgePtrRange TethysGraph::in_edges(VertexPtr ptr) const
+{
+    const size_t slot = 2 * vertex_index(ptr) + 1;
+    return adjacency_range(slot, slot + 1, slot + 1);
+}
+
+EdgePtrRange TethysGraph::residual_edges(VertexPtr ptr) const
+{
+    const size_t slot = 2 * vertex_index(ptr);
+    return adjacency_range(slot, slot + 2, slot + 1);
+}
+
 void VertexVec::reset_parent_edges() const
 {
     for (const Vertex& v : *this) {
@@ -163,13 +272,10 @@ std::vector<EdgePtr> TethysGraph::find_source_sink_path(const size_t component,
 
         // get and pop the first element of the queue
         const VertexPtr v_ptr = queue.front();
-        const Vertex&   v     = get_vertex(v_ptr);
         queue.pop_front();
 
         // go through the outgoing edges of the selected vertex
-        const std::vector<EdgePtr>& out_edges = v.out_edges;
-
-        for (EdgePtr e_ptr : out_edges) {
+        for (EdgePtr e_ptr : out_edges(v_ptr)) {
             const Edge& e = edges[e_ptr];
             if (e.flow > 0) {
                 const VertexPtr dest_ptr = e.end;
@@ -202,8 +308,7 @@ std::vector<EdgePtr> TethysGraph::find_source_sink_path(const size_t component,
         }
 
         // we also need to do the same thing for the reciprocal graph
-        const std::vector<EdgePtr> in_edges = v.in_edges;
-        for (EdgePtr e_ptr : in_edges) {
+        for (EdgePtr e_ptr : in_edges(v_ptr)) {
             const Edge& e = edges[e_ptr];
             if (e.rec_flow > 0) {
                 const VertexPtr dest_ptr = e.start;
@@ -323,88 +428,163 @@ std::vector<EdgePtr> TethysGraph::find_source_sink_path(const size_t component,
     return {};
 }
 
-void TethysGraph::compute_connected_components()
+// Runs job(begin, end) on chunks of [0, count), spread over the thread pool,
+// and waits for their completion
+template<class F>
+static void parallel_chunks(ThreadPool& thread_pool, size_t count, F job)
 {
-    size_t component_index = 1;
-    size_t max_size        = 1;
-    for (size_t vi = 0; vi < vertices.size(); vi++) {
-        VertexPtr vp(vi);
-        if (vertices[vp].component != 0) {
-            continue;
-        }
-        size_t component_size  = 0;
-        vertices[vp].component = component_index;
-
-        std::deque<VertexPtr> queue;
-
-        queue.push_front(vp);
+    // a few chunks per thread, to balance the load
+    const size_t n_chunks
+        = 4 * std::max<size_t>(std::thread::hardware_concurrency(), 1);
+    const size_t chunk_size
+        = std::max<size_t>((count + n_chunks - 1) / n_chunks, 1);
 
-        while (!queue.empty()) {
-            const Vertex& v = get_vertex(queue.front());
-            queue.pop_front();
-            component_size++;
+    std::vector<std::future<void>> jobs;
+    for (size_t begin = 0; begin < count; begin += chunk_size) {
+        const size_t end = std::min(begin + chunk_size, count);
+        jobs.push_back(
+            thread_pool.enqueue([&job, begin, end]() { job(begin, end); }));
+    }
 
-            // go through the outgoing edges of the selected vertex
-            const std::vector<EdgePtr>& out_edges = v.out_edges;
+    for (auto& j : jobs) {
+        j.get();
+    }
+}
 
-            for (EdgePtr e_ptr : out_edges) {
-                const Edge&     e        = edges[e_ptr];
-                const VertexPtr dest_ptr = e.end;
+// Lock-free union-find: find() halves the paths, and unite() always links the
+// root with the largest index below the other one, so that concurrent links
+// can never create a cycle.
+static size_t union_find_root(std::vector<std::atomic_size_t>& parents,
+                              size_t                           v)
+{
+    while (true) {
+        size_t parent = parents[v].load(std::memory_order_relaxed);
+        if (parent == v) {
+            return v;
+        }
+        size_t grand_parent = parents[parent].load(std::memory_order_relaxed);
+        if (parent != grand_parent) {
+            // path halving: losing the race is harmless
+            parents[v].compare_exchange_weak(
+                parent, grand_parent, std::memory_order_relaxed);
+        }
+        v = grand_parent;
+    }
+}
 
-                if (dest_ptr == kSinkPtr || dest_ptr == kSourcePtr) {
-                    continue;
-                }
+static void union_find_unite(std::vector<std::atomic_size_t>& parents,
+                             size_t                           a,
+                             size_t                           b)
+{
+    while (true) {
+        a = union_find_root(parents, a);
+        b = union_find_root(parents, b);
 
-                Vertex& dest = get_vertex(dest_ptr);
+        if (a == b) {
+            return;
+        }
+        if (a < b) {
+            std::swap(a, b);
+        }
+        // link a below b, if a is still a root
+        size_t expected = a;
+        if (parents[a].compare_exchange_strong(
+                expected, b, std::memory_order_relaxed)) {
+            return;
+        }
+    }
+}
 
-                if (dest.component == 0) {
-                    // TODO : add a flag to choose between DFS and BFS
-                    // DFS for now
-                    queue.push_front(dest_ptr);
-                    dest.component = component_index;
-                }
-            }
+void TethysGraph::compute_connected_components(ThreadPool& thread_pool)
+{
+    std::vector<std::atomic_size_t> parents(graph_size);
 
-            // we also need to do the same thing for the reciprocal graph
-            const std::vector<EdgePtr> in_edges = v.in_edges;
-            for (EdgePtr e_ptr : in_edges) {
-                const Edge&     e        = edges[e_ptr];
-                const VertexPtr dest_ptr = e.start;
+    parallel_chunks(thread_pool, graph_size, [&](size_t begin, size_t end) {
+        for (size_t v = begin; v < end; v++) {
+            parents[v].store(v, std::memory_order_relaxed);
+        }
+    });
 
-                if (dest_ptr == kSinkPtr || dest_ptr == kSourcePtr) {
-                    continue;
-                }
+    // merge the extremities of every edge not linked to the source or the
+    // sink
+    parallel_chunks(thread_pool, edges.size(), [&](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; i++) {
+            const Edge& e = edges[EdgePtr(i)];
 
-                Vertex& dest = get_vertex(dest_ptr);
-                if (dest.component == 0) {
-                    // TODO : add a flag to choose between DFS and BFS
-                    // DFS for now
-                    queue.push_front(dest_ptr);
-                    dest.component = component_index;
-                }
+            if (e.start == kSourcePtr || e.end == kSinkPtr) {
+                continue;
             }
+            union_find_unite(parents, e.start.index, e.end.index);
+        }
+    });
+
+    // flatten the trees: every vertex points to its root
+    parallel_chunks(thread_pool, graph_size, [&](size_t begin, size_t end) {
+        for (size_t v = begin; v < end; v++) {
+            parents[v].store(union_find_root(parents, v),
+                             std::memory_order_relaxed);
         }
-        if (component_size == 1) {
-            vertices[vp].component = 0;
+    });
+
+    // number the components with more than one vertex from 1, in the order
+    // of their smallest vertex (their root), and put the isolated vertices in
+    // component 0
+    std::vector<size_t> component_indices(graph_size, 0);
+    for (size_t v = 0; v < graph_size; v++) {
+        component_indices[parents[v].load(std::memory_order_relaxed)]++;
+    }
+
+    size_t component_index = 1;
+    size_t max_size        = 1;
+    for (size_t v = 0; v < graph_size; v++) {
+        // only the roots have a non-zero count
+        const size_t size = component_indices[v];
+        if (size > 1) {
+            max_size             = std::max(max_size, size);
+            component_indices[v] = component_index++;
         } else {
-            // std::cout << component_size << "\n";
-            max_size = std::max(max_size, component_size);
-            component_index++;
+            component_indices[v] = 0;
         }
     }
 
+    parallel_chunks(thread_pool, graph_size, [&](size_t begin, size_t end) {
+        for (size_t v = begin; v < end; v++) {
+            const size_t root = parents[v].load(std::memory_order_relaxed);
+            vertices[VertexPtr(v)].component = component_indices[root];
+        }
+    });
+
     n_components = component_index - 1;
-    std::cout << n_components << "\n";
-    std::cout << max_size << "\n";
+
+    logger::logger()->info("{} connected components, the largest has {} "
+                           "vertices",
+                           n_components,
+                           max_size);
 }
 
-void TethysGraph::compute_residual_maxflow()
+void TethysGraph::compute_residual_maxflow(MaxFlowAlgorithm algorithm)
 {
     if (state != Building) {
         throw std::invalid_argument(
             "Invalid inner state. State should be Building.");
     }
 
+    switch (algorithm) {
+    case FordFulkerson:
+        ford_fulkerson_residual_maxflow();
+        break;
+    case Dinic:
+        dinic_residual_maxflow();
+        break;
+    default:
+        throw std::invalid_argument("Unknown maxflow algorithm");
+    }
+
+    state = ResidualComputed;
+}
+
+void TethysGraph::ford_fulkerson_residual_maxflow()
+{
     size_t computed_capacity = 0;
     size_t it                = 0;
 
@@ -438,31 +618,356 @@ void TethysGraph::compute_residual_maxflow()
         "maxflow computation completed: {} iterations, computed capacity: {}",
         it,
         computed_capacity);
+}
 
-    state = ResidualComputed;
+constexpr size_t TethysGraph::kMaxFlowBatchVerticesCount;
+
+// level of the vertices not reachable from the source
+static constexpr size_t kUnreachedLevel = ~0UL;
+
+void TethysGraph::dinic_residual_maxflow()
+{
+    // the whole graph is a single scope
+    std::vector<VertexPtr> scope(graph_size);
+    for (size_t i = 0; i < graph_size; i++) {
+        scope[i] = VertexPtr(i);
+    }
+
+    std::vector<size_t> levels(graph_size);
+    std::vector<size_t> current_edges(graph_size);
+    DinicWorkspace      workspace;
+
+    size_t phases            = 0;
+    size_t computed_capacity = dinic_maxflow(scope.data(),
+                                             scope.data() + scope.size(),
+                                             levels,
+                                             current_edges,
+                                             workspace,
+                                             phases);
+
+    logger::logger()->info("dinic maxflow computation completed: {} phases, "
+                           "computed capacity: {}",
+                           phases,
+                           computed_capacity);
+}
+
+size_t TethysGraph::dinic_maxflow(const VertexPtr*     first,
+                                  const VertexPtr*     last,
+                                  std::vector<size_t>& levels,
+                                  std::vector<size_t>& current_edges,
+                                  DinicWorkspace&      workspace,
+                                  size_t&              phases)
+{
+    // the edges from the source to the scope
+    workspace.source_edges.clear();
+    for (const VertexPtr* v = first; v != last; ++v) {
+        for (EdgePtr e_ptr : in_edges(*v)) {
+            if (edges[e_ptr].start == kSourcePtr) {
+                workspace.source_edges.push_back(e_ptr);
+            }
+        }
+    }
+
+    size_t flow       = 0;
+    size_t sink_level = kUnreachedLevel;
+
+    while (dinic_compute_levels(first, last, levels, workspace, sink_level)) {
+        flow += dinic_blocking_flow(
+            first, last, levels, sink_level, current_edges, workspace);
+        phases++;
+
+        if ((phases % 10) == 0) {
+            logger::logger()->info(
+                "dinic maxflow computation: {} phases, computed capacity: {}",
+                phases,
+                flow);
+        }
+    }
+
+    return flow;
 }
 
-void TethysGraph::parallel_compute_residual_maxflow(ThreadPool& thread_pool)
+// Computes the BFS distance from the source of every vertex of the scope in
+// the residual graph. Returns false if the sink is not reachable anymore.
+bool TethysGraph::dinic_compute_levels(const VertexPtr*     first,
+                                       const VertexPtr*     last,
+                                       std::vector<size_t>& levels,
+                                       DinicWorkspace&      workspace,
+                                       size_t&              sink_level) const
+{
+    for (const VertexPtr* v = first; v != last; ++v) {
+        levels[v->index] = kUnreachedLevel;
+    }
+    sink_level = kUnreachedLevel;
+
+    // the source is at level 0
+    std::vector<VertexPtr>& queue = workspace.queue;
+    queue.clear();
+
+    for (EdgePtr e_ptr : workspace.source_edges) {
+        const Edge& e = edges[e_ptr];
+        if (e.flow > 0 && levels[e.end.index] == kUnreachedLevel) {
+            levels[e.end.index] = 1;
+            queue.push_back(e.end);
+        }
+    }
+
+    for (size_t head = 0; head < queue.size(); head++) {
+        const VertexPtr v_ptr   = queue[head];
+        const size_t    v_level = levels[v_ptr.index];
+
+        if (v_level >= sink_level) {
+            // the vertices further than the sink are not on a shortest path
+            break;
+        }
+
+        for (EdgePtr e_ptr : residual_edges(v_ptr)) {
+            if (edges.edge_flow(e_ptr) == 0) {
+                continue;
+            }
+
+            const VertexPtr dest_ptr = residual_edge_end(e_ptr);
+
+            if (dest_ptr == kSourcePtr) {
+                continue;
+            }
+            if (dest_ptr == kSinkPtr) {
+                sink_level = std::min(sink_level, v_level + 1);
+                continue;
+            }
+
+            size_t& dest_level = levels[dest_ptr.index];
+            if (dest_level == kUnreachedLevel) {
+                dest_level = v_level + 1;
+                queue.push_back(dest_ptr);
+            }
+        }
+    }
+
+    return sink_level != kUnreachedLevel;
+}
+
+// Saturates every shortest source-sink path of the level graph, and returns
+// the added flow. The paths are explored with an iterative DFS which only
+// follows the edges going up one level. Each vertex keeps the position of
+// the first of its edges that might still lead to the sink: an edge is never
+// looked at twice in a phase, except the ones carrying an augmenting path.
+size_t TethysGraph::dinic_blocking_flow(
+    const VertexPtr*           first,
+    const VertexPtr*           last,
+    const std::vector<size_t>& levels,
+    size_t                     sink_level,
+    std::vector<size_t>&       current_edges,
+    DinicWorkspace&            workspace)
+{
+    for (const VertexPtr* v = first; v != last; ++v) {
+        current_edges[v->index] = 0;
+    }
+
+    // the source's current edge
+    size_t source_current = 0;
+
+    const std::vector<EdgePtr>& source_edges = workspace.source_edges;
+    std::vector<EdgePtr>&       path         = workspace.path;
+    path.clear();
+
+    auto level = [&](VertexPtr ptr) -> size_t {
+        if (ptr == kSinkPtr) {
+            return sink_level;
+        }
+        if (ptr == kSourcePtr) {
+            return 0;
+        }
+        return levels[ptr.index];
+    };
+
+    // an edge of the level graph, with some residual capacity left
+    auto admissible = [&](EdgePtr e_ptr, size_t next_level) {
+        return edges.edge_flow(e_ptr) > 0
+               && level(residual_edge_end(e_ptr)) == next_level;
+    };
+
+    size_t    total_flow = 0;
+    VertexPtr u_ptr      = kSourcePtr;
+
+    while (true) {
+        if (u_ptr == kSinkPtr) {
+            // augment the flow along the path
+            size_t flow = SIZE_MAX;
+            for (EdgePtr e_ptr : path) {
+                flow = std::min<size_t>(edges.edge_flow(e_ptr), flow);
+            }
+
+            size_t first_saturated = path.size();
+            for (size_t i = 0; i < path.size(); i++) {
+                edges.update_flow(path[i], flow);
+
+                if (first_saturated == path.size()
+                    && edges.edge_flow(path[i]) == 0) {
+                    first_saturated = i;
+                }
+            }
+            total_flow += flow;
+
+            // resume the search from the start of the first saturated edge
+            u_ptr = residual_edge_start(path[first_saturated]);
+            path.resize(first_saturated);
+            continue;
+        }
+
+        // find the next admissible edge leaving u
+        EdgePtr e_ptr = kNullEdgePtr;
+
+        if (u_ptr == kSourcePtr) {
+            for (; source_current < source_edges.size(); source_current++) {
+                if (admissible(source_edges[source_current], 1)) {
+                    e_ptr = source_edges[source_current];
+                    break;
+                }
+            }
+        } else {
+            const EdgePtrRange u_edges    = residual_edges(u_ptr);
+            const size_t       next_level = levels[u_ptr.index] + 1;
+            size_t&            current    = current_edges[u_ptr.index];
+
+            for (; current < u_edges.size(); current++) {
+                if (admissible(u_edges[current], next_level)) {
+                    e_ptr = u_edges[current];
+                    break;
+                }
+            }
+        }
+
+        if (e_ptr != kNullEdgePtr) {
+            // advance
+            path.push_back(e_ptr);
+            u_ptr = residual_edge_end(e_ptr);
+        } else if (u_ptr == kSourcePtr) {
+            // the source is exhausted
+            break;
+        } else {
+            // dead end: retreat, and skip the edge leading here
+            u_ptr = residual_edge_start(path.back());
+            path.pop_back();
+
+            if (u_ptr == kSourcePtr) {
+                source_current++;
+            } else {
+                current_edges[u_ptr.index]++;
+            }
+        }
+    }
+
+    return total_flow;
+}
+
+void TethysGraph::parallel_compute_residual_maxflow(
+    ThreadPool&      thread_pool,
+    MaxFlowAlgorithm algorithm)
 {
     if (state != Building) {
         throw std::invalid_argument(
             "Invalid inner state. State should be Building.");
     }
 
-    compute_connected_components();
+    compute_connected_components(thread_pool);
 
-    std::vector<std::future<void>> jobs;
+    // the jobs read the adjacency concurrently
+    compress_adjacency();
 
-    std::cout << "Spawning " << n_components + 1 << " jobs\n";
+    // Sort the components by decreasing size (the isolated vertices of
+    // component 0 included) ...
+    std::vector<size_t> component_sizes(n_components + 1, 0);
+    for (const Vertex& v : vertices) {
+        component_sizes[v.component]++;
+    }
 
-    jobs.reserve(n_components + 1);
+    std::vector<size_t> components(n_components + 1);
+    std::iota(components.begin(), components.end(), 0);
+    std::stable_sort(components.begin(),
+                     components.end(),
+                     [&component_sizes](size_t a, size_t b) {
+                         return component_sizes[a] > component_sizes[b];
+                     });
+
+    // ... and lay their vertices out contiguously, in this order
+    std::vector<size_t> component_offsets(n_components + 1);
+    size_t              offset = 0;
+    for (size_t c : components) {
+        component_offsets[c] = offset;
+        offset += component_sizes[c];
+    }
+
+    std::vector<VertexPtr> sorted_vertices(graph_size);
+    {
+        std::vector<size_t> cursors(component_offsets);
+        for (size_t v = 0; v < graph_size; v++) {
+            sorted_vertices[cursors[vertices[VertexPtr(v)].component]++]
+                = VertexPtr(v);
+        }
+    }
+
+    // Group the small components in batches of at least
+    // kMaxFlowBatchVerticesCount vertices. As the jobs are queued
+    // largest-first, the small batches fill the gaps left by the large ones.
+    struct MaxFlowBatch
+    {
+        size_t first_component; // position in components
+        size_t last_component;  // position in components, excluded
+    };
+
+    std::vector<MaxFlowBatch> batches;
+    size_t                    batch_size = 0;
+    for (size_t i = 0; i < components.size(); i++) {
+        if (batch_size == 0) {
+            batches.push_back(MaxFlowBatch{i, i + 1});
+        } else {
+            batches.back().last_component = i + 1;
+        }
+        batch_size += component_sizes[components[i]];
+
+        if (batch_size >= kMaxFlowBatchVerticesCount) {
+            batch_size = 0;
+        }
+    }
+
+    logger::logger()->info("Spawning {} maxflow jobs for {} components",
+                           batches.size(),
+                           n_components + 1);
 
     std::atomic_size_t computed_capacity{0};
     std::atomic_size_t it{0};
 
-    for (size_t component_index = 0; component_index <= n_components;
-         component_index++) {
-        auto job = [&, component_index]() {
+    // Shared by the Dinic jobs: they never access the same entries, as they
+    // work on disjoint sets of vertices
+    std::vector<size_t> levels;
+    std::vector<size_t> current_edges;
+    if (algorithm == Dinic) {
+        levels.resize(graph_size);
+        current_edges.resize(graph_size);
+    }
+
+    auto dinic_job = [&](const MaxFlowBatch& batch) {
+        const size_t first_c = components[batch.first_component];
+        const size_t last_c  = components[batch.last_component - 1];
+
+        const VertexPtr* first
+            = sorted_vertices.data() + component_offsets[first_c];
+        const VertexPtr* last = sorted_vertices.data()
+                                + component_offsets[last_c]
+                                + component_sizes[last_c];
+
+        DinicWorkspace workspace;
+        size_t         phases = 0;
+        computed_capacity += dinic_maxflow(
+            first, last, levels, current_edges, workspace, phases);
+        it += phases;
+    };
+
+    auto ford_fulkerson_job = [&](const MaxFlowBatch& batch) {
+        for (size_t i = batch.first_component; i < batch.last_component; i++) {
+            const size_t component_index = components[i];
+
             while (true) {
                 // find a path from source to sink
                 size_t path_capacity;
@@ -488,14 +993,21 @@ void TethysGraph::parallel_compute_residual_maxflow(ThreadPool& thread_pool)
                                            computed_capacity);
                 }
             }
-        };
-        std::future<void> job_fut = thread_pool.enqueue(job);
-        // job_fut.get();
+        }
+    };
 
-        jobs.push_back(std::move(job_fut));
-    }
+    std::vector<std::future<void>> jobs;
+    jobs.reserve(batches.size());
 
-    std::cout << "Wait for jobs completion\n";
+    for (const MaxFlowBatch& batch : batches) {
+        if (algorithm == Dinic) {
+            jobs.push_back(thread_pool.enqueue(
+                [&dinic_job, batch]() { dinic_job(batch); }));
+        } else {
+            jobs.push_back(thread_pool.enqueue(
+                [&ford_fulkerson_job, batch]() { ford_fulkerson_job(batch); }));
+        }
+    }
 
     // wait for completion of the jobs
     for (auto& j : jobs) {
@@ -507,8 +1019,6 @@ void TethysGraph::parallel_compute_residual_maxflow(ThreadPool& thread_pool)
                            it,
                            computed_capacity);
 
-    std::cout << "Maxflow jobs completed\n";
-
     state = ResidualComputed;
 }
 
@@ -534,7 +1044,7 @@ size_t TethysGraph::get_flow() const
     }
 
     size_t flow = 0;
-    for (const EdgePtr e_ptr : source.out_edges) {
+    for (const EdgePtr e_ptr : out_edges(kSourcePtr)) {
         // cppcheck-suppress useStlAlgorithm
         flow += edges[e_ptr].flow;
     }
@@ -560,22 +1070,22 @@ size_t TethysGraph::get_edge_flow(EdgePtr e_ptr) const
 
 size_t TethysGraph::get_vertex_in_capacity(VertexPtr v_ptr) const
 {
-    const Vertex& v = get_vertex(v_ptr);
+    const EdgePtrRange v_edges = in_edges(v_ptr);
 
     return std::accumulate(
-        v.in_edges.begin(),
-        v.in_edges.end(),
+        v_edges.begin(),
+        v_edges.end(),
         0UL,
         [&](size_t acc, EdgePtr e_ptr) { return acc + edges[e_ptr].capacity; });
 }
 
 size_t TethysGraph::get_vertex_out_capacity(VertexPtr v_ptr) const
 {
-    const Vertex& v = get_vertex(v_ptr);
+    const EdgePtrRange v_edges = out_edges(v_ptr);
 
     return std::accumulate(
-        v.out_edges.begin(),
-        v.out_edges.end(),
+        v_edges.begin(),
+        v_edges.end(),
         0UL,
         [&](size_t acc, EdgePtr e_ptr) { return acc + edges[e_ptr].capacity; });
 }
@@ -587,11 +1097,11 @@ size_t TethysGraph::get_vertex_in_flow(VertexPtr v_ptr) const
             "Invalid inner state. State should be MaxFlowComputed.");
     }
 
-    const Vertex& v = get_vertex(v_ptr);
+    const EdgePtrRange v_edges = in_edges(v_ptr);
 
     return std::accumulate(
-        v.in_edges.begin(),
-        v.in_edges.end(),
+        v_edges.begin(),
+        v_edges.end(),
         0UL,
         [&](size_t acc, EdgePtr e_ptr) { return acc + edges[e_ptr].flow; });
 }
@@ -603,11 +1113,11 @@ size_t TethysGraph::get_vertex_out_flow(VertexPtr v_ptr) const
             "Invalid inner state. State should be MaxFlowComputed.");
     }
 
-    const Vertex& v = get_vertex(v_ptr);
+    const EdgePtrRange v_edges = out_edges(v_ptr);
 
     return std::accumulate(
-        v.out_edges.begin(),
-        v.out_edges.end(),
+        v_edges.begin(),
+        v_edges.end(),
         0UL,
         [&](size_t acc, EdgePtr e_ptr) { return acc + edges[e_ptr].flow; });
 }
@@ -0,0 +1,227 @@
+#pragma once
+
+#include <grpcpp/grpcpp.h>
+#include <grpcpp/support/sync_stream.h>
+
+#include <cstdint>
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+namespace sse {
+namespace utility {
+
+// Coalesce search results into batched reply messages, and write these
+// messages on the gRPC stream from a dedicated thread, so that the search
+// threads only wait for the network when the queue of sealed batches is
+// full. Once a write fails (e.g. the client went away), the following
+// results are dropped and failed() returns true.
+// Single results are first staged in a buffer owned by the calling thread,
+// and handed over by chunks of batch_size: the producers do not contend on
+// the writer's lock for every result.
+// Reply must be a protobuf message with a repeated results field.
+template<class Reply>
+class BatchedReplyWriter
+{
+public:
+    static constexpr size_t kDefaultMaxQueuedBatches = 16;
+
+    BatchedReplyWriter(grpc::ServerWriter<Reply>* writer,
+                       size_t                     batch_size,
+                       size_t max_queued_batches = kDefaultMaxQueuedBatches)
+        : writer_(writer), batch_size_(std::max<size_t>(batch_size, 1)),
+          max_queued_batches_(std::max<size_t>(max_queued_batches, 1)),
+          id_(next_id()), writer_thread_(&BatchedReplyWriter::writer_loop, this)
+    {
+    }
+
+    BatchedReplyWriter(const BatchedReplyWriter&) = delete;
+    BatchedReplyWriter& operator=(const BatchedReplyWriter&) = delete;
+
+    ~BatchedReplyWriter()
+    {
+        finish();
+    }
+
+    // Can be called concurrently. Blocks while the queue is full.
+    void push(uint64_t result)
+    {
+        std::vector<uint64_t>& staging = local_staging_buffer();
+
+        staging.push_back(result);
+        if (staging.size() >= batch_size_) {
+            push(staging.begin(), staging.end());
+            staging.clear();
+        }
+    }
+
+    template<class InputIt>
+    void push(InputIt first, InputIt last)
+    {
+        std::unique_lock<std::mutex> lock(mtx_);
+        for (; first != last && !failed_; ++first) {
+            push_locked(lock, *first);
+        }
+    }
+
+    // Send the staged results and the last (incomplete) batch, and wait for
+    // all the messages to be written. Must only be called once the producers
+    // are done. Returns the total number of results pushed.
+    size_t finish()
+    {
+        {
+            std::lock_guard<std::mutex> staging_lock(staging_mtx_);
+            for (auto& entry : staging_) {
+                std::vector<uint64_t>& staging = *entry.second;
+                push(staging.begin(), staging.end());
+                staging.clear();
+            }
+        }
+        {
+            std::lock_guard<std::mutex> lock(mtx_);
+            if (!finished_) {
+                if (!failed_ && current_.results_size() > 0) {
+                    seal_current_batch();
+                }
+                finished_ = true;
+            }
+        }
+        cv_.notify_one();
+        if (writer_thread_.joinable()) {
+            writer_thread_.join();
+        }
+        return results_count_;
+    }
+
+    // True if a message could not be written on the stream
+    bool failed()
+    {
+        std::lock_guard<std::mutex> lock(mtx_);
+        return failed_;
+    }
+
+private:
+    static uint64_t next_id()
+    {
+        static std::atomic<uint64_t> next{1};
+        return next.fetch_add(1);
+    }
+
+    // Staging buffer of the calling thread. The thread caches the buffer of
+    // the last writer it pushed to, so that staging_mtx_ is only taken when
+    // it switches writers.
+    std::vector<uint64_t>& local_staging_buffer()
+    {
+        thread_local uint64_t               cached_id     = 0;
+        thread_local std::vector<uint64_t>* cached_buffer = nullptr;
+
+        if (cached_id != id_) {
+            std::lock_guard<std::mutex> lock(staging_mtx_);
+
+            std::unique_ptr<std::vector<uint64_t>>& buffer
+                = staging_[std::this_thread::get_id()];
+            if (!buffer) {
+                buffer.reset(new std::vector<uint64_t>());
+                buffer->reserve(batch_size_);
+            }
+            cached_id     = id_;
+            cached_buffer = buffer.get();
+        }
+        return *cached_buffer;
+    }
+
+    void push_locked(std::unique_lock<std::mutex>& lock, uint64_t result)
+    {
+        space_cv_.wait(lock, [this] {
+            return failed_ || ready_.size() < max_queued_batches_;
+        });
+        if (failed_) {
+            return;
+        }
+
+        current_.add_results(result);
+        results_count_++;
+
+        if (static_cast<size_t>(current_.results_size()) >= batch_size_) {
+            seal_current_batch();
+            cv_.notify_one();
+        }
+    }
+
+    // must be called with mtx_ held
+    void seal_current_batch()
+    {
+        ready_.emplace_back();
+        ready_.back().Swap(&current_);
+    }
+
+    void writer_loop()
+    {
+        std::unique_lock<std::mutex> lock(mtx_);
+        for (;;) {
+            cv_.wait(lock, [this] { return finished_ || !ready_.empty(); });
+
+            while (!ready_.empty()) {
+                Reply batch;
+                batch.Swap(&ready_.front());
+                ready_.pop_front();
+
+                space_cv_.notify_all();
+
+                lock.unlock();
+                bool success = writer_->Write(batch);
+                lock.lock();
+
+                if (!success) {
+                    // the stream is broken: unblock the producers and drop
+                    // everything that comes next
+                    failed_ = true;
+                    ready_.clear();
+                    space_cv_.notify_all();
+                    return;
+                }
+            }
+
+            if (finished_) {
+                return;
+            }
+        }
+    }
+
+    grpc::ServerWriter<Reply>* writer_;
+    const size_t               batch_size_;
+    const size_t               max_queued_batches_;
+
+    std::mutex              mtx_;
+    std::condition_variable cv_;
+    std::condition_variable space_cv_;
+    Reply                   current_;
+    std::deque<Reply>       ready_;
+    size_t                  results_count_{0};
+    bool                    finished_{false};
+    bool                    failed_{false};
+
+    // unique among the writers, so that a cached staging buffer is never
+    // mistaken for the one of a new writer
+    const uint64_t id_;
+    std::mutex     staging_mtx_;
+    std::unordered_map<std::thread::id, std::unique_ptr<std::vector<uint64_t>>>
+        staging_;
+
+    // declared last, so that it is started after every other member is
+    // initialized
+    std::thread writer_thread_;
+};
+
+template<class Reply>
+constexpr size_t BatchedReplyWriter<Reply>::kDefaultMaxQueuedBatches;
+
+} // namespace utility
+} // namespace sse
@@ -0,0 +1,161 @@
+#include <sse/schemes/utils/range_executor.hpp>
+
+#include <cassert>
+
+#include <algorithm>
+
+namespace sse {
+namespace utility {
+
+struct RangeExecutor::Task
+{
+    Task(size_t c, size_t cs, const range_job_type& j)
+        : count(c), chunk_size(cs), chunks_count((c + cs - 1) / cs), job(j),
+          remaining_chunks(chunks_count)
+    {
+    }
+
+    const size_t          count;
+    const size_t          chunk_size;
+    const size_t          chunks_count;
+    const range_job_type& job;
+
+    std::atomic<size_t> next_chunk{0};
+    std::atomic<size_t> remaining_chunks;
+
+    // protect the exception pointer and the completion notification
+    std::mutex              mtx;
+    std::condition_variable cv;
+    std::exception_ptr      exception;
+};
+
+RangeExecutor::RangeExecutor(unsigned threads_count)
+{
+    workers_.reserve(threads_count);
+    for (unsigned i = 0; i < threads_count; i++) {
+        workers_.emplace_back(&RangeExecutor::worker_loop, this);
+    }
+}
+
+RangeExecutor::~RangeExecutor()
+{
+    {
+        std::lock_guard<std::mutex> lock(queue_mtx_);
+        stop_ = true;
+    }
+    queue_cv_.notify_all();
+    for (std::thread& worker : workers_) {
+        if (worker.joinable()) {
+            worker.join();
+        }
+    }
+}
+
+RangeExecutor& RangeExecutor::global_executor()
+{
+    static RangeExecutor executor(std::thread::hardware_concurrency());
+
+    return executor;
+}
+
+bool RangeExecutor::process_chunk(Task& task, uint8_t slot)
+{
+    const size_t chunk = task.next_chunk.fetch_add(1);
+    if (chunk >= task.chunks_count) {
+        // do not touch the job: the task might already be completed, and the
+        // job destroyed
+        return false;
+    }
+
+    const size_t min = chunk * task.chunk_size;
+    const size_t max = std::min(min + task.chunk_size, task.count) - 1;
+
+    try {
+        task.job(slot, min, max);
+    } catch (...) {
+        std::lock_guard<std::mutex> lock(task.mtx);
+        if (!task.exception) {
+            task.exception = std::current_exception();
+        }
+    }
+
+    if (task.remaining_chunks.fetch_sub(1) == 1) {
+        // last chunk: wake up the caller of run()
+        std::lock_guard<std::mutex> lock(task.mtx);
+        task.cv.notify_all();
+    }
+    return true;
+}
+
+void RangeExecutor::worker_loop()
+{
+    for (;;) {
+        Ticket ticket;
+        {
+            std::unique_lock<std::mutex> lock(queue_mtx_);
+            queue_cv_.wait(lock,
+                           [this] { return stop_ || !tickets_.empty(); });
+            if (stop_ && tickets_.empty()) {
+                return;
+            }
+            ticket = std::move(tickets_.front());
+            tickets_.pop_front();
+        }
+
+        while (process_chunk(*ticket.task, ticket.slot)) {
+            // give way to the jobs waiting for a worker
+            std::lock_guard<std::mutex> lock(queue_mtx_);
+            if (!tickets_.empty()) {
+                tickets_.push_back(std::move(ticket));
+                break;
+            }
+        }
+    }
+}
+
+void RangeExecutor::run(size_t                count,
+                        size_t                chunk_size,
+                        uint8_t               max_participants,
+                        const range_job_type& job)
+{
+    assert(chunk_size > 0);
+    assert(max_participants > 0);
+
+    if (count == 0) {
+        return;
+    }
+    chunk_size = std::max<size_t>(chunk_size, 1);
+
+    auto task = std::make_shared<Task>(count, chunk_size, job);
+
+    // the calling thread uses the slot 0
+    const size_t helpers_count
+        = std::min<size_t>({std::max<size_t>(max_participants, 1),
+                            workers_.size() + 1,
+                            task->chunks_count})
+          - 1;
+
+    if (helpers_count > 0) {
+        {
+            std::lock_guard<std::mutex> lock(queue_mtx_);
+            for (size_t s = 1; s <= helpers_count; s++) {
+                tickets_.push_back(Ticket{task, static_cast<uint8_t>(s)});
+            }
+        }
+        queue_cv_.notify_all();
+    }
+
+    while (process_chunk(*task, 0)) {
+    }
+
+    std::unique_lock<std::mutex> lock(task->mtx);
+    task->cv.wait(lock,
+                  [&task] { return task->remaining_chunks.load() == 0; });
+
+    if (task->exception) {
+        std::rethrow_exception(task->exception);
+    }
+}
+
+} // namespace utility
+} // namespace sse
@@ -20,15 +20,148 @@
 
 #include <sse/schemes/utils/rocksdb_wrapper.hpp>
 
+#include <rocksdb/merge_operator.h>
+
+#include <array>
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+
 namespace sse {
 namespace sophos {
 
+namespace {
+// Merge operator adding 32 bits increments to a counter. A missing counter
+// is considered to be equal to -1, so that its first increment sets it to 0
+// (as get_and_increment does).
+class CounterIncrementOperator : public rocksdb::AssociativeMergeOperator
+{
+public:
+    bool Merge(const rocksdb::Slice& /*key*/,
+               const rocksdb::Slice* existing_value,
+               const rocksdb::Slice& value,
+               std::string*          new_value,
+               rocksdb::Logger* /*logger*/) const override
+    {
+        uint32_t counter = ~static_cast<uint32_t>(0);
+        uint32_t increment;
+
+        if (value.size() != sizeof(uint32_t)) {
+            return false;
+        }
+        ::memcpy(&increment, value.data(), sizeof(uint32_t));
+
+        if (existing_value != nullptr) {
+            if (existing_value->size() != sizeof(uint32_t)) {
+                return false;
+            }
+            ::memcpy(&counter, existing_value->data(), sizeof(uint32_t));
+        }
+        counter += increment;
+
+        new_value->assign(reinterpret_cast<const char*>(&counter),
+                          sizeof(uint32_t));
+        return true;
+    }
+
+    const char* Name() const override
+    {
+        return "SSECounterIncrement";
+    }
+};
+} // namespace
+
+// Next counter of the keys incremented since the database was opened, used
+// to reserve counters without locking when the increments are merged
+class RocksDBCounter::Reservations
+{
+public:
+    static constexpr size_t kShardsCount = 64;
+
+    using slot_type = std::shared_ptr<std::atomic<uint32_t>>;
+
+    explicit Reservations(rocksdb::DB* db) : db_(db)
+    {
+    }
+
+    // Returns nullptr if the counter could not be read from the database
+    slot_type slot(const std::string& key);
+
+    void invalidate(const std::string& key);
+
+private:
+    struct Shard
+    {
+        std::mutex                                 mtx;
+        std::unordered_map<std::string, slot_type> slots;
+    };
+
+    Shard& shard(const std::string& key)
+    {
+        return shards_[hasher_(key) % kShardsCount];
+    }
+
+    rocksdb::DB*                    db_;
+    std::array<Shard, kShardsCount> shards_;
+    std::hash<std::string>          hasher_;
+};
 
-RocksDBCounter::RocksDBCounter(const std::string& path) : db_(nullptr)
+RocksDBCounter::Reservations::slot_type RocksDBCounter::Reservations::slot(
+    const std::string& key)
+{
+    Shard& sh = shard(key);
+
+    // the lock only protects the map: the reservations themselves are
+    // lock-free
+    std::lock_guard<std::mutex> lock(sh.mtx);
+
+    auto it = sh.slots.find(key);
+    if (it != sh.slots.end()) {
+        return it->second;
+    }
+
+    std::string     data;
+    uint32_t        next = 0;
+    rocksdb::Status s    = db_->Get(rocksdb::ReadOptions(), key, &data);
+
+    if (s.ok()) {
+        ::memcpy(&next, data.data(), sizeof(uint32_t));
+        next++;
+    } else if (!s.IsNotFound()) {
+        /* LCOV_EXCL_START */
+        logger::logger()->error("Unable to read counter\nkey="
+                                + utility::hex_string(key)
+                                + "\nRocksdb status: " + s.ToString());
+        return nullptr;
+        /* LCOV_EXCL_STOP */
+    }
+
+    slot_type slot = std::make_shared<std::atomic<uint32_t>>(next);
+    sh.slots.emplace(key, slot);
+    return slot;
+}
+
+void RocksDBCounter::Reservations::invalidate(const std::string& key)
+{
+    Shard& sh = shard(key);
+
+    std::lock_guard<std::mutex> lock(sh.mtx);
+    sh.slots.erase(key);
+}
+
+RocksDBCounter::RocksDBCounter(const std::string& path, bool merge_increments)
+    : db_(nullptr), merge_increments_(merge_increments)
 {
     rocksdb::Options options;
     options.create_if_missing = true;
 
+    if (merge_increments_) {
+        options.merge_operator = std::make_shared<CounterIncrementOperator>();
+    }
+
 
     rocksdb::CuckooTableOptions cuckoo_options;
     cuckoo_options.identity_as_first_hash = false;
@@ -80,10 +213,213 @@ RocksDBCounter::RocksDBCounter(const std::string& path) : db_(nullptr)
                                  + path);
     }
     /* LCOV_EXCL_STOP */
+
+    if (merge_increments_) {
+        reservations_.reset(new Reservations(db_));
+    }
+}
+
+// In-memory front of the counter database
+class RocksDBCounter::Cache
+{
+public:
+    static constexpr size_t kShardsCount = 64;
+
+    struct Entry
+    {
+        uint32_t value{0};
+        // false if the key is not in the database
+        bool present{false};
+        // true if the entry was modified since the last checkpoint
+        bool dirty{false};
+    };
+
+    Cache(rocksdb::DB* db, std::chrono::milliseconds checkpoint_period);
+    ~Cache();
+
+    // Call f on the entry of key, with the lock of the entry's shard held.
+    // Entries are loaded from the database on their first access.
+    template<class F>
+    bool with_entry(const std::string& key, F f);
+
+    bool checkpoint();
+
+private:
+    struct Shard
+    {
+        std::mutex                             mtx;
+        std::unordered_map<std::string, Entry> entries;
+    };
+
+    void checkpoint_loop();
+
+    rocksdb::DB*                    db_;
+    std::array<Shard, kShardsCount> shards_;
+    std::hash<std::string>          hasher_;
+    const std::chrono::milliseconds checkpoint_period_;
+
+    // serializes the checkpoints
+    std::mutex checkpoint_mtx_;
+
+    std::mutex              stop_mtx_;
+    std::condition_variable stop_cv_;
+    bool                    stop_{false};
+    std::thread             checkpoint_thread_;
+};
+
+RocksDBCounter::Cache::Cache(rocksdb::DB*              db,
+                             std::chrono::milliseconds checkpoint_period)
+    : db_(db), checkpoint_period_(checkpoint_period)
+{
+    if (checkpoint_period_.count() > 0) {
+        checkpoint_thread_ = std::thread(&Cache::checkpoint_loop, this);
+    }
+}
+
+RocksDBCounter::Cache::~Cache()
+{
+    {
+        std::lock_guard<std::mutex> lock(stop_mtx_);
+        stop_ = true;
+    }
+    stop_cv_.notify_all();
+    if (checkpoint_thread_.joinable()) {
+        checkpoint_thread_.join();
+    }
+    checkpoint();
+}
+
+void RocksDBCounter::Cache::checkpoint_loop()
+{
+    std::unique_lock<std::mutex> lock(stop_mtx_);
+    while (!stop_cv_.wait_for(lock, checkpoint_period_, [this] {
+        return stop_;
+    })) {
+        lock.unlock();
+        checkpoint();
+        lock.lock();
+    }
+}
+
+template<class F>
+bool RocksDBCounter::Cache::with_entry(const std::string& key, F f)
+{
+    Shard& shard = shards_[hasher_(key) % kShardsCount];
+
+    std::lock_guard<std::mutex> lock(shard.mtx);
+
+    auto it = shard.entries.find(key);
+    if (it == shard.entries.end()) {
+        // cold miss: the shard stays locked during the lookup, so that the
+        // entry is loaded only once
+        Entry       entry;
+        std::string data;
+
+        rocksdb::Status s = db_->Get(rocksdb::ReadOptions(), key, &data);
+
+        if (s.ok()) {
+            ::memcpy(&entry.value, data.data(), sizeof(uint32_t));
+            entry.present = true;
+        } else if (!s.IsNotFound()) {
+            /* LCOV_EXCL_START */
+            logger::logger()->error("Unable to read counter\nkey="
+                                    + utility::hex_string(key)
+                                    + "\nRocksdb status: " + s.ToString());
+            return false;
+            /* LCOV_EXCL_STOP */
+        }
+        it = shard.entries.emplace(key, entry).first;
+    }
+
+    return f(it->second);
+}
+
+bool RocksDBCounter::Cache::checkpoint()
+{
+    std::lock_guard<std::mutex> checkpoint_lock(checkpoint_mtx_);
+
+    rocksdb::WriteBatch      batch;
+    std::vector<std::string> written_keys;
+
+    for (Shard& shard : shards_) {
+        std::lock_guard<std::mutex> lock(shard.mtx);
+
+        for (auto& entry : shard.entries) {
+            if (!entry.second.dirty) {
+                continue;
+            }
+            if (entry.second.present) {
+                const char* value
+                    = reinterpret_cast<const char*>(&entry.second.value);
+                batch.Put(entry.first,
+                          rocksdb::Slice(value, sizeof(uint32_t)));
+            } else {
+                batch.Delete(entry.first);
+            }
+            entry.second.dirty = false;
+            written_keys.push_back(entry.first);
+        }
+    }
+
+    if (written_keys.empty()) {
+        return true;
+    }
+
+    rocksdb::WriteOptions options;
+    options.sync = true;
+
+    rocksdb::Status s = db_->Write(options, &batch);
+
+    /* LCOV_EXCL_START */
+    if (!s.ok()) {
+        logger::logger()->error("Counters checkpoint failed: " + s.ToString());
+
+        // the entries will be written by the next checkpoint
+        for (const std::string& key : written_keys) {
+            Shard& shard = shards_[hasher_(key) % kShardsCount];
+
+            std::lock_guard<std::mutex> lock(shard.mtx);
+            shard.entries[key].dirty = true;
+        }
+    }
+    /* LCOV_EXCL_STOP */
+
+    return s.ok();
+}
+
+RocksDBCounter::~RocksDBCounter()
+{
+    // write the cached counters back before closing the database
+    cache_.reset();
+    delete db_;
+}
+
+void RocksDBCounter::enable_cache(std::chrono::milliseconds checkpoint_period)
+{
+    if (!cache_) {
+        cache_.reset(new Cache(db_, checkpoint_period));
+    }
+}
+
+bool RocksDBCounter::checkpoint()
+{
+    if (!cache_) {
+        return true;
+    }
+    return cache_->checkpoint();
 }
 
 bool RocksDBCounter::get(const std::string& key, uint32_t& val) const
 {
+    if (cache_) {
+        return cache_->with_entry(key, [&val](Cache::Entry& entry) {
+            if (entry.present) {
+                val = entry.value;
+            }
+            return entry.present;
+        });
+    }
+
     std::string data;
 
     rocksdb::Status s = db_->Get(rocksdb::ReadOptions(), key, &data);
@@ -100,6 +436,20 @@ bool RocksDBCounter::get(const std::string& key, uint32_t& val) const
 
 bool RocksDBCounter::get_and_increment(const std::string& key, uint32_t& val)
 {
+    if (cache_) {
+        return cache_->with_entry(key, [&val](Cache::Entry& entry) {
+            entry.value   = (entry.present) ? entry.value + 1 : 0;
+            entry.present = true;
+            entry.dirty   = true;
+            val           = entry.value;
+            return true;
+        });
+    }
+
+    if (merge_increments_) {
+        return reserve(key, 1, val);
+    }
+
     std::string data;
 
     rocksdb::Status s = db_->Get(rocksdb::ReadOptions(), key, &data);
@@ -131,8 +481,190 @@ bool RocksDBCounter::get_and_increment(const std::string& key, uint32_t& val)
     return s.ok();
 }
 
+bool RocksDBCounter::get_and_increment(const std::vector<std::string>& keys,
+                                       std::vector<uint32_t>&          vals,
+                                       bool disable_wal)
+{
+    vals.resize(keys.size());
+
+    if (keys.empty()) {
+        return true;
+    }
+
+    if (cache_) {
+        // the WAL is bypassed anyway: the cache is written back by the
+        // checkpoints
+        (void)disable_wal;
+        for (size_t i = 0; i < keys.size(); i++) {
+            if (!get_and_increment(keys[i], vals[i])) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    if (merge_increments_) {
+        // reserve the counters in memory, and write all the increments in a
+        // single batch
+        const uint32_t       one = 1;
+        const rocksdb::Slice increment(reinterpret_cast<const char*>(&one),
+                                       sizeof(uint32_t));
+        rocksdb::WriteBatch  batch;
+
+        for (size_t i = 0; i < keys.size(); i++) {
+            auto slot = reservations_->slot(keys[i]);
+            if (!slot) {
+                return false;
+            }
+            vals[i] = slot->fetch_add(1);
+            batch.Merge(keys[i], increment);
+        }
+
+        rocksdb::WriteOptions options;
+        options.disableWAL = disable_wal;
+
+        rocksdb::Status s = db_->Write(options, &batch);
+
+        /* LCOV_EXCL_START */
+        if (!s.ok()) {
+            logger::logger()->error("Unable to increment a batch of "
+                                    + std::to_string(keys.size())
+                                    + " counters\nRocksdb status: "
+                                    + s.ToString());
+        }
+        /* LCOV_EXCL_STOP */
+
+        return s.ok();
+    }
+
+    // position of every distinct key in the MultiGet batch
+    std::unordered_map<std::string, size_t> positions;
+    std::vector<rocksdb::Slice>             k_s;
+    std::vector<size_t>                     key_positions(keys.size());
+
+    for (size_t i = 0; i < keys.size(); i++) {
+        auto it          = positions.emplace(keys[i], k_s.size());
+        key_positions[i] = it.first->second;
+        if (it.second) {
+            k_s.emplace_back(keys[i]);
+        }
+    }
+
+    std::vector<std::string>     values;
+    std::vector<rocksdb::Status> statuses
+        = db_->MultiGet(rocksdb::ReadOptions(), k_s, &values);
+
+    std::vector<uint32_t> counters(k_s.size());
+    std::vector<bool>     found(k_s.size());
+
+    for (size_t j = 0; j < k_s.size(); j++) {
+        found[j] = statuses[j].ok();
+        if (found[j]) {
+            ::memcpy(&counters[j], values[j].data(), sizeof(uint32_t));
+        } else if (!statuses[j].IsNotFound()) {
+            /* LCOV_EXCL_START */
+            logger::logger()->error("Unable to read counter\nkey="
+                                    + utility::hex_string(k_s[j].ToString())
+                                    + "\nRocksdb status: "
+                                    + statuses[j].ToString());
+            return false;
+            /* LCOV_EXCL_STOP */
+        }
+    }
+
+    for (size_t i = 0; i < keys.size(); i++) {
+        const size_t j = key_positions[i];
+        if (found[j]) {
+            counters[j]++;
+        } else {
+            counters[j] = 0;
+            found[j]    = true;
+        }
+        vals[i] = counters[j];
+    }
+
+    rocksdb::WriteBatch batch;
+    for (size_t j = 0; j < k_s.size(); j++) {
+        batch.Put(k_s[j],
+                  rocksdb::Slice(reinterpret_cast<const char*>(&counters[j]),
+                                 sizeof(uint32_t)));
+    }
+
+    rocksdb::WriteOptions options;
+    options.disableWAL = disable_wal;
+
+    rocksdb::Status s = db_->Write(options, &batch);
+
+    /* LCOV_EXCL_START */
+    if (!s.ok()) {
+        logger::logger()->error("Unable to increment a batch of "
+                                + std::to_string(k_s.size())
+                                + " counters\nRocksdb status: " + s.ToString());
+    }
+    /* LCOV_EXCL_STOP */
+
+    return s.ok();
+}
+
+bool RocksDBCounter::reserve(const std::string& key,
+                             uint32_t           count,
+                             uint32_t&          first)
+{
+    if (count == 0) {
+        return get(key, first);
+    }
+
+    if (cache_) {
+        return cache_->with_entry(key, [count, &first](Cache::Entry& entry) {
+            first         = (entry.present) ? entry.value + 1 : 0;
+            entry.value   = first + count - 1;
+            entry.present = true;
+            entry.dirty   = true;
+            return true;
+        });
+    }
+
+    if (merge_increments_) {
+        auto slot = reservations_->slot(key);
+        if (!slot) {
+            return false;
+        }
+        first = slot->fetch_add(count);
+
+        rocksdb::Status s = db_->Merge(
+            rocksdb::WriteOptions(),
+            key,
+            rocksdb::Slice(reinterpret_cast<const char*>(&count),
+                           sizeof(uint32_t)));
+
+        /* LCOV_EXCL_START */
+        if (!s.ok()) {
+            logger::logger()->error(
+                "Unable to increment counter\nkey=" + utility::hex_string(key)
+                + "\nRocksdb status: " + s.ToString());
+        }
+        /* LCOV_EXCL_STOP */
+
+        return s.ok();
+    }
+
+    uint32_t last;
+    first = (get(key, last)) ? last + 1 : 0;
+
+    return set(key, first + count - 1);
+}
+
 bool RocksDBCounter::increment(const std::string& key, uint32_t default_value)
 {
+    if (cache_) {
+        return cache_->with_entry(key, [default_value](Cache::Entry& entry) {
+            entry.value   = (entry.present) ? entry.value + 1 : default_value;
+            entry.present = true;
+            entry.dirty   = true;
+            return true;
+        });
+    }
+
     std::string data;
     uint32_t    val;
 
@@ -160,11 +692,25 @@ bool RocksDBCounter::increment(const std::string& key, uint32_t default_value)
     }
     /* LCOV_EXCL_STOP */
 
+    if (reservations_) {
+        // the next reservation reloads the counter
+        reservations_->invalidate(key);
+    }
+
     return s.ok();
 }
 
 bool RocksDBCounter::set(const std::string& key, uint32_t val)
 {
+    if (cache_) {
+        return cache_->with_entry(key, [val](Cache::Entry& entry) {
+            entry.value   = val;
+            entry.present = true;
+            entry.dirty   = true;
+            return true;
+        });
+    }
+
     rocksdb::Slice k_v(reinterpret_cast<const char*>(&val), sizeof(uint32_t));
 
     rocksdb::Status s = db_->Put(rocksdb::WriteOptions(), key, k_v);
@@ -178,19 +724,39 @@ bool RocksDBCounter::set(const std::string& key, uint32_t val)
     }
     /* LCOV_EXCL_STOP */
 
+    if (reservations_) {
+        // the next reservation reloads the counter
+        reservations_->invalidate(key);
+    }
+
     return s.ok();
 }
 
 
 bool RocksDBCounter::remove_key(const std::string& key)
 {
+    if (cache_) {
+        return cache_->with_entry(key, [](Cache::Entry& entry) {
+            entry.present = false;
+            entry.dirty   = true;
+            return true;
+        });
+    }
+
     rocksdb::Status s = db_->Delete(rocksdb::WriteOptions(), key);
 
+    if (reservations_) {
+        // the next reservation reloads the counter
+        reservations_->invalidate(key);
+    }
+
     return s.ok();
 }
 
 void RocksDBCounter::flush(bool blocking)
 {
+    checkpoint();
+
     rocksdb::FlushOptions options;
 
     options.wait = blocking;
@@ -203,5 +769,31 @@ void RocksDBCounter::flush(bool blocking)
     }
     /* LCOV_EXCL_STOP */
 }
+
+bool RocksDBCounter::sync(bool wal_disabled)
+{
+    if (!checkpoint()) {
+        return false;
+    }
+
+    rocksdb::Status s;
+
+    if (wal_disabled) {
+        rocksdb::FlushOptions options;
+        options.wait = true;
+
+        s = db_->Flush(options);
+    } else {
+        s = db_->SyncWAL();
+    }
+
+    /* LCOV_EXCL_START */
+    if (!s.ok()) {
+        logger::logger()->error("DB sync failed: " + s.ToString());
+    }
+    /* LCOV_EXCL_STOP */
+
+    return s.ok();
+}
 } // namespace sophos
 } // namespace sse
@@ -0,0 +1,69 @@
+#pragma once
+
+#include <sse/schemes/abstractio/scheduler.hpp>
+
+#include <algorithm>
+#include <memory>
+#include <vector>
+
+namespace sse {
+namespace abstractio {
+namespace test {
+
+// Thread pool scheduler only accepting the first reads of every batch
+class PartialReadScheduler : public Scheduler
+{
+public:
+    explicit PartialReadScheduler(size_t accepted_reads)
+        : m_inner(make_thread_pool_aio_scheduler()),
+          m_accepted_reads(accepted_reads)
+    {
+    }
+
+    void wait_completions() override
+    {
+        m_inner->wait_completions();
+    }
+
+    int submit_pread(int                     fd,
+                     void*                   buf,
+                     size_t                  len,
+                     off_t                   offset,
+                     void*                   data,
+                     scheduler_callback_type callback) override
+    {
+        return m_inner->submit_pread(
+            fd, buf, len, offset, data, std::move(callback));
+    }
+
+    int submit_preads(const std::vector<PReadSumission>& subs) override
+    {
+        const size_t count = std::min(subs.size(), m_accepted_reads);
+        return m_inner->submit_preads(std::vector<PReadSumission>(
+            subs.begin(), subs.begin() + count));
+    }
+
+    int submit_pwrite(int                     fd,
+                      void*                   buf,
+                      size_t                  len,
+                      off_t                   offset,
+                      void*                   data,
+                      scheduler_callback_type callback) override
+    {
+        return m_inner->submit_pwrite(
+            fd, buf, len, offset, data, std::move(callback));
+    }
+
+    Scheduler* duplicate() const override
+    {
+        return new PartialReadScheduler(m_accepted_reads);
+    }
+
+private:
+    std::unique_ptr<Scheduler> m_inner;
+    const size_t               m_accepted_reads;
+};
+
+} // namespace test
+} // namespace abstractio
+} // namespace sse
@@ -1,7 +1,15 @@
+#include "abstractio_test_utils.hpp"
+
 #include <sse/schemes/abstractio/awonvm_vector.hpp>
 #include <sse/schemes/abstractio/scheduler.hpp>
 #include <sse/schemes/utils/utils.hpp>
 
+#include <cstring>
+#include <unistd.h>
+
+#include <atomic>
+#include <thread>
+
 #include <gtest/gtest.h>
 
 namespace sse {
@@ -52,7 +60,10 @@ enum AWONVMVectorTestScheduler
 {
     LinuxAIOScheduler = 1,
     ThreadPoolSchedulerCached,
-    ThreadPoolSchedulerDirect
+    ThreadPoolSchedulerDirect,
+    IoUringScheduler,
+    IoUringSchedulerSQPoll,
+    ShardedLinuxAIOScheduler
 };
 
 class AWONVMVectorTest
@@ -77,10 +88,25 @@ public:
                 make_linux_aio_scheduler(kPageSize, 128));
 #else
             return std::unique_ptr<Scheduler>(nullptr);
+#endif
+        case ShardedLinuxAIOScheduler:
+#ifdef HAS_LIBAIO
+            return std::unique_ptr<Scheduler>(
+                make_linux_aio_scheduler(kPageSize, 128, 4));
+#else
+            return std::unique_ptr<Scheduler>(nullptr);
 #endif
         case ThreadPoolSchedulerCached:
         case ThreadPoolSchedulerDirect:
             return std::unique_ptr<Scheduler>(make_thread_pool_aio_scheduler());
+        case IoUringScheduler:
+        case IoUringSchedulerSQPoll:
+#ifdef HAS_IO_URING
+            return std::unique_ptr<Scheduler>(make_io_uring_scheduler(
+                kPageSize, 128, GetParam() == IoUringSchedulerSQPoll));
+#else
+            return std::unique_ptr<Scheduler>(nullptr);
+#endif
 
         default:
             return std::unique_ptr<Scheduler>(nullptr);
@@ -149,7 +175,7 @@ TEST_P(AWONVMVectorTest, async_build_and_get)
         ASSERT_TRUE(vec.is_committed());
 
         for (uint64_t i = 0; i < kTestVecSize; i++) {
-            vec.async_get(i, [i](std::unique_ptr<test_payload> value) {
+            vec.async_get(i, [i](pooled_ptr<test_payload> value) {
                 (void)i;
                 (void)value;
                 ASSERT_TRUE(value);
@@ -159,6 +185,156 @@ TEST_P(AWONVMVectorTest, async_build_and_get)
     }
 }
 
+TEST_P(AWONVMVectorTest, batched_async_build_and_get)
+{
+    bool direct_io = (GetParam() == ThreadPoolSchedulerCached) ? false : true;
+
+    constexpr size_t kBatchSize = 64;
+
+    // create the vector, by batches of kBatchSize values (the last one being
+    // incomplete)
+    {
+        awonvm_vector<test_payload, kPageSize> vec(
+            test_file, get_scheduler(), direct_io);
+
+        // the batches are written from buffers aligned on the page size
+        constexpr size_t  kBatchesCount
+            = (kTestVecSize + kBatchSize - 1) / kBatchSize;
+        AlignedBufferPool pool(
+            kBatchSize * sizeof(test_payload), kPageSize, kBatchesCount);
+
+        std::atomic<size_t> written_bytes(0);
+
+        for (uint64_t i = 0; i < kTestVecSize; i += kBatchSize) {
+            auto*        batch = static_cast<test_payload*>(pool.acquire());
+            const size_t count = std::min(kBatchSize, kTestVecSize - i);
+            for (size_t j = 0; j < count; j++) {
+                batch[j] = test_payload(i + j);
+            }
+
+            size_t first = vec.async_push_back(
+                batch, count, [&written_bytes](int64_t res) {
+                    ASSERT_GT(res, 0);
+                    written_bytes.fetch_add(static_cast<size_t>(res));
+                });
+            ASSERT_EQ(first, i);
+        }
+
+        vec.commit();
+        ASSERT_EQ(written_bytes.load(), kTestVecSize * sizeof(test_payload));
+    }
+
+    {
+        awonvm_vector<test_payload, kPageSize> vec(
+            test_file, get_scheduler(), direct_io);
+
+        ASSERT_TRUE(vec.is_committed());
+        ASSERT_EQ(vec.size(), kTestVecSize);
+
+        for (uint64_t i = 0; i < kTestVecSize; i++) {
+            ASSERT_EQ(vec.get(i), test_payload(i));
+        }
+    }
+}
+
+TEST_P(AWONVMVectorTest, cached_get)
+{
+    bool direct_io = (GetParam() == ThreadPoolSchedulerCached) ? false : true;
+
+    {
+        awonvm_vector<test_payload, kPageSize> vec(
+            test_file, get_scheduler(), direct_io);
+
+        for (uint64_t i = 0; i < kTestVecSize; i++) {
+            __attribute__((aligned(kPageSize))) test_payload payload(i);
+            vec.push_back(payload);
+        }
+        vec.commit();
+    }
+
+    constexpr size_t kCachedPages = 64;
+    using vector_type             = awonvm_vector<test_payload, kPageSize>;
+
+    vector_type vec(test_file, get_scheduler(), direct_io);
+    vec.set_cache(std::make_shared<PageCache<test_payload>>(
+        kCachedPages * sizeof(test_payload), 4));
+
+    // the second pass is entirely served by the cache
+    for (size_t pass = 0; pass < 2; pass++) {
+        std::vector<vector_type::GetRequest> requests;
+        std::atomic<uint64_t>                completed{0};
+
+        for (uint64_t i = 0; i < kCachedPages; i++) {
+            requests.emplace_back(
+                i, [i, &completed](pooled_ptr<test_payload> value) {
+                    ASSERT_TRUE(value);
+                    ASSERT_EQ(*value, test_payload(i));
+                    completed.fetch_add(1);
+                });
+        }
+        vec.async_gets(requests);
+
+        while (completed.load() != kCachedPages) {
+            std::this_thread::yield();
+        }
+    }
+    ASSERT_EQ(vec.cache()->miss_count(), kCachedPages);
+    ASSERT_EQ(vec.cache()->hit_count(), kCachedPages);
+
+    for (uint64_t i = 0; i < kCachedPages; i++) {
+        ASSERT_EQ(vec.get(i), test_payload(i));
+    }
+    ASSERT_EQ(vec.cache()->hit_count(), 2 * kCachedPages);
+}
+
+TEST_P(AWONVMVectorTest, memory_mapped_get)
+{
+    bool direct_io = (GetParam() == ThreadPoolSchedulerCached) ? false : true;
+
+    {
+        awonvm_vector<test_payload, kPageSize> vec(
+            test_file, get_scheduler(), direct_io);
+
+        for (uint64_t i = 0; i < kTestVecSize; i++) {
+            __attribute__((aligned(kPageSize))) test_payload payload(i);
+            vec.push_back(payload);
+        }
+        ASSERT_THROW(vec.map_memory(), std::runtime_error);
+        vec.commit();
+    }
+
+    awonvm_vector<test_payload, kPageSize> vec(
+        test_file, get_scheduler(), direct_io);
+    vec.map_memory(true);
+    ASSERT_TRUE(vec.is_memory_mapped());
+
+    test_payload buffer;
+    for (uint64_t i = 0; i < kTestVecSize; i++) {
+        ASSERT_EQ(vec.get(i), test_payload(i));
+
+        // the view points in the mapping
+        const test_payload& view = vec.view(i, buffer);
+        ASSERT_NE(&view, &buffer);
+        ASSERT_EQ(view, test_payload(i));
+    }
+    ASSERT_THROW(vec.view(kTestVecSize, buffer), std::invalid_argument);
+
+    // served synchronously from the mapping
+    std::atomic<uint64_t> completed{0};
+    for (uint64_t i = 0; i < kTestVecSize; i++) {
+        vec.async_get(i, [i, &completed](pooled_ptr<test_payload> value) {
+            ASSERT_TRUE(value);
+            ASSERT_EQ(*value, test_payload(i));
+            completed.fetch_add(1);
+        });
+    }
+    ASSERT_EQ(completed.load(), kTestVecSize);
+
+    vec.unmap_memory();
+    ASSERT_FALSE(vec.is_memory_mapped());
+    ASSERT_EQ(&vec.view(0, buffer), &buffer);
+    ASSERT_EQ(buffer, test_payload(0));
+}
 
 INSTANTIATE_TEST_SUITE_P(AWONVMVectorTest,
                          AWONVMVectorTest,
@@ -166,10 +342,205 @@ INSTANTIATE_TEST_SUITE_P(AWONVMVectorTest,
                                          ThreadPoolSchedulerDirect
 #ifdef HAS_LIBAIO
                                          ,
-                                         LinuxAIOScheduler
+                                         LinuxAIOScheduler,
+                                         ShardedLinuxAIOScheduler
+#endif
+#ifdef HAS_IO_URING
+                                         ,
+                                         IoUringScheduler,
+                                         IoUringSchedulerSQPoll
 #endif
                                          ));
 
+TEST(awonvm_vector, partial_async_gets)
+{
+    constexpr size_t kReadsCount    = 100;
+    constexpr size_t kAcceptedReads = 10;
+
+    silent_cleanup();
+    {
+        awonvm_vector<test_payload, kPageSize> vec(
+            test_file,
+            std::unique_ptr<Scheduler>(make_thread_pool_aio_scheduler()),
+            false);
+        for (uint64_t i = 0; i < kReadsCount; i++) {
+            vec.push_back(test_payload(i));
+        }
+        vec.commit();
+    }
+
+    std::atomic<size_t> completed{0};
+    {
+        awonvm_vector<test_payload, kPageSize> vec(
+            test_file,
+            std::unique_ptr<Scheduler>(
+                new test::PartialReadScheduler(kAcceptedReads)),
+            false);
+
+        std::vector<awonvm_vector<test_payload, kPageSize>::GetRequest>
+            requests;
+        for (uint64_t i = 0; i < kReadsCount; i++) {
+            requests.emplace_back(
+                i, [i, &completed](pooled_ptr<test_payload> value) {
+                    ASSERT_TRUE(value);
+                    ASSERT_EQ(*value, test_payload(i));
+                    completed.fetch_add(1);
+                });
+        }
+
+        // only the callbacks of the submitted reads are called
+        ASSERT_EQ(vec.async_gets(requests), kAcceptedReads);
+    }
+    ASSERT_EQ(completed.load(), kAcceptedReads);
+
+    cleanup();
+}
+
+TEST(aligned_buffer_pool, recycle)
+{
+    constexpr size_t kCapacity = 4;
+
+    auto pool
+        = std::make_shared<AlignedBufferPool>(100, kPageSize, kCapacity);
+    ASSERT_EQ(pool->buffer_size(), kPageSize);
+
+    std::vector<void*> buffers;
+    for (size_t i = 0; i < kCapacity; i++) {
+        buffers.push_back(pool->acquire());
+        ASSERT_TRUE(pool->owns(buffers.back()));
+        ASSERT_TRUE(utility::is_aligned(buffers.back(), kPageSize));
+    }
+
+    // the pool is exhausted: fall back to the allocator
+    void* extra = pool->acquire();
+    ASSERT_FALSE(pool->owns(extra));
+    ASSERT_TRUE(utility::is_aligned(extra, kPageSize));
+    pool->release(extra);
+
+    // released buffers are handed out again
+    pool->release(buffers[2]);
+    ASSERT_EQ(pool->acquire(), buffers[2]);
+
+    {
+        pooled_ptr<test_payload> value(
+            reinterpret_cast<test_payload*>(buffers[0]),
+            PooledBufferDeleter<test_payload>{pool});
+    }
+    ASSERT_EQ(pool->acquire(), buffers[0]);
+
+    for (void* buf : buffers) {
+        pool->release(buf);
+    }
+}
+
+TEST(page_cache, clock_eviction)
+{
+    PageCache<test_payload> cache(4 * sizeof(test_payload), 1);
+    ASSERT_EQ(cache.capacity(), 4);
+
+    test_payload value;
+    ASSERT_FALSE(cache.get(0, value));
+
+    for (uint64_t i = 0; i < 4; i++) {
+        cache.insert(i, test_payload(i));
+    }
+    ASSERT_EQ(cache.size(), 4);
+
+    // 0 and 1 are referenced: 2 is the first page without a second chance
+    ASSERT_TRUE(cache.get(0, value));
+    ASSERT_EQ(value, test_payload(0));
+    ASSERT_TRUE(cache.get(1, value));
+    cache.insert(4, test_payload(4));
+
+    ASSERT_EQ(cache.size(), 4);
+    ASSERT_FALSE(cache.get(2, value));
+    ASSERT_TRUE(cache.get(4, value));
+    ASSERT_EQ(value, test_payload(4));
+    ASSERT_TRUE(cache.get(0, value));
+    ASSERT_TRUE(cache.get(3, value));
+
+    ASSERT_EQ(cache.hit_count(), 5);
+    ASSERT_EQ(cache.miss_count(), 2);
+}
+
+#ifdef HAS_IO_URING
+TEST(io_uring_scheduler, registered_buffers)
+{
+    // more pages than request slots
+    constexpr size_t   kPagesCount  = 64;
+    constexpr unsigned kQueueDepth  = 8;
+    constexpr size_t   kBufferSize  = kPagesCount * kPageSize;
+    constexpr int64_t  kPageSizeRes = kPageSize;
+
+    silent_cleanup();
+    int fd = utility::open_fd(test_file, true);
+    ASSERT_GE(fd, 0);
+
+    void* buffer = nullptr;
+    ASSERT_EQ(posix_memalign(&buffer, kPageSize, kBufferSize), 0);
+    auto* pages = static_cast<uint8_t*>(buffer);
+
+    std::unique_ptr<Scheduler> scheduler(
+        make_io_uring_scheduler(kPageSize, kQueueDepth));
+    ASSERT_EQ(scheduler->register_buffers({ReadBuffer{buffer, kBufferSize}}),
+              0);
+    ASSERT_EQ(scheduler->register_files({fd}), 0);
+
+    std::atomic<size_t> written{0};
+    for (size_t i = 0; i < kPagesCount; i++) {
+        uint8_t* page = pages + i * kPageSize;
+        memset(page, static_cast<int>(i), kPageSize);
+
+        int ret = scheduler->submit_pwrite(
+            fd,
+            page,
+            kPageSize,
+            i * kPageSize,
+            page,
+            [&written](void* /*buf*/, int64_t res) {
+                if (res == kPageSizeRes) {
+                    written++;
+                }
+            });
+        ASSERT_EQ(ret, 1);
+    }
+    while (written.load() < kPagesCount) {
+        std::this_thread::yield();
+    }
+
+    memset(buffer, 0xFF, kBufferSize);
+
+    std::atomic<size_t>                    valid_reads{0};
+    std::vector<Scheduler::PReadSumission> reads;
+    for (size_t i = 0; i < kPagesCount; i++) {
+        uint8_t* page = pages + i * kPageSize;
+        reads.emplace_back(
+            fd,
+            page,
+            kPageSize,
+            i * kPageSize,
+            page,
+            [&valid_reads, i](void* b, int64_t res) {
+                const auto* p = static_cast<const uint8_t*>(b);
+                if (res == kPageSizeRes
+                    && std::all_of(p, p + kPageSize, [i](uint8_t c) {
+                           return c == static_cast<uint8_t>(i);
+                       })) {
+                    valid_reads++;
+                }
+            });
+    }
+    ASSERT_EQ(scheduler->submit_preads(reads), static_cast<int>(kPagesCount));
+
+    scheduler->wait_completions();
+    ASSERT_EQ(valid_reads.load(), kPagesCount);
+
+    scheduler.reset();
+    free(buffer);
+    close(fd);
+    cleanup();
+}
+#endif
 
 } // namespace abstractio
 } // namespace sse
\ No newline at end of file
@@ -0,0 +1,89 @@
+#include <sse/schemes/utils/bounded_queue.hpp>
+
+#include <atomic>
+#include <thread>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+namespace sse {
+namespace test {
+
+using utility::BoundedQueue;
+
+TEST(bounded_queue, push_pop)
+{
+    BoundedQueue<uint64_t> queue(5);
+
+    // the capacity is rounded up to a power of 2
+    ASSERT_EQ(queue.capacity(), 8);
+
+    uint64_t v;
+    ASSERT_FALSE(queue.try_pop(v));
+
+    for (uint64_t i = 0; i < queue.capacity(); i++) {
+        ASSERT_TRUE(queue.try_push(i));
+    }
+    ASSERT_FALSE(queue.try_push(42));
+
+    // FIFO order, several times around the ring
+    for (uint64_t i = 0; i < 100; i++) {
+        ASSERT_TRUE(queue.try_pop(v));
+        ASSERT_EQ(v, i);
+        ASSERT_TRUE(queue.try_push(i + queue.capacity()));
+    }
+}
+
+TEST(bounded_queue, concurrent)
+{
+    constexpr size_t   kProducers       = 4;
+    constexpr size_t   kConsumers       = 4;
+    constexpr uint64_t kElementsPerProd = 100000;
+
+    BoundedQueue<uint64_t> queue(64);
+
+    std::atomic<size_t>      producers_done(0);
+    std::atomic<uint64_t>    sum(0);
+    std::atomic<size_t>      popped(0);
+    std::vector<std::thread> threads;
+
+    for (size_t p = 0; p < kProducers; p++) {
+        threads.emplace_back([&queue, &producers_done]() {
+            for (uint64_t i = 1; i <= kElementsPerProd; i++) {
+                while (!queue.try_push(i)) {
+                    std::this_thread::yield();
+                }
+            }
+            producers_done++;
+        });
+    }
+    for (size_t c = 0; c < kConsumers; c++) {
+        threads.emplace_back([&queue, &producers_done, &sum, &popped]() {
+            uint64_t v;
+            for (;;) {
+                if (queue.try_pop(v)) {
+                    sum += v;
+                    popped++;
+                } else if (producers_done == kProducers) {
+                    // the producers have finished before the last failed pop
+                    if (!queue.try_pop(v)) {
+                        return;
+                    }
+                    sum += v;
+                    popped++;
+                } else {
+                    std::this_thread::yield();
+                }
+            }
+        });
+    }
+    for (auto& t : threads) {
+        t.join();
+    }
+
+    ASSERT_EQ(popped, kProducers * kElementsPerProd);
+    ASSERT_EQ(sum, kProducers * kElementsPerProd * (kElementsPerProd + 1) / 2);
+}
+
+} // namespace test
+} // namespace sse
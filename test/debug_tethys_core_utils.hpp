@@ -395,7 +395,8 @@ void async_store_read_queries(const size_t                  n_queries,
         } else {
             auto callback =
                 [&notifier, n_queries, &completed_queries, benchmark](
-                    std::unique_ptr<std::array<uint8_t, kPageSize>> /*bucket*/,
+                    sse::abstractio::pooled_ptr<std::array<uint8_t, kPageSize>>
+                    /*bucket*/,
                     size_t /*b_index*/) {
                     size_t query_count = completed_queries.fetch_add(1) + 1;
 
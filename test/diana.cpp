@@ -172,6 +172,9 @@ inline void check_same_results(const U& l1, const V& l2)
 }
 
 
+// Much smaller than the number of results of the test searches
+constexpr size_t kTestSearchChunkSize = 50;
+
 // To test all the different search algorithms
 template<class SearchFun>
 static void test_search_function(SearchFun search_fun)
@@ -185,6 +188,9 @@ static void test_search_function(SearchFun search_fun)
     // first, create a client and a server from scratch
     create_client_server(client, server);
 
+    // split the parallel searches in several chunks
+    server->set_search_chunk_size(kTestSearchChunkSize);
+
     std::list<uint64_t> long_list;
     for (size_t i = 0; i < 1000; i++) {
         long_list.push_back(i);
@@ -233,6 +239,48 @@ TEST(diana, search_parallel_vec)
     test_search_function(search_fun);
 }
 
+TEST(diana, search_vec)
+{
+    auto search_fun = [](TestDianaServer& server, SearchRequest& req) {
+        std::vector<uint64_t> res_vec;
+
+        server.search(req, res_vec);
+
+        EXPECT_EQ(res_vec.size(), req.add_count);
+        return res_vec;
+    };
+    test_search_function(search_fun);
+}
+
+TEST(diana, search_unbatched)
+{
+    auto search_fun = [](TestDianaServer& server, SearchRequest& req) {
+        server.set_lookup_batch_size(1);
+        return server.search(req);
+    };
+    test_search_function(search_fun);
+}
+
+TEST(diana, search_parallel_batched)
+{
+    // use a batch size that does not divide the number of results, nor the
+    // size of the ranges given to each thread
+    auto search_fun = [](TestDianaServer& server, SearchRequest& req) {
+        server.set_lookup_batch_size(7);
+        return server.search_parallel(req, concurrency_level);
+    };
+    test_search_function(search_fun);
+}
+
+TEST(diana, search_parallel_unbatched)
+{
+    auto search_fun = [](TestDianaServer& server, SearchRequest& req) {
+        server.set_lookup_batch_size(0);
+        return server.search_parallel(req, concurrency_level);
+    };
+    test_search_function(search_fun);
+}
+
 TEST(diana, search_callback)
 {
     std::mutex          res_list_mutex;
@@ -222,6 +222,26 @@ TEST(janus, insertion_removal_parallel_search)
     test_search_removal(search_fun);
 }
 
+TEST(janus, insertion_removal_search_vec)
+{
+    auto search_fun = [](Server& server, janus::SearchRequest& req) {
+        std::vector<index_type> res_vec;
+        server.search(req, res_vec);
+        return res_vec;
+    };
+    test_search_removal(search_fun);
+}
+
+TEST(janus, insertion_removal_parallel_search_vec)
+{
+    auto search_fun = [](Server& server, janus::SearchRequest& req) {
+        std::vector<index_type> res_vec;
+        server.search_parallel(req, 1, res_vec);
+        return res_vec;
+    };
+    test_search_removal(search_fun);
+}
+
 } // namespace test
 } // namespace janus
 } // namespace sse
\ No newline at end of file
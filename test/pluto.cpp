@@ -1,9 +1,13 @@
 
+#include "abstractio_test_utils.hpp"
 #include "pluto_test_utils.hpp"
 
 #include <sse/schemes/pluto/pluto_client.hpp>
 #include <sse/schemes/pluto/pluto_server.hpp>
 
+#include <chrono>
+#include <future>
+
 #include <gtest/gtest.h>
 
 namespace sse {
@@ -69,6 +73,34 @@ void test_pluto_builder(size_t n_elements, const std::string& json_path)
         ASSERT_EQ(std::set<index_type>(res.begin(), res.end()),
                   std::set<index_type>(long_list.begin(), long_list.end()));
 
+        // same search, with all the IOs submitted at once
+        std::promise<SearchResponse<kPageSize>> search_promise;
+        server.async_search(sr, [&search_promise](SearchResponse<kPageSize> r) {
+            search_promise.set_value(std::move(r));
+        });
+        res = client.decode_search_results(sr,
+                                           search_promise.get_future().get());
+
+        ASSERT_EQ(std::set<index_type>(res.begin(), res.end()),
+                  std::set<index_type>(long_list.begin(), long_list.end()));
+
+        // with an exact and an underestimated complete blocks count
+        const uint32_t n_blocks = long_list.size() / Params::kPlutoListLength;
+        for (uint32_t hint : {n_blocks, 0U}) {
+            auto hinted_sr = client.search_request("alpha", hint);
+
+            std::promise<SearchResponse<kPageSize>> hinted_promise;
+            server.async_search(hinted_sr,
+                                [&hinted_promise](SearchResponse<kPageSize> r) {
+                                    hinted_promise.set_value(std::move(r));
+                                });
+            res = client.decode_search_results(
+                hinted_sr, hinted_promise.get_future().get());
+
+            ASSERT_EQ(std::set<index_type>(res.begin(), res.end()),
+                      std::set<index_type>(long_list.begin(), long_list.end()));
+        }
+
         sr  = client.search_request("beta");
         bl  = server.search(sr);
         res = client.decode_search_results(sr, bl);
@@ -118,6 +150,81 @@ TYPED_TEST(PlutoTest, basic)
     test_pluto_builder<TypeParam>(1000, "../inverted_index_test.json");
 }
 
+TEST(pluto, async_search_submission_failures)
+{
+    using Params = default_param_type;
+    using abstractio::test::PartialReadScheduler;
+
+    constexpr size_t              kKeySize = 32;
+    std::array<uint8_t, kKeySize> prf_key;
+    std::fill(prf_key.begin(), prf_key.end(), 0x00);
+
+    std::array<uint8_t, pluto_builder_type::kEncryptionKeySize> encryption_key;
+    std::fill(encryption_key.begin(), encryption_key.end(), 0x11);
+
+    std::list<index_type> long_list;
+    for (size_t i = 0; i < 3 * Params::kPlutoListLength + 7; i++) {
+        long_list.push_back(i);
+    }
+
+    cleanup_store();
+    {
+        auto builder = create_pluto_builder<Params>(
+            test_dir,
+            sse::crypto::Key<kKeySize>(prf_key.data()),
+            encryption_key,
+            long_list.size());
+        builder.insert_list("alpha", long_list);
+        builder.build();
+    }
+
+    using inner_decoder_type =
+        typename Params::tethys_inner_encoder_type::decoder_type;
+    PlutoClient<inner_decoder_type> client(
+        tethys_stash_path(test_dir),
+        sse::crypto::Key<kKeySize>(prf_key.data()),
+        encryption_key);
+    auto sr = client.search_request("alpha");
+
+    // number of reads accepted by the schedulers of the Tethys table and of
+    // the hash table (a hash table probe is made of two reads)
+    constexpr size_t kAll = 1000;
+    const std::vector<std::array<size_t, 2>> accepted_reads
+        = {{kAll, kAll}, {0, kAll}, {kAll, 0}, {kAll, 1}};
+
+    for (const auto& accepted : accepted_reads) {
+        PlutoServer<Params> server(
+            tethys_table_path(test_dir),
+            make_pluto_ht_params<Params>(test_dir),
+            std::unique_ptr<abstractio::Scheduler>(
+                new PartialReadScheduler(accepted[0])),
+            std::unique_ptr<abstractio::Scheduler>(
+                new PartialReadScheduler(accepted[1])));
+
+        std::promise<SearchResponse<kPageSize>> search_promise;
+        auto search_future = search_promise.get_future();
+        server.async_search(sr, [&search_promise](SearchResponse<kPageSize> r) {
+            search_promise.set_value(std::move(r));
+        });
+
+        // the callback is called even when the reads cannot be submitted
+        ASSERT_EQ(search_future.wait_for(std::chrono::seconds(30)),
+                  std::future_status::ready);
+        SearchResponse<kPageSize> response = search_future.get();
+
+        if (accepted[0] == kAll && accepted[1] == kAll) {
+            ASSERT_FALSE(response.failed);
+
+            auto res = client.decode_search_results(sr, response);
+            ASSERT_EQ(std::set<index_type>(res.begin(), res.end()),
+                      std::set<index_type>(long_list.begin(), long_list.end()));
+        } else {
+            ASSERT_TRUE(response.failed);
+        }
+    }
+    cleanup_store();
+}
+
 } // namespace test
 } // namespace pluto
 } // namespace sse
\ No newline at end of file
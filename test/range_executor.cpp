@@ -0,0 +1,123 @@
+#include <sse/schemes/utils/range_executor.hpp>
+
+#include <atomic>
+#include <set>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+namespace sse {
+namespace test {
+
+using utility::RangeExecutor;
+
+// Run a job over [0, count) and check that every index has been processed
+// exactly once, and that every slot is used by a single thread at a time
+static void check_run(RangeExecutor& executor,
+                      size_t         count,
+                      size_t         chunk_size,
+                      uint8_t        max_participants)
+{
+    std::vector<std::vector<size_t>> per_slot(max_participants);
+    std::vector<std::atomic<bool>>   slot_in_use(max_participants);
+    for (auto& in_use : slot_in_use) {
+        in_use = false;
+    }
+
+    auto job = [&per_slot, &slot_in_use, max_participants](
+                   uint8_t slot, size_t min, size_t max) {
+        ASSERT_LT(slot, max_participants);
+        ASSERT_FALSE(slot_in_use[slot].exchange(true));
+        for (size_t i = min; i <= max; i++) {
+            per_slot[slot].push_back(i);
+        }
+        slot_in_use[slot] = false;
+    };
+
+    executor.run(count, chunk_size, max_participants, job);
+
+    std::set<size_t> indices;
+    size_t           processed = 0;
+    for (const auto& v : per_slot) {
+        processed += v.size();
+        indices.insert(v.begin(), v.end());
+    }
+    ASSERT_EQ(processed, count);
+    ASSERT_EQ(indices.size(), count);
+    if (count > 0) {
+        ASSERT_EQ(*indices.rbegin(), count - 1);
+    }
+}
+
+TEST(range_executor, run)
+{
+    RangeExecutor executor(4);
+
+    check_run(executor, 0, 10, 4);
+    check_run(executor, 1, 10, 4);
+    check_run(executor, 1000, 1, 4);
+    check_run(executor, 1000, 7, 2);
+    check_run(executor, 1000, 2000, 8);
+    check_run(executor, 10000, 100, 16);
+}
+
+TEST(range_executor, no_worker)
+{
+    // the calling thread does all the work
+    RangeExecutor executor(0);
+
+    check_run(executor, 1000, 10, 4);
+}
+
+TEST(range_executor, concurrent_runs)
+{
+    RangeExecutor            executor(4);
+    std::vector<std::thread> threads;
+
+    for (size_t t = 0; t < 8; t++) {
+        threads.emplace_back([&executor, t]() {
+            check_run(executor, 10000 + t * 1000, 64, 3);
+        });
+    }
+    for (auto& t : threads) {
+        t.join();
+    }
+}
+
+TEST(range_executor, nested_runs)
+{
+    RangeExecutor       executor(2);
+    std::atomic<size_t> total(0);
+
+    auto inner = [&total](uint8_t /*slot*/, size_t min, size_t max) {
+        total += max - min + 1;
+    };
+    auto outer = [&executor, &inner](uint8_t /*slot*/, size_t, size_t) {
+        executor.run(100, 10, 3, inner);
+    };
+
+    executor.run(10, 1, 3, outer);
+
+    ASSERT_EQ(total, 1000);
+}
+
+TEST(range_executor, exception)
+{
+    RangeExecutor executor(4);
+
+    auto job = [](uint8_t /*slot*/, size_t min, size_t max) {
+        if (min <= 500 && 500 <= max) {
+            throw std::runtime_error("Exception in job");
+        }
+    };
+
+    ASSERT_THROW(executor.run(1000, 10, 4, job), std::runtime_error);
+
+    // the executor is still usable
+    check_run(executor, 1000, 10, 4);
+}
+
+} // namespace test
+} // namespace sse
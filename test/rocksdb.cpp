@@ -4,8 +4,12 @@
 
 #include <cstring>
 
+#include <algorithm>
+#include <chrono>
 #include <memory>
 #include <string>
+#include <thread>
+#include <vector>
 
 #include <gtest/gtest.h>
 
@@ -86,6 +90,84 @@ TEST(rocksdb, entry_removal)
     ASSERT_FALSE(db->get(key2, v_get));
 }
 
+TEST(rocksdb, multi_get)
+{
+    cleanup_directory(rocksdb_test_dir);
+
+    std::unique_ptr<sophos::RockDBWrapper> db(
+        new sophos::RockDBWrapper(rocksdb_test_dir));
+
+    std::array<std::array<uint8_t, 2>, 4> keys{
+        {{{0x01, 0x00}}, {{0xFF, 0xFF}}, {{0x02, 0x00}}, {{0x03, 0x00}}}};
+
+    uint64_t v1 = 1789;
+    uint64_t v2 = 31416;
+    uint64_t v3 = 8080;
+
+    ASSERT_TRUE(db->put(keys[0], v1));
+    ASSERT_TRUE(db->put(keys[2], v2));
+    ASSERT_TRUE(db->put(keys[3], v3));
+
+    std::array<uint64_t, 4> values{{0, 0, 0, 0}};
+    bool                    found[4];
+
+    ASSERT_EQ(db->multi_get(keys.data(), keys.size(), values.data(), found),
+              3);
+
+    EXPECT_TRUE(found[0]);
+    EXPECT_FALSE(found[1]);
+    EXPECT_TRUE(found[2]);
+    EXPECT_TRUE(found[3]);
+
+    EXPECT_EQ(values[0], v1);
+    EXPECT_EQ(values[2], v2);
+    EXPECT_EQ(values[3], v3);
+
+    // empty batches are valid
+    ASSERT_EQ(db->multi_get(keys.data(), 0, values.data(), found), 0);
+}
+
+TEST(rocksdb, write_batch)
+{
+    cleanup_directory(rocksdb_test_dir);
+
+    std::unique_ptr<sophos::RockDBWrapper> db(
+        new sophos::RockDBWrapper(rocksdb_test_dir));
+
+    std::array<uint8_t, 2> k1{{0x01, 0x00}};
+    std::array<uint8_t, 2> k2{{0x02, 0x00}};
+    std::array<uint8_t, 2> k3{{0x03, 0x00}};
+
+    uint64_t v1 = 1789;
+    uint64_t v2 = 31416;
+    uint64_t v3 = 8080;
+
+    rocksdb::WriteBatch batch;
+    sophos::RockDBWrapper::put(batch, k1, v1);
+    sophos::RockDBWrapper::put(batch, k2, v2);
+
+    uint64_t v_get;
+    // nothing is written before the batch is committed
+    ASSERT_FALSE(db->get(k1, v_get));
+
+    ASSERT_TRUE(db->write(batch));
+    ASSERT_TRUE(db->sync(false));
+
+    rocksdb::WriteBatch no_wal_batch;
+    sophos::RockDBWrapper::put(no_wal_batch, k3, v3);
+    ASSERT_TRUE(db->write(no_wal_batch, true));
+    ASSERT_TRUE(db->sync(true));
+
+    ASSERT_TRUE(db->get(k1, v_get));
+    EXPECT_EQ(v_get, v1);
+    ASSERT_TRUE(db->get(k2, v_get));
+    EXPECT_EQ(v_get, v2);
+
+    // the writes without WAL were flushed by sync(): they survive a reopening
+    db.reset(new sophos::RockDBWrapper(rocksdb_test_dir));
+    ASSERT_TRUE(db->get(k3, v_get));
+    EXPECT_EQ(v_get, v3);
+}
 
 TEST(rocksdb, entry_persistence)
 {
@@ -170,6 +252,38 @@ TEST(rocksdb, counters)
 }
 
 
+TEST(rocksdb, batched_counters)
+{
+    cleanup_directory(rocksdb_test_dir);
+
+    std::unique_ptr<sophos::RocksDBCounter> db(
+        new sophos::RocksDBCounter(rocksdb_test_dir));
+
+    uint32_t v_get = 0;
+    ASSERT_TRUE(db->set("key1", 41));
+
+    std::vector<uint32_t> vals;
+    ASSERT_TRUE(db->get_and_increment(
+        {"key1", "key2", "key1", "key3", "key2"}, vals));
+    EXPECT_EQ(vals, std::vector<uint32_t>({42, 0, 43, 0, 1}));
+
+    ASSERT_TRUE(db->get("key1", v_get));
+    EXPECT_EQ(v_get, 43);
+    ASSERT_TRUE(db->get("key2", v_get));
+    EXPECT_EQ(v_get, 1);
+
+    // batches and single increments are consistent
+    ASSERT_TRUE(db->get_and_increment("key3", v_get));
+    EXPECT_EQ(v_get, 1);
+
+    ASSERT_TRUE(db->get_and_increment({"key3"}, vals, true));
+    EXPECT_EQ(vals, std::vector<uint32_t>({2}));
+    ASSERT_TRUE(db->sync(true));
+
+    ASSERT_TRUE(db->get_and_increment({}, vals));
+    EXPECT_TRUE(vals.empty());
+}
+
 TEST(rocksdb, counters_persistence)
 {
     cleanup_directory(rocksdb_test_dir);
@@ -212,6 +326,142 @@ TEST(rocksdb, counters_persistence)
     ASSERT_EQ(0, v_get);
 }
 
+TEST(rocksdb, cached_counters)
+{
+    cleanup_directory(rocksdb_test_dir);
+
+    std::unique_ptr<sophos::RocksDBCounter> db(
+        new sophos::RocksDBCounter(rocksdb_test_dir));
+
+    uint32_t v_get = 0;
+
+    // a counter written before the cache is enabled
+    ASSERT_TRUE(db->set("key1", 41));
+
+    // no periodic checkpoint
+    db->enable_cache(std::chrono::milliseconds(0));
+    ASSERT_TRUE(db->cache_enabled());
+
+    ASSERT_TRUE(db->get("key1", v_get));
+    EXPECT_EQ(v_get, 41);
+    ASSERT_TRUE(db->get_and_increment("key1", v_get));
+    EXPECT_EQ(v_get, 42);
+
+    ASSERT_FALSE(db->get("key2", v_get));
+    ASSERT_TRUE(db->get_and_increment("key2", v_get));
+    EXPECT_EQ(v_get, 0);
+    ASSERT_TRUE(db->increment("key3", 10));
+    ASSERT_TRUE(db->get("key3", v_get));
+    EXPECT_EQ(v_get, 10);
+
+    ASSERT_TRUE(db->set("key4", 4));
+    ASSERT_TRUE(db->remove_key("key4"));
+    ASSERT_FALSE(db->get("key4", v_get));
+
+    ASSERT_TRUE(db->checkpoint());
+
+    // concurrent increments
+    const size_t             n_threads    = 8;
+    const size_t             n_increments = 1000;
+    std::vector<std::thread> threads;
+    for (size_t t = 0; t < n_threads; t++) {
+        threads.emplace_back([&db, n_increments]() {
+            uint32_t v;
+            for (size_t i = 0; i < n_increments; i++) {
+                EXPECT_TRUE(db->get_and_increment("key2", v));
+            }
+        });
+    }
+    for (auto& t : threads) {
+        t.join();
+    }
+    ASSERT_TRUE(db->get("key2", v_get));
+    EXPECT_EQ(v_get, n_threads * n_increments);
+
+    // the destructor writes the counters back
+    db.reset(new sophos::RocksDBCounter(rocksdb_test_dir));
+    ASSERT_FALSE(db->cache_enabled());
+
+    ASSERT_TRUE(db->get("key1", v_get));
+    EXPECT_EQ(v_get, 42);
+    ASSERT_TRUE(db->get("key2", v_get));
+    EXPECT_EQ(v_get, n_threads * n_increments);
+    ASSERT_TRUE(db->get("key3", v_get));
+    EXPECT_EQ(v_get, 10);
+    ASSERT_FALSE(db->get("key4", v_get));
+}
+
+TEST(rocksdb, merged_counters)
+{
+    cleanup_directory(rocksdb_test_dir);
+
+    std::unique_ptr<sophos::RocksDBCounter> db(
+        new sophos::RocksDBCounter(rocksdb_test_dir, true));
+
+    ASSERT_TRUE(db->merge_increments());
+    ASSERT_TRUE(db->atomic_increments());
+
+    uint32_t v_get = 0;
+
+    ASSERT_TRUE(db->set("key1", 41));
+    ASSERT_TRUE(db->get_and_increment("key1", v_get));
+    EXPECT_EQ(v_get, 42);
+    ASSERT_TRUE(db->get("key1", v_get));
+    EXPECT_EQ(v_get, 42);
+
+    ASSERT_TRUE(db->get_and_increment("key2", v_get));
+    EXPECT_EQ(v_get, 0);
+    ASSERT_TRUE(db->reserve("key2", 5, v_get));
+    EXPECT_EQ(v_get, 1);
+    ASSERT_TRUE(db->get("key2", v_get));
+    EXPECT_EQ(v_get, 5);
+
+    std::vector<uint32_t> vals;
+    ASSERT_TRUE(db->get_and_increment({"key1", "key3", "key1"}, vals));
+    EXPECT_EQ(vals, std::vector<uint32_t>({43, 0, 44}));
+
+    // concurrent reservations never return the same counter
+    const size_t             n_threads    = 8;
+    const size_t             n_increments = 1000;
+    std::vector<std::thread> threads;
+
+    std::vector<std::vector<uint32_t>> reserved(n_threads);
+    for (size_t t = 0; t < n_threads; t++) {
+        threads.emplace_back([&db, &reserved, t, n_increments]() {
+            uint32_t v;
+            for (size_t i = 0; i < n_increments; i++) {
+                EXPECT_TRUE(db->get_and_increment("key4", v));
+                reserved[t].push_back(v);
+            }
+        });
+    }
+    for (auto& t : threads) {
+        t.join();
+    }
+    std::vector<uint32_t> all_reserved;
+    for (const auto& r : reserved) {
+        all_reserved.insert(all_reserved.end(), r.begin(), r.end());
+    }
+    std::sort(all_reserved.begin(), all_reserved.end());
+    for (size_t i = 0; i < all_reserved.size(); i++) {
+        EXPECT_EQ(all_reserved[i], i);
+    }
+
+    // the merge operands are persisted
+    db.reset(new sophos::RocksDBCounter(rocksdb_test_dir, true));
+
+    ASSERT_TRUE(db->get("key1", v_get));
+    EXPECT_EQ(v_get, 44);
+    ASSERT_TRUE(db->get("key2", v_get));
+    EXPECT_EQ(v_get, 5);
+    ASSERT_TRUE(db->get("key4", v_get));
+    EXPECT_EQ(v_get, n_threads * n_increments - 1);
+
+    ASSERT_TRUE(db->remove_key("key4"));
+    ASSERT_TRUE(db->get_and_increment("key4", v_get));
+    EXPECT_EQ(v_get, 0);
+}
+
 class TestSerializer
 {
 public:
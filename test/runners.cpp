@@ -18,7 +18,9 @@
 #include <map>
 #include <memory>
 #include <mutex>
+#include <set>
 #include <thread>
+#include <vector>
 
 #include <gtest/gtest.h>
 
@@ -131,6 +133,77 @@ TYPED_TEST(RunnerTest, search_async)
     sse::test::test_search_correctness(this->client_, test_db);
 }
 
+TYPED_TEST(RunnerTest, search_small_batches)
+{
+    // use a batch size that does not divide the number of results
+    this->server_->set_search_batch_size(7);
+
+    std::list<uint64_t> long_list;
+    for (size_t i = 0; i < 1000; i++) {
+        long_list.push_back(i);
+    }
+    const std::map<std::string, std::list<uint64_t>> test_db
+        = {{"kw_1", long_list}, {"kw_2", {0}}};
+
+    sse::test::insert_database(this->client_, test_db);
+
+    // synchronous search
+    sse::test::test_search_correctness(this->client_, test_db);
+
+    // asynchronous search
+    this->server_->set_async_search(true);
+    sse::test::test_search_correctness(this->client_, test_db);
+}
+
+TYPED_TEST(RunnerTest, search_async_results_once)
+{
+    // the asynchronous searches push the results from several threads: every
+    // result must be sent exactly once
+    constexpr size_t kResultsCount = 2000;
+
+    this->server_->set_async_search(true);
+    this->server_->set_search_batch_size(7);
+
+    std::list<uint64_t> long_list;
+    for (size_t i = 0; i < kResultsCount; i++) {
+        long_list.push_back(i);
+    }
+    const std::map<std::string, std::list<uint64_t>> test_db
+        = {{"kw_1", long_list}};
+
+    sse::test::insert_database(this->client_, test_db);
+
+    std::vector<uint64_t> res_vec;
+    this->client_->search("kw_1", res_vec);
+    std::sort(res_vec.begin(), res_vec.end());
+
+    const std::vector<uint64_t> expected(long_list.begin(), long_list.end());
+    EXPECT_EQ(res_vec, expected);
+}
+
+TYPED_TEST(RunnerTest, search_vec)
+{
+    const std::map<std::string, std::list<uint64_t>> test_db
+        = {{"kw_1", {0, 1}}, {"kw_2", {0}}, {"kw_3", {0}}};
+
+    sse::test::insert_database(this->client_, test_db);
+
+    std::vector<uint64_t> res_vec;
+    for (const auto& entry : test_db) {
+        this->client_->search(entry.first, res_vec);
+
+        const std::set<uint64_t> res_set(res_vec.begin(), res_vec.end());
+        const std::set<uint64_t> expected_set(entry.second.begin(),
+                                              entry.second.end());
+        EXPECT_EQ(res_set, expected_set);
+        EXPECT_EQ(res_vec.size(), entry.second.size());
+    }
+
+    // results are replaced, not appended
+    this->client_->search("??", res_vec);
+    EXPECT_TRUE(res_vec.empty());
+}
+
 TYPED_TEST(RunnerTest, insert_session)
 {
     this->client_->start_update_session();
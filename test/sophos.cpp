@@ -13,6 +13,7 @@
 #include <map>
 #include <memory>
 #include <mutex>
+#include <set>
 #include <thread>
 
 #include <gtest/gtest.h>
@@ -188,6 +189,47 @@ TEST(sophos, insertion_search)
     EXPECT_EQ(s_req.add_count, 0);
 }
 
+TEST(sophos, bulk_insertion)
+{
+    std::unique_ptr<sophos::SophosClient> client;
+    std::unique_ptr<sophos::SophosServer> server;
+
+    // start by cleaning up the test directory
+    sse::test::cleanup_directory(sophos_test_dir);
+
+    // first, create a client and a server from scratch
+    create_client_server(client, server);
+
+    // mix bulk and single insertions, in interleaved keywords
+    sse::test::insert_entry(client, server, "kw_1", 0);
+
+    std::list<std::pair<std::string, index_type>> update_list;
+    for (index_type i = 1; i < 100; i++) {
+        update_list.emplace_back("kw_1", i);
+        update_list.emplace_back("kw_2", i);
+        if (i % 10 == 0) {
+            update_list.emplace_back("kw_3", i);
+        }
+    }
+
+    auto requests = client->bulk_insertion_request(update_list);
+    EXPECT_EQ(requests.size(), update_list.size());
+    for (const auto& req : requests) {
+        server->insert(req);
+    }
+
+    sse::test::insert_entry(client, server, "kw_2", 100);
+
+    std::map<std::string, std::list<uint64_t>> test_db;
+    test_db["kw_1"].push_back(0);
+    for (const auto& update : update_list) {
+        test_db[update.first].push_back(update.second);
+    }
+    test_db["kw_2"].push_back(100);
+
+    sse::test::test_search_correctness(client, server, test_db);
+}
+
 inline void check_same_results(const std::list<uint64_t>& l1,
                                const std::list<uint64_t>& l2)
 {
@@ -254,6 +296,112 @@ TEST(sophos, search_parallel_light)
     test_search_function(search_fun);
 }
 
+TEST(sophos, search_vec)
+{
+    auto search_fun = [](SophosServer& server, SearchRequest& req) {
+        std::vector<uint64_t> res_vec;
+
+        server.search(req, res_vec);
+
+        EXPECT_EQ(res_vec.size(), req.add_count);
+        return res_vec;
+    };
+    test_search_function(search_fun);
+}
+
+TEST(sophos, search_parallel_vec)
+{
+    auto search_fun = [](SophosServer& server, SearchRequest& req) {
+        std::vector<uint64_t> res_vec;
+
+        server.search_parallel(req, 2, res_vec);
+
+        EXPECT_EQ(res_vec.size(), req.add_count);
+        return res_vec;
+    };
+    test_search_function(search_fun);
+}
+
+TEST(sophos, search_parallel_light_vec)
+{
+    auto search_fun = [](SophosServer& server, SearchRequest& req) {
+        std::vector<uint64_t> res_vec;
+
+        server.search_parallel_light(
+            req, std::thread::hardware_concurrency(), res_vec);
+
+        EXPECT_EQ(res_vec.size(), req.add_count);
+        return res_vec;
+    };
+    test_search_function(search_fun);
+}
+
+TEST(sophos, checkpoint_cache)
+{
+    std::unique_ptr<sophos::SophosClient> client;
+    std::unique_ptr<sophos::SophosServer> server;
+
+    // start by cleaning up the test directory
+    sse::test::cleanup_directory(sophos_test_dir);
+
+    // first, create a client and a server from scratch
+    create_client_server(client, server);
+
+    const std::string keyword = "kw_1";
+    std::set<uint64_t> expected;
+
+    for (uint64_t i = 0; i < 1000; i++) {
+        sse::test::insert_entry(client, server, keyword, i);
+        expected.insert(i);
+    }
+
+    // a checkpoint every 64 tokens
+    server->enable_checkpoint_cache(64, 20);
+
+    SearchRequest req = client->search_request(keyword);
+    auto          res = server->search_parallel(req, 2);
+    EXPECT_EQ(std::set<uint64_t>(res.begin(), res.end()), expected);
+
+    auto stats = server->checkpoint_cache_stats();
+    EXPECT_EQ(stats.lookups, 1);
+    EXPECT_EQ(stats.hits, 0);
+    EXPECT_EQ(stats.checkpoints_count, 1000 / 64);
+
+    for (uint64_t i = 1000; i < 1100; i++) {
+        sse::test::insert_entry(client, server, keyword, i);
+        expected.insert(i);
+    }
+
+    // the older part of the chain is computed from the checkpoints
+    req = client->search_request(keyword);
+    std::vector<uint64_t> res_vec;
+    server->search_parallel(req, 2, res_vec);
+    EXPECT_EQ(std::set<uint64_t>(res_vec.begin(), res_vec.end()), expected);
+
+    stats = server->checkpoint_cache_stats();
+    EXPECT_EQ(stats.lookups, 2);
+    EXPECT_EQ(stats.hits, 1);
+    EXPECT_EQ(stats.checkpoints_count, 1100 / 64);
+    EXPECT_EQ(stats.hit_rate(), 0.5);
+
+    // other keywords evict the least recently used checkpoints
+    for (uint64_t i = 0; i < 1300; i++) {
+        sse::test::insert_entry(client, server, "kw_2", i);
+    }
+    req = client->search_request("kw_2");
+    res = server->search_parallel(req, 2);
+    EXPECT_EQ(res.size(), 1300);
+
+    stats = server->checkpoint_cache_stats();
+    EXPECT_EQ(stats.evicted_keywords, 1);
+    EXPECT_EQ(stats.checkpoints_count, 20);
+
+    server->disable_checkpoint_cache();
+    req = client->search_request(keyword);
+    res = server->search_parallel(req, 2);
+    EXPECT_EQ(std::set<uint64_t>(res.begin(), res.end()), expected);
+}
+
 TEST(sophos, search_callback)
 {
     std::mutex          res_list_mutex;
@@ -5,6 +5,8 @@
 #include <sse/schemes/tethys/tethys_client.hpp>
 #include <sse/schemes/tethys/tethys_server.hpp>
 
+#include <future>
+
 #include <gtest/gtest.h>
 
 
@@ -138,6 +140,18 @@ void test_tethys_builder(size_t n_elements)
         auto bl  = server.search(sr);
         auto res = client.decode_search_results(sr, bl);
 
+        ASSERT_EQ(std::set<index_type>(res.begin(), res.end()),
+                  std::set<index_type>(long_list.begin(), long_list.end()));
+
+        // same search, with all the IOs submitted at once
+        using bucket_pairs_type = std::vector<KeyedBucketPair<kPageSize>>;
+        std::promise<bucket_pairs_type> search_promise;
+        server.async_search(sr, [&search_promise](bucket_pairs_type r) {
+            search_promise.set_value(std::move(r));
+        });
+        res = client.decode_search_results(sr,
+                                           search_promise.get_future().get());
+
         ASSERT_EQ(std::set<index_type>(res.begin(), res.end()),
                   std::set<index_type>(long_list.begin(), long_list.end()));
 
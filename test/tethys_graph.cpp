@@ -1,6 +1,8 @@
 #include <sse/schemes/tethys/details/tethys_graph.hpp>
 
+#include <algorithm>
 #include <iostream>
+#include <random>
 
 #include <gtest/gtest.h>
 
@@ -11,6 +13,40 @@ namespace tethys {
 namespace details {
 namespace test {
 
+TEST(tethys_graph, adjacency)
+{
+    TethysGraph graph(4);
+
+    EdgePtr e_0 = graph.add_edge(0, 1, 0, 2);
+    EdgePtr e_1 = graph.add_edge(1, 1, 1, 0);
+    EdgePtr e_2 = graph.add_edge(2, 1, 0, 3);
+
+    auto to_vector = [](const EdgePtrRange& range) {
+        return std::vector<EdgePtr>(range.begin(), range.end());
+    };
+
+    EXPECT_EQ(to_vector(graph.out_edges(VertexPtr(0))),
+              std::vector<EdgePtr>({e_0, e_2}));
+    EXPECT_EQ(to_vector(graph.in_edges(VertexPtr(0))),
+              std::vector<EdgePtr>({e_1}));
+    EXPECT_EQ(to_vector(graph.residual_edges(VertexPtr(0))),
+              std::vector<EdgePtr>({e_0, e_2, e_1.reciprocal()}));
+    EXPECT_TRUE(graph.out_edges(VertexPtr(2)).empty());
+
+    // adding edges after a query rebuilds the adjacency
+    EdgePtr e_3 = graph.add_edge_from_source(3, 1, 0);
+    EdgePtr e_4 = graph.add_edge_to_sink(4, 1, 2);
+
+    EXPECT_EQ(to_vector(graph.in_edges(VertexPtr(0))),
+              std::vector<EdgePtr>({e_1, e_3}));
+    EXPECT_EQ(to_vector(graph.out_edges(kSourcePtr)),
+              std::vector<EdgePtr>({e_3}));
+    EXPECT_EQ(to_vector(graph.in_edges(kSinkPtr)),
+              std::vector<EdgePtr>({e_4}));
+    EXPECT_EQ(to_vector(graph.out_edges(VertexPtr(2))),
+              std::vector<EdgePtr>({e_4}));
+}
+
 TEST(tethys_graph, dfs_1)
 {
     const size_t graph_size = 6;
@@ -1005,6 +1041,210 @@ TEST(tethys_graph, parallel_maxflow_11)
     EXPECT_EQ(graph.get_vertex_out_flow(kSinkPtr), 0);
 }
 
+TEST(tethys_graph, dinic_maxflow_1)
+{
+    const size_t graph_size = 6;
+    const size_t mid_graph  = graph_size / 2;
+    TethysGraph  graph(graph_size);
+
+    EdgePtr e_0 = graph.add_edge_from_source(0, 2, 0);
+    EdgePtr e_1 = graph.add_edge(1, 2, 0, 0 + mid_graph);
+
+    EdgePtr e_2 = graph.add_edge(2, 1, 0 + mid_graph, 1);
+    EdgePtr e_3 = graph.add_edge_to_sink(3, 1, 1);
+
+    EdgePtr e_4 = graph.add_edge(4, 1, 0 + mid_graph, 2);
+    EdgePtr e_5 = graph.add_edge(5, 1, 2, 1 + mid_graph);
+    EdgePtr e_6 = graph.add_edge_to_sink(6, 1, 1 + mid_graph);
+
+    graph.compute_residual_maxflow(Dinic);
+    graph.transform_residual_to_flow();
+
+    EXPECT_EQ(graph.get_edge_flow(e_0), 2);
+    EXPECT_EQ(graph.get_edge_flow(e_1), 2);
+    EXPECT_EQ(graph.get_edge_flow(e_2), 1);
+    EXPECT_EQ(graph.get_edge_flow(e_3), 1);
+    EXPECT_EQ(graph.get_edge_flow(e_4), 1);
+    EXPECT_EQ(graph.get_edge_flow(e_5), 1);
+    EXPECT_EQ(graph.get_edge_flow(e_6), 1);
+}
+
+TEST(tethys_graph, dinic_maxflow_2)
+{
+    const size_t graph_size = 20;
+    const size_t mid_graph  = graph_size / 2;
+    TethysGraph  graph(graph_size);
+
+    EdgePtr e_source_1 = graph.add_edge_from_source(0, 15, 1);
+    EdgePtr e_source_2 = graph.add_edge_from_source(1, 10, 9);
+
+    graph.add_edge(3, 20, 1, 8 + mid_graph);
+
+    EdgePtr e_sink_1 = graph.add_edge_to_sink(8, 10, 7);
+    EdgePtr e_sink_2 = graph.add_edge_to_sink(15, 12, 8 + mid_graph);
+
+    graph.compute_residual_maxflow(Dinic);
+    graph.transform_residual_to_flow();
+
+
+    size_t flow = graph.get_flow();
+
+    EXPECT_EQ(flow, 12);
+
+    EXPECT_EQ(graph.get_edge_flow(e_source_1), 12);
+    EXPECT_EQ(graph.get_edge_flow(e_source_2), 0);
+
+    EXPECT_EQ(graph.get_edge_flow(e_sink_1), 0);
+    EXPECT_EQ(graph.get_edge_flow(e_sink_2), 12);
+
+    EXPECT_EQ(graph.get_vertex_in_flow(kSinkPtr),
+              graph.get_vertex_out_flow(kSourcePtr));
+    EXPECT_EQ(graph.get_vertex_in_flow(kSinkPtr), flow);
+    EXPECT_EQ(graph.get_vertex_out_flow(kSinkPtr),
+              graph.get_vertex_in_flow(kSourcePtr));
+    EXPECT_EQ(graph.get_vertex_out_flow(kSinkPtr), 0);
+}
+
+// Build a random graph, with the source and sink edges added the same way
+// as TethysAllocator does
+static void build_random_allocation_graph(TethysGraph& graph,
+                                          size_t       graph_size,
+                                          size_t       n_edges,
+                                          size_t       page_size,
+                                          uint32_t     seed)
+{
+    const size_t mid_graph = graph_size / 2;
+
+    std::mt19937                          gen(seed);
+    std::uniform_int_distribution<size_t> vertex_dist(0, mid_graph - 1);
+    std::uniform_int_distribution<size_t> cap_dist(1, page_size);
+
+    for (size_t i = 0; i < n_edges; i++) {
+        size_t cap   = cap_dist(gen);
+        size_t start = vertex_dist(gen);
+        size_t end   = mid_graph + vertex_dist(gen);
+        graph.add_edge(i, cap, start, end);
+    }
+
+    // query the graph before adding edges, not to rebuild its adjacency
+    std::vector<size_t> out_capacities;
+    for (size_t v = 0; v < graph_size; v++) {
+        size_t d = graph.get_vertex_out_capacity(VertexPtr(v));
+        out_capacities.push_back(d);
+    }
+    for (size_t v = 0; v < graph_size; v++) {
+        size_t d = out_capacities[v];
+        if (d > page_size) {
+            graph.add_edge_from_source(~0UL, d - page_size, v);
+        } else if (d < page_size) {
+            graph.add_edge_to_sink(~0UL, page_size - d, v);
+        }
+    }
+}
+
+static void check_flow_validity(const TethysGraph& graph,
+                                size_t             graph_size,
+                                size_t             n_edges)
+{
+    for (size_t v = 0; v < graph_size; v++) {
+        EXPECT_EQ(graph.get_vertex_in_flow(VertexPtr(v)),
+                  graph.get_vertex_out_flow(VertexPtr(v)));
+    }
+    for (size_t i = 0; i < n_edges; i++) {
+        EXPECT_LE(graph.get_edge_flow(EdgePtr(i)),
+                  graph.get_edge_capacity(EdgePtr(i)));
+    }
+}
+
+// Check that Dinic finds a valid flow with the same value as Ford-Fulkerson
+TEST(tethys_graph, dinic_random_graphs)
+{
+    const size_t graph_size = 200;
+    const size_t page_size  = 10;
+    const size_t n_edges    = 150;
+
+    for (uint32_t seed = 0; seed < 20; seed++) {
+        TethysGraph ff_graph(graph_size);
+        TethysGraph dinic_graph(graph_size);
+
+        build_random_allocation_graph(
+            ff_graph, graph_size, n_edges, page_size, seed);
+        build_random_allocation_graph(
+            dinic_graph, graph_size, n_edges, page_size, seed);
+
+        ff_graph.compute_residual_maxflow(FordFulkerson);
+        ff_graph.transform_residual_to_flow();
+        dinic_graph.compute_residual_maxflow(Dinic);
+        dinic_graph.transform_residual_to_flow();
+
+        ASSERT_EQ(dinic_graph.get_flow(), ff_graph.get_flow());
+        check_flow_validity(dinic_graph, graph_size, n_edges);
+    }
+}
+
+TEST(tethys_graph, connected_components)
+{
+    TethysGraph graph(8);
+
+    graph.add_edge(0, 1, 0, 4);
+    graph.add_edge(1, 1, 1, 4);
+    graph.add_edge(2, 1, 2, 5);
+    graph.add_edge(3, 1, 3, 5);
+    graph.add_edge(4, 1, 2, 6);
+    graph.add_edge_from_source(5, 1, 7);
+    graph.add_edge_to_sink(6, 1, 0);
+
+    graph.compute_connected_components();
+
+    auto component = [&graph](size_t v) {
+        return graph.get_vertex(VertexPtr(v)).component;
+    };
+
+    // numbered by smallest vertex
+    EXPECT_EQ(component(0), 1);
+    EXPECT_EQ(component(1), 1);
+    EXPECT_EQ(component(4), 1);
+    EXPECT_EQ(component(2), 2);
+    EXPECT_EQ(component(3), 2);
+    EXPECT_EQ(component(5), 2);
+    EXPECT_EQ(component(6), 2);
+    // the source and sink edges do not connect vertices
+    EXPECT_EQ(component(7), 0);
+}
+
+// Run the parallel Dinic on graphs made of many components, some of them
+// large enough to get their own job
+TEST(tethys_graph, parallel_dinic_random_graphs)
+{
+    const size_t page_size = 10;
+
+    // more threads than cores, so that the jobs overlap even on a small
+    // machine
+    ThreadPool pool(8);
+
+    for (size_t graph_size : {200UL, 20000UL}) {
+        const size_t n_edges = 3 * graph_size / 4;
+
+        for (uint32_t seed = 0; seed < 5; seed++) {
+            TethysGraph reference_graph(graph_size);
+            TethysGraph dinic_graph(graph_size);
+
+            build_random_allocation_graph(
+                reference_graph, graph_size, n_edges, page_size, seed);
+            build_random_allocation_graph(
+                dinic_graph, graph_size, n_edges, page_size, seed);
+
+            reference_graph.compute_residual_maxflow(Dinic);
+            reference_graph.transform_residual_to_flow();
+            dinic_graph.parallel_compute_residual_maxflow(pool, Dinic);
+            dinic_graph.transform_residual_to_flow();
+
+            ASSERT_EQ(dinic_graph.get_flow(), reference_graph.get_flow());
+            check_flow_validity(dinic_graph, graph_size, n_edges);
+        }
+    }
+}
+
 } // namespace test
 } // namespace details
 } // namespace tethys
@@ -5,6 +5,9 @@
 #include <sse/schemes/tethys/tethys_store.hpp>
 #include <sse/schemes/tethys/tethys_store_builder.hpp>
 
+#include <future>
+#include <random>
+
 #include <gtest/gtest.h>
 
 
@@ -31,6 +34,7 @@ struct Hasher
 const std::string test_dir   = "tethys_store_test";
 const std::string table_path = test_dir + "/tethys_table.bin";
 const std::string stash_path = test_dir + "/tethys_stash.bin";
+const std::string spill_path = test_dir + "/tethys_spill.bin";
 
 // construct key-value pairs that force an overflow after the lists have a
 // certain size
@@ -117,13 +121,16 @@ size_t get_encoded_number_elements(
     return n_elts;
 }
 
-void build_store(size_t v_size, bool& valid_v_size)
+void build_store(size_t v_size, bool& valid_v_size, bool spill = false)
 {
     TethysStoreBuilderParam builder_params;
     builder_params.max_n_elements    = 0;
     builder_params.tethys_table_path = table_path;
     builder_params.tethys_stash_path = stash_path;
     builder_params.epsilon           = 0.1;
+    if (spill) {
+        builder_params.spill_path = spill_path;
+    }
 
     using encoder_type
         = encoders::EncodeSeparateEncoder<key_type, size_t, kPageSize>;
@@ -172,6 +179,27 @@ void test_store(size_t v_size)
         ASSERT_EQ(std::set<size_t>(res.begin(), res.end()),
                   std::set<size_t>(kv.second.begin(), kv.second.end()));
     }
+
+    // batched async reads, with the same key twice in the batch
+    std::vector<key_type> keys;
+    for (const auto& kv : test_kv) {
+        keys.push_back(kv.first);
+    }
+    keys.push_back(test_kv.front().first);
+
+    std::promise<std::vector<std::vector<size_t>>> lists_promise;
+    store.async_get_lists(keys,
+                          [&lists_promise](std::vector<std::vector<size_t>> l) {
+                              lists_promise.set_value(std::move(l));
+                          });
+    std::vector<std::vector<size_t>> lists = lists_promise.get_future().get();
+
+    ASSERT_EQ(lists.size(), keys.size());
+    for (size_t i = 0; i < keys.size(); i++) {
+        const auto& expected = test_kv[i % test_kv.size()].second;
+        ASSERT_EQ(std::set<size_t>(lists[i].begin(), lists[i].end()),
+                  std::set<size_t>(expected.begin(), expected.end()));
+    }
 }
 
 static void cleanup_store()
@@ -211,6 +239,81 @@ TEST_P(TethysStoreOverflowTest, build_and_get)
     cleanup_store();
 }
 
+TEST_P(TethysStoreOverflowTest, spilled_build_and_get)
+{
+    size_t v_size = GetParam();
+    bool   valid_v_size;
+
+    build_store(v_size, valid_v_size, true);
+    // the spill log is removed with the builder
+    ASSERT_FALSE(sse::utility::is_file(spill_path));
+
+    if (valid_v_size) {
+        test_store(v_size);
+    }
+    cleanup_store();
+}
+
+// enough lists for the table to be encoded in several runs, and written with
+// direct IOs
+TEST(tethys_store, large_direct_io_build_and_get)
+{
+    constexpr size_t kListsCount = 3000;
+    constexpr size_t kListSize   = 100;
+
+    using encoder_type
+        = encoders::EncodeSeparateEncoder<key_type, size_t, kPageSize>;
+
+    cleanup_store();
+    sse::utility::create_directory(test_dir, static_cast<mode_t>(0700));
+
+    std::mt19937_64                                       rng(0x5EED);
+    std::vector<std::pair<key_type, std::vector<size_t>>> test_kv;
+    for (size_t i = 0; i < kListsCount; i++) {
+        key_type key;
+        for (auto& byte : key) {
+            byte = static_cast<uint8_t>(rng());
+        }
+        std::vector<size_t> list(kListSize);
+        for (size_t j = 0; j < kListSize; j++) {
+            list[j] = i * kListSize + j;
+        }
+        test_kv.emplace_back(key, std::move(list));
+    }
+
+    {
+        TethysStoreBuilderParam builder_params;
+        builder_params.tethys_table_path = table_path;
+        builder_params.tethys_stash_path = stash_path;
+        builder_params.epsilon           = 0.1;
+        builder_params.direct_io         = true;
+        builder_params.max_n_elements
+            = get_encoded_number_elements<encoder_type>(test_kv);
+
+        TethysStoreBuilder<kPageSize, key_type, size_t, Hasher, encoder_type>
+            store_builder(builder_params);
+        for (const auto& kv : test_kv) {
+            store_builder.insert_list(kv.first, kv.second);
+        }
+        store_builder.build();
+    }
+
+    TethysStore<kPageSize,
+                key_type,
+                size_t,
+                Hasher,
+                encoders::EncodeSeparateDecoder<key_type, size_t, kPageSize>>
+        store(table_path, stash_path);
+
+    for (const auto& kv : test_kv) {
+        std::vector<size_t> res = store.get_list(kv.first);
+
+        ASSERT_EQ(std::set<size_t>(res.begin(), res.end()),
+                  std::set<size_t>(kv.second.begin(), kv.second.end()));
+    }
+    cleanup_store();
+}
+
 INSTANTIATE_TEST_SUITE_P(VariableListLengthTest,
                          TethysStoreOverflowTest,
                          testing::Values(20, 450, 600),